@@ -180,6 +180,17 @@ unknown_opt:
     }
 }
 
+void uninit_opts(void)
+{
+    int i;
+    for (i = 0; i < CODEC_TYPE_NB; i++)
+        av_freep(&avcodec_opts[i]);
+    av_freep(&avformat_opts);
+    av_freep(&sws_opts);
+    av_freep(&opt_names);
+    opt_name_count = 0;
+}
+
 int opt_default(const char *opt, const char *arg){
     int type;
     int ret= 0;
@@ -44,6 +44,12 @@ extern AVCodecContext *avcodec_opts[CODEC_TYPE_NB];
 extern AVFormatContext *avformat_opts;
 extern struct SwsContext *sws_opts;
 
+/**
+ * Frees the contexts used to store generic options and forgets the
+ * names of the options set through opt_default().
+ */
+void uninit_opts(void);
+
 /**
  * Fallback for options that are not explicitly handled, these will be
  * parsed through AVOptions.
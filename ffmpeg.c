@@ -30,6 +30,7 @@
 #include <errno.h>
 #include <signal.h>
 #include <limits.h>
+#include <setjmp.h>
 #include <unistd.h>
 #include "libavformat/avformat.h"
 #include "libavdevice/avdevice.h"
@@ -41,6 +42,10 @@
 #include "libavutil/avstring.h"
 #include "libavformat/os_support.h"
 
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
 #if HAVE_SYS_RESOURCE_H
 #include <sys/types.h>
 #include <sys/resource.h>
@@ -91,10 +96,12 @@ static const OptionDef options[];
 
 #define MAX_FILES 20
 
-static char *last_asked_format = NULL;
+/* packets read ahead on each input when several inputs are read in parallel */
+#define INPUT_QUEUE_SIZE 32
+
 static AVFormatContext *input_files[MAX_FILES];
 static int64_t input_files_ts_offset[MAX_FILES];
-static double input_files_ts_scale[MAX_FILES][MAX_STREAMS];
+static int64_t input_files_trim_pts[MAX_FILES];
 static AVCodec *input_codecs[MAX_FILES*MAX_STREAMS];
 static int nb_input_files = 0;
 static int nb_icodecs;
@@ -104,116 +111,161 @@ static AVCodec *output_codecs[MAX_FILES*MAX_STREAMS];
 static int nb_output_files = 0;
 static int nb_ocodecs;
 
-static AVStreamMap stream_maps[MAX_FILES*MAX_STREAMS];
-static int nb_stream_maps;
-
-static AVMetaDataMap meta_data_maps[MAX_FILES];
-static int nb_meta_data_maps;
-
-static int frame_width  = 0;
-static int frame_height = 0;
-static float frame_aspect_ratio = 0;
-static enum PixelFormat frame_pix_fmt = PIX_FMT_NONE;
-static enum SampleFormat audio_sample_fmt = SAMPLE_FMT_NONE;
-static int frame_padtop  = 0;
-static int frame_padbottom = 0;
-static int frame_padleft  = 0;
-static int frame_padright = 0;
-static int padcolor[3] = {16,128,128}; /* default to black */
-static int frame_topBand  = 0;
-static int frame_bottomBand = 0;
-static int frame_leftBand  = 0;
-static int frame_rightBand = 0;
-static int max_frames[4] = {INT_MAX, INT_MAX, INT_MAX, INT_MAX};
-static AVRational frame_rate;
-static float video_qscale = 0;
-static uint16_t *intra_matrix = NULL;
-static uint16_t *inter_matrix = NULL;
-static const char *video_rc_override_string=NULL;
-static int video_disable = 0;
-static int video_discard = 0;
-static char *video_codec_name = NULL;
-static int video_codec_tag = 0;
-static int same_quality = 0;
-static int do_deinterlace = 0;
-static int top_field_first = -1;
-static int me_threshold = 0;
-static int intra_dc_precision = 8;
-static int loop_input = 0;
-static int loop_output = AVFMT_NOOUTPUTLOOP;
-static int qp_hist = 0;
-
-static int intra_only = 0;
-static int audio_sample_rate = 44100;
-static int64_t channel_layout = 0;
 #define QSCALE_NONE -99999
-static float audio_qscale = QSCALE_NONE;
-static int audio_disable = 0;
-static int audio_channels = 1;
-static char  *audio_codec_name = NULL;
-static int audio_codec_tag = 0;
-static char *audio_language = NULL;
-
-static int subtitle_disable = 0;
-static char *subtitle_codec_name = NULL;
-static char *subtitle_language = NULL;
-static int subtitle_codec_tag = 0;
-
-static float mux_preload= 0.5;
-static float mux_max_delay= 0.7;
-
-static int64_t recording_time = INT64_MAX;
-static int64_t start_time = 0;
-static int64_t rec_timestamp = 0;
-static int64_t input_ts_offset = 0;
-static int file_overwrite = 0;
-static int metadata_count;
-static AVMetadataTag *metadata;
-static int do_benchmark = 0;
-static int do_hex_dump = 0;
-static int do_pkt_dump = 0;
-static int do_psnr = 0;
-static int do_pass = 0;
-static char *pass_logfilename_prefix = NULL;
-static int audio_stream_copy = 0;
-static int video_stream_copy = 0;
-static int subtitle_stream_copy = 0;
-static int video_sync_method= -1;
-static int audio_sync_method= 0;
-static float audio_drift_threshold= 0.1;
-static int copy_ts= 0;
-static int opt_shortest = 0;
-static int video_global_header = 0;
-static char *vstats_filename;
-static FILE *vstats_file;
-static int opt_programid = 0;
-static int copy_initial_nonkeyframes = 0;
-
-static int rate_emu = 0;
 
-static int  video_channel = 0;
-static char *video_standard;
+/**
+ * Settings given on the command line. They apply to one run, a batch job
+ * starts again from default_run_opts.
+ */
+typedef struct RunOptions {
+    char *last_asked_format;
+    double input_files_ts_scale[MAX_FILES][MAX_STREAMS];
+
+    AVStreamMap stream_maps[MAX_FILES*MAX_STREAMS];
+    int nb_stream_maps;
+
+    AVMetaDataMap meta_data_maps[MAX_FILES];
+    int nb_meta_data_maps;
+
+    int frame_width;
+    int frame_height;
+    float frame_aspect_ratio;
+    enum PixelFormat frame_pix_fmt;
+    enum SampleFormat audio_sample_fmt;
+    int frame_padtop;
+    int frame_padbottom;
+    int frame_padleft;
+    int frame_padright;
+    int padcolor[3];
+    int frame_topBand;
+    int frame_bottomBand;
+    int frame_leftBand;
+    int frame_rightBand;
+    int max_frames[4];
+    AVRational frame_rate;
+    float video_qscale;
+    uint16_t *intra_matrix;
+    uint16_t *inter_matrix;
+    const char *video_rc_override_string;
+    int video_disable;
+    int video_discard;
+    char *video_codec_name;
+    int video_codec_tag;
+    int same_quality;
+    int do_deinterlace;
+    int top_field_first;
+    int me_threshold;
+    int intra_dc_precision;
+    int loop_input;
+    int loop_output;
+    int qp_hist;
+
+    int intra_only;
+    int audio_sample_rate;
+    int64_t channel_layout;
+    float audio_qscale;
+    int audio_disable;
+    int audio_channels;
+    char *audio_codec_name;
+    int audio_codec_tag;
+    char *audio_language;
+
+    int subtitle_disable;
+    char *subtitle_codec_name;
+    char *subtitle_language;
+    int subtitle_codec_tag;
+
+    float mux_preload;
+    float mux_max_delay;
+
+    int64_t recording_time;
+    int64_t start_time;
+    int64_t rec_timestamp;
+    int64_t input_ts_offset;
+    int accurate_seek;
+    int file_overwrite;
+    int metadata_count;
+    AVMetadataTag *metadata;
+    int do_benchmark;
+    int do_hex_dump;
+    int do_pkt_dump;
+    int do_psnr;
+    int do_ssim;
+    int do_pass;
+    char *pass_logfilename_prefix;
+    int audio_stream_copy;
+    int video_stream_copy;
+    int subtitle_stream_copy;
+    int video_sync_method;
+    int audio_sync_method;
+    float audio_drift_threshold;
+    int copy_ts;
+    int opt_shortest;
+    int video_global_header;
+    char *vstats_filename;
+    int opt_programid;
+    int copy_initial_nonkeyframes;
+
+    int rate_emu;
+
+    int  video_channel;
+    char *video_standard;
+
+    int audio_volume;
+
+    int exit_on_error;
+    int verbose;
+    int thread_count;
+    int input_sync;
+    uint64_t limit_filesize;
+    int force_fps;
+
+    int pgmyuv_compatibility_hack;
+    float dts_delta_threshold;
+
+    unsigned int sws_flags;
+
+    AVBitStreamFilterContext *video_bitstream_filters;
+    AVBitStreamFilterContext *audio_bitstream_filters;
+    AVBitStreamFilterContext *subtitle_bitstream_filters;
+} RunOptions;
+
+static const RunOptions default_run_opts = {
+    .frame_pix_fmt = PIX_FMT_NONE,
+    .audio_sample_fmt = SAMPLE_FMT_NONE,
+    .padcolor = {16,128,128}, /* default to black */
+    .max_frames = {INT_MAX, INT_MAX, INT_MAX, INT_MAX},
+    .top_field_first = -1,
+    .intra_dc_precision = 8,
+    .loop_output = AVFMT_NOOUTPUTLOOP,
+    .audio_sample_rate = 44100,
+    .audio_qscale = QSCALE_NONE,
+    .audio_channels = 1,
+    .mux_preload = 0.5,
+    .mux_max_delay = 0.7,
+    .recording_time = INT64_MAX,
+    .video_sync_method = -1,
+    .audio_drift_threshold = 0.1,
+    .audio_volume = 256,
+    .verbose = 1,
+    .thread_count = 1,
+    .dts_delta_threshold = 10,
+    .sws_flags = SWS_BICUBIC,
+};
 
-static int audio_volume = 256;
+static RunOptions run_opts;
 
-static int exit_on_error = 0;
+static FILE *vstats_file;
+static char *batch_filename = NULL;
+static jmp_buf batch_job_env;
+static int in_batch_job = 0;
 static int using_stdin = 0;
-static int verbose = 1;
-static int thread_count= 1;
 static int q_pressed = 0;
 static int64_t video_size = 0;
 static int64_t audio_size = 0;
 static int64_t extra_size = 0;
 static int nb_frames_dup = 0;
 static int nb_frames_drop = 0;
-static int input_sync;
-static uint64_t limit_filesize = 0;
-static int force_fps = 0;
-
-static int pgmyuv_compatibility_hack=0;
-static float dts_delta_threshold = 10;
-
-static unsigned int sws_flags = SWS_BICUBIC;
 
 static int64_t timer_start;
 
@@ -223,15 +275,45 @@ static uint8_t *audio_out2;
 
 static short *samples;
 
-static AVBitStreamFilterContext *video_bitstream_filters=NULL;
-static AVBitStreamFilterContext *audio_bitstream_filters=NULL;
-static AVBitStreamFilterContext *subtitle_bitstream_filters=NULL;
 static AVBitStreamFilterContext *bitstream_filters[MAX_FILES][MAX_STREAMS];
 
 #define DEFAULT_PASS_LOGFILENAME_PREFIX "ffmpeg2pass"
 
 struct AVInputStream;
 
+/* encoder input picture waiting for its decoded counterpart */
+typedef struct MetricFrame {
+    AVPicture pict;
+    int64_t pts;
+} MetricFrame;
+
+typedef struct MetricJob {
+    struct MetricContext *m;
+    int plane;
+    int y0, y1;              /* rows of 4x4 blocks this job measures */
+    int last;                /* also measures the rows below the last block row */
+    int (*sums)[4];          /* 4x4 block sums of two block rows */
+    int64_t sse;
+    double ssim;
+} MetricJob;
+
+/* in-loop PSNR/SSIM measurement of an encoded video stream */
+typedef struct MetricContext {
+    AVCodecContext *dec;     /* decodes the encoder output again */
+    AVFrame *frame;
+    AVFifoBuffer *refs;      /* MetricFrame */
+    const AVPicture *ref, *cmp;
+    enum PixelFormat pix_fmt;
+    int width[3], height[3];
+    int nb_planes;
+    MetricJob *jobs;
+    int nb_jobs;
+    int warned;
+    uint64_t frames;
+    double sse[3], ssim;     /* sums over all measured frames */
+    double frame_sse[3], frame_ssim;
+} MetricContext;
+
 typedef struct AVOutputStream {
     int file_index;          /* file index */
     int index;               /* stream index in the output file */
@@ -283,6 +365,8 @@ typedef struct AVOutputStream {
     AVAudioConvert *reformat_ctx;
     AVFifoBuffer *fifo;     /* for compression: one audio fifo per codec */
     FILE *logfile;
+
+    MetricContext *metric;  /* -ssim quality measurement */
 } AVOutputStream;
 
 typedef struct AVInputStream {
@@ -298,6 +382,9 @@ typedef struct AVInputStream {
                                 is not defined */
     int64_t       pts;       /* current pts */
     int is_start;            /* is 1 at the start and after a discontinuity */
+    int64_t trim_pts;        /* decoded data before this pts is dropped */
+    enum AVDiscard skip_frame; /* decoder skip_frame setting after trim_pts */
+    int repeat_pict;         /* parser repeat_pict of the current packet, -1 if not parsed */
 } AVInputStream;
 
 typedef struct AVInputFile {
@@ -305,8 +392,27 @@ typedef struct AVInputFile {
     int ist_index;        /* index of first stream in ist_table */
     int buffer_size;      /* current total buffer size */
     int nb_streams;       /* nb streams we are aware of */
+#if HAVE_PTHREADS
+    AVFormatContext *ctx;
+    pthread_t thread;     /* reads the packets of the file into fifo */
+    pthread_mutex_t fifo_lock;
+    pthread_cond_t fifo_cond;
+    AVFifoBuffer *fifo;   /* packets read ahead, NULL if no thread is used */
+    int finished;         /* the thread stopped, ret is its last error */
+    int ret;
+    int nb_stalls;        /* number of times no packet was ready */
+    int64_t stall_time;   /* time spent waiting for its packets */
+    int64_t full_time;    /* time its thread spent waiting for room in fifo */
+#endif
 } AVInputFile;
 
+/* a packet in the fifo of an input thread, with the parser state it was
+   read with, so that the main loop never looks at the parser */
+typedef struct AVInputPacket {
+    AVPacket pkt;
+    int repeat_pict;      /* parser repeat_pict of pkt, -1 if not parsed */
+} AVInputPacket;
+
 #if HAVE_TERMIOS_H
 
 /* init terminal so that we can grab keys */
@@ -391,23 +497,39 @@ static int read_key(void)
     return -1;
 }
 
+#if HAVE_PTHREADS
+static volatile int input_threads_stop = 0;
+#endif
+
 static int decode_interrupt_cb(void)
 {
-    return q_pressed || (q_pressed = read_key() == 'q');
+#if HAVE_PTHREADS
+    if (input_threads_stop)
+        return 1;
+#endif
+    return q_pressed || (!using_stdin && (q_pressed = read_key() == 'q'));
 }
 
-static int av_exit(int ret)
+static void close_files(void)
 {
     int i;
 
-    /* close files */
     for(i=0;i<nb_output_files;i++) {
         /* maybe av_close_output_file ??? */
         AVFormatContext *s = output_files[i];
         int j;
         if (!(s->oformat->flags & AVFMT_NOFILE) && s->pb)
             url_fclose(s->pb);
+        /* left over by a job which failed before av_write_trailer() */
+        while (s->packet_buffer) {
+            AVPacketList *pktl = s->packet_buffer;
+            s->packet_buffer = pktl->next;
+            av_free_packet(&pktl->pkt);
+            av_free(pktl);
+        }
+        av_freep(&s->priv_data);
         for(j=0;j<s->nb_streams;j++) {
+            av_freep(&s->streams[j]->priv_data);
             av_metadata_free(&s->streams[j]->metadata);
             av_free(s->streams[j]->codec);
             av_free(s->streams[j]);
@@ -421,33 +543,42 @@ static int av_exit(int ret)
         av_metadata_free(&s->metadata);
         av_free(s);
     }
+    nb_output_files = 0;
+
     for(i=0;i<nb_input_files;i++)
         av_close_input_file(input_files[i]);
+    nb_input_files = 0;
+}
+
+static int av_exit(int ret)
+{
+    if (in_batch_job && !received_sigterm) {
+        /* only abort the current job of a batch */
+        in_batch_job = 0;
+        longjmp(batch_job_env, 1);
+    }
 
-    av_free(intra_matrix);
-    av_free(inter_matrix);
+    close_files();
+
+    av_free(run_opts.intra_matrix);
+    av_free(run_opts.inter_matrix);
 
     if (vstats_file)
         fclose(vstats_file);
-    av_free(vstats_filename);
-
-    av_free(opt_names);
+    av_free(run_opts.vstats_filename);
 
-    av_free(video_codec_name);
-    av_free(audio_codec_name);
-    av_free(subtitle_codec_name);
+    av_free(run_opts.video_codec_name);
+    av_free(run_opts.audio_codec_name);
+    av_free(run_opts.subtitle_codec_name);
 
-    av_free(video_standard);
+    av_free(run_opts.video_standard);
 
 #if CONFIG_POWERPC_PERF
     void powerpc_display_perf_report(void);
     powerpc_display_perf_report();
 #endif /* CONFIG_POWERPC_PERF */
 
-    for (i=0;i<CODEC_TYPE_NB;i++)
-        av_free(avcodec_opts[i]);
-    av_free(avformat_opts);
-    av_free(sws_opts);
+    uninit_opts();
     av_free(audio_buf);
     av_free(audio_out);
     av_free(audio_out2);
@@ -489,9 +620,9 @@ static int read_ffserver_streams(AVFormatContext *s, const char *filename)
         memcpy(st->codec, ic->streams[i]->codec, sizeof(AVCodecContext));
         s->streams[i] = st;
 
-        if (st->codec->codec_type == CODEC_TYPE_AUDIO && audio_stream_copy)
+        if (st->codec->codec_type == CODEC_TYPE_AUDIO && run_opts.audio_stream_copy)
             st->stream_copy = 1;
-        else if (st->codec->codec_type == CODEC_TYPE_VIDEO && video_stream_copy)
+        else if (st->codec->codec_type == CODEC_TYPE_VIDEO && run_opts.video_stream_copy)
             st->stream_copy = 1;
 
         if(!st->codec->thread_count)
@@ -514,10 +645,10 @@ static double
 get_sync_ipts(const AVOutputStream *ost)
 {
     const AVInputStream *ist = ost->sync_ist;
-    return (double)(ist->pts - start_time)/AV_TIME_BASE;
+    return (double)(ist->pts - run_opts.start_time)/AV_TIME_BASE;
 }
 
-static void write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx, AVBitStreamFilterContext *bsfc){
+static int write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx, AVBitStreamFilterContext *bsfc){
     int ret;
 
     while(bsfc){
@@ -534,8 +665,8 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx
                     bsfc->filter->name, pkt->stream_index,
                     avctx->codec ? avctx->codec->name : "copy");
             print_error("", a);
-            if (exit_on_error)
-                av_exit(1);
+            if (run_opts.exit_on_error)
+                return AVERROR(EINVAL);
         }
         *pkt= new_pkt;
 
@@ -545,16 +676,17 @@ static void write_frame(AVFormatContext *s, AVPacket *pkt, AVCodecContext *avctx
     ret= av_interleaved_write_frame(s, pkt);
     if(ret < 0){
         print_error("av_interleaved_write_frame()", ret);
-        av_exit(1);
+        return AVERROR(EIO);
     }
+    return 0;
 }
 
 #define MAX_AUDIO_PACKET_SIZE (128 * 1024)
 
-static void do_audio_out(AVFormatContext *s,
-                         AVOutputStream *ost,
-                         AVInputStream *ist,
-                         unsigned char *buf, int size)
+static int do_audio_out(AVFormatContext *s,
+                        AVOutputStream *ost,
+                        AVInputStream *ist,
+                        unsigned char *buf, int size)
 {
     uint8_t *buftmp;
     const int audio_out_size= 4*MAX_AUDIO_PACKET_SIZE;
@@ -571,7 +703,7 @@ static void do_audio_out(AVFormatContext *s,
     if (!audio_out)
         audio_out = av_malloc(audio_out_size);
     if (!audio_buf || !audio_out)
-        return;               /* Should signal an error ! */
+        return AVERROR(ENOMEM);
 
     if (enc->channels != dec->channels)
         ost->audio_resample = 1;
@@ -587,7 +719,7 @@ static void do_audio_out(AVFormatContext *s,
             fprintf(stderr, "Can not resample %d channels @ %d Hz to %d channels @ %d Hz\n",
                     dec->channels, dec->sample_rate,
                     enc->channels, enc->sample_rate);
-            av_exit(1);
+            return AVERROR(EINVAL);
         }
     }
 
@@ -597,7 +729,7 @@ static void do_audio_out(AVFormatContext *s,
         if (!audio_out2)
             audio_out2 = av_malloc(audio_out_size);
         if (!audio_out2)
-            av_exit(1);
+            return AVERROR(ENOMEM);
         if (ost->reformat_ctx)
             av_audio_convert_free(ost->reformat_ctx);
         ost->reformat_ctx = av_audio_convert_alloc(enc->sample_fmt, 1,
@@ -606,12 +738,12 @@ static void do_audio_out(AVFormatContext *s,
             fprintf(stderr, "Cannot convert %s sample format to %s sample format\n",
                 avcodec_get_sample_fmt_name(dec->sample_fmt),
                 avcodec_get_sample_fmt_name(enc->sample_fmt));
-            av_exit(1);
+            return AVERROR(EINVAL);
         }
         ost->reformat_pair=MAKE_SFMT_PAIR(enc->sample_fmt,dec->sample_fmt);
     }
 
-    if(audio_sync_method){
+    if(run_opts.audio_sync_method){
         double delta = get_sync_ipts(ost) * enc->sample_rate - ost->sync_opts
                 - av_fifo_size(ost->fifo)/(ost->st->codec->channels * 2);
         double idelta= delta*ist->st->codec->sample_rate / enc->sample_rate;
@@ -619,15 +751,15 @@ static void do_audio_out(AVFormatContext *s,
 
         //FIXME resample delay
         if(fabs(delta) > 50){
-            if(ist->is_start || fabs(delta) > audio_drift_threshold*enc->sample_rate){
+            if(ist->is_start || fabs(delta) > run_opts.audio_drift_threshold*enc->sample_rate){
                 if(byte_delta < 0){
                     byte_delta= FFMAX(byte_delta, -size);
                     size += byte_delta;
                     buf  -= byte_delta;
-                    if(verbose > 2)
+                    if(run_opts.verbose > 2)
                         fprintf(stderr, "discarding %d audio samples\n", (int)-delta);
                     if(!size)
-                        return;
+                        return 0;
                     ist->is_start=0;
                 }else{
                     static uint8_t *input_tmp= NULL;
@@ -642,13 +774,13 @@ static void do_audio_out(AVFormatContext *s,
                     memcpy(input_tmp + byte_delta, buf, size);
                     buf= input_tmp;
                     size += byte_delta;
-                    if(verbose > 2)
+                    if(run_opts.verbose > 2)
                         fprintf(stderr, "adding %d audio samples of silence\n", (int)delta);
                 }
-            }else if(audio_sync_method>1){
-                int comp= av_clip(delta, -audio_sync_method, audio_sync_method);
+            }else if(run_opts.audio_sync_method>1){
+                int comp= av_clip(delta, -run_opts.audio_sync_method, run_opts.audio_sync_method);
                 assert(ost->audio_resample);
-                if(verbose > 2)
+                if(run_opts.verbose > 2)
                     fprintf(stderr, "compensating audio timestamp drift:%f compensation:%d in:%d\n", delta, comp, enc->sample_rate);
 //                fprintf(stderr, "drift:%f len:%d opts:%"PRId64" ipts:%"PRId64" fifo:%d\n", delta, -1, ost->sync_opts, (int64_t)(get_sync_ipts(ost) * enc->sample_rate), av_fifo_size(ost->fifo)/(ost->st->codec->channels * 2));
                 av_resample_compensate(*(struct AVResampleContext**)ost->resample, comp, enc->sample_rate);
@@ -677,9 +809,9 @@ static void do_audio_out(AVFormatContext *s,
         int len= size_out/istride[0];
         if (av_audio_convert(ost->reformat_ctx, obuf, ostride, ibuf, istride, len)<0) {
             printf("av_audio_convert() failed\n");
-            if (exit_on_error)
-                av_exit(1);
-            return;
+            if (run_opts.exit_on_error)
+                return AVERROR(EINVAL);
+            return 0;
         }
         buftmp = audio_out2;
         size_out = len*osize;
@@ -690,7 +822,7 @@ static void do_audio_out(AVFormatContext *s,
         /* output resampled raw samples */
         if (av_fifo_realloc2(ost->fifo, av_fifo_size(ost->fifo) + size_out) < 0) {
             fprintf(stderr, "av_fifo_realloc2() failed\n");
-            av_exit(1);
+            return AVERROR(ENOMEM);
         }
         av_fifo_generic_write(ost->fifo, buftmp, size_out, NULL);
 
@@ -708,7 +840,7 @@ static void do_audio_out(AVFormatContext *s,
                                        (short *)audio_buf);
             if (ret < 0) {
                 fprintf(stderr, "Audio encoding failed\n");
-                av_exit(1);
+                return AVERROR(EINVAL);
             }
             audio_size += ret;
             pkt.stream_index= ost->index;
@@ -717,7 +849,8 @@ static void do_audio_out(AVFormatContext *s,
             if(enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
                 pkt.pts= av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
             pkt.flags |= PKT_FLAG_KEY;
-            write_frame(s, &pkt, ost->st->codec, bitstream_filters[ost->file_index][pkt.stream_index]);
+            if (write_frame(s, &pkt, ost->st->codec, bitstream_filters[ost->file_index][pkt.stream_index]) < 0)
+                return AVERROR(EIO);
 
             ost->sync_opts += enc->frame_size;
         }
@@ -739,7 +872,7 @@ static void do_audio_out(AVFormatContext *s,
                                    (short *)buftmp);
         if (ret < 0) {
             fprintf(stderr, "Audio encoding failed\n");
-            av_exit(1);
+            return AVERROR(EINVAL);
         }
         audio_size += ret;
         pkt.stream_index= ost->index;
@@ -748,8 +881,10 @@ static void do_audio_out(AVFormatContext *s,
         if(enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
             pkt.pts= av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
         pkt.flags |= PKT_FLAG_KEY;
-        write_frame(s, &pkt, ost->st->codec, bitstream_filters[ost->file_index][pkt.stream_index]);
+        if (write_frame(s, &pkt, ost->st->codec, bitstream_filters[ost->file_index][pkt.stream_index]) < 0)
+            return AVERROR(EIO);
     }
+    return 0;
 }
 
 static void pre_process_video_frame(AVInputStream *ist, AVPicture *picture, void **bufp)
@@ -762,7 +897,7 @@ static void pre_process_video_frame(AVInputStream *ist, AVPicture *picture, void
     dec = ist->st->codec;
 
     /* deinterlace : must be done before any resize */
-    if (do_deinterlace) {
+    if (run_opts.do_deinterlace) {
         int size;
 
         /* create temporary picture */
@@ -794,11 +929,11 @@ static void pre_process_video_frame(AVInputStream *ist, AVPicture *picture, void
 /* we begin to correct av delay at this threshold */
 #define AV_DELAY_MAX 0.100
 
-static void do_subtitle_out(AVFormatContext *s,
-                            AVOutputStream *ost,
-                            AVInputStream *ist,
-                            AVSubtitle *sub,
-                            int64_t pts)
+static int do_subtitle_out(AVFormatContext *s,
+                           AVOutputStream *ost,
+                           AVInputStream *ist,
+                           AVSubtitle *sub,
+                           int64_t pts)
 {
     static uint8_t *subtitle_out = NULL;
     int subtitle_out_max_size = 1024 * 1024;
@@ -808,9 +943,9 @@ static void do_subtitle_out(AVFormatContext *s,
 
     if (pts == AV_NOPTS_VALUE) {
         fprintf(stderr, "Subtitle packets must have a pts\n");
-        if (exit_on_error)
-            av_exit(1);
-        return;
+        if (run_opts.exit_on_error)
+            return AVERROR(EINVAL);
+        return 0;
     }
 
     enc = ost->st->codec;
@@ -837,7 +972,7 @@ static void do_subtitle_out(AVFormatContext *s,
                                                     subtitle_out_max_size, sub);
         if (subtitle_out_size < 0) {
             fprintf(stderr, "Subtitle encoding failed\n");
-            av_exit(1);
+            return AVERROR(EINVAL);
         }
 
         av_init_packet(&pkt);
@@ -853,18 +988,323 @@ static void do_subtitle_out(AVFormatContext *s,
             else
                 pkt.pts += 90 * sub->end_display_time;
         }
-        write_frame(s, &pkt, ost->st->codec, bitstream_filters[ost->file_index][pkt.stream_index]);
+        if (write_frame(s, &pkt, ost->st->codec, bitstream_filters[ost->file_index][pkt.stream_index]) < 0)
+            return AVERROR(EIO);
+    }
+    return 0;
+}
+
+static double psnr(double d){
+    return -10.0*log(d)/log(10.0);
+}
+
+static int open_vstats_file(void)
+{
+    /* this is executed just the first time vstats are written */
+    if (!vstats_file) {
+        vstats_file = fopen(run_opts.vstats_filename, "w");
+        if (!vstats_file) {
+            perror("fopen");
+            return AVERROR(EIO);
+        }
+    }
+    return 0;
+}
+
+static MetricContext *metric_init(AVCodecContext *enc)
+{
+    MetricContext *m;
+    AVCodec *codec;
+    AVCodecContext *dec;
+    int hshift, vshift, i, p, n, bw;
+
+    switch (enc->pix_fmt) {
+    case PIX_FMT_YUV420P: case PIX_FMT_YUV422P: case PIX_FMT_YUV444P:
+    case PIX_FMT_YUV410P: case PIX_FMT_YUV411P: case PIX_FMT_YUV440P:
+    case PIX_FMT_YUVJ420P: case PIX_FMT_YUVJ422P: case PIX_FMT_YUVJ444P:
+    case PIX_FMT_YUVJ440P: case PIX_FMT_GRAY8:
+        break;
+    default:
+        fprintf(stderr, "SSIM/PSNR measurement is not supported for pixel format %s\n",
+                avcodec_get_pix_fmt_name(enc->pix_fmt));
+        return NULL;
+    }
+    codec = avcodec_find_decoder(enc->codec_id);
+    if (!codec) {
+        fprintf(stderr, "No decoder for codec id %d, cannot measure SSIM/PSNR\n",
+                enc->codec_id);
+        return NULL;
+    }
+
+    m = av_mallocz(sizeof(*m));
+    m->dec = dec = avcodec_alloc_context();
+    dec->width                 = enc->width;
+    dec->height                = enc->height;
+    dec->pix_fmt               = enc->pix_fmt;
+    dec->codec_tag             = enc->codec_tag;
+    dec->bits_per_coded_sample = enc->bits_per_coded_sample;
+    dec->extradata             = enc->extradata;
+    dec->extradata_size        = enc->extradata_size;
+    if (run_opts.thread_count > 1)
+        avcodec_thread_init(dec, run_opts.thread_count);
+    if (avcodec_open(dec, codec) < 0) {
+        fprintf(stderr, "Error while opening decoder for SSIM/PSNR measurement\n");
+        av_free(dec);
+        av_free(m);
+        return NULL;
+    }
+    m->frame = avcodec_alloc_frame();
+    m->refs  = av_fifo_alloc(4 * sizeof(MetricFrame));
+
+    m->pix_fmt = enc->pix_fmt;
+    avcodec_get_chroma_sub_sample(enc->pix_fmt, &hshift, &vshift);
+    m->nb_planes = enc->pix_fmt == PIX_FMT_GRAY8 ? 1 : 3;
+    for (p = 0; p < m->nb_planes; p++) {
+        m->width [p] = p ? -((-enc->width ) >> hshift) : enc->width;
+        m->height[p] = p ? -((-enc->height) >> vshift) : enc->height;
+    }
+
+    /* split every plane into horizontal bands, measured in parallel */
+    n  = FFMAX(run_opts.thread_count, 1);
+    bw = m->width[0] >> 2;
+    m->nb_jobs = n * m->nb_planes;
+    m->jobs    = av_mallocz(m->nb_jobs * sizeof(*m->jobs));
+    for (p = 0; p < m->nb_planes; p++) {
+        int bh = m->height[p] >> 2;
+        for (i = 0; i < n; i++) {
+            MetricJob *job = &m->jobs[p * n + i];
+            job->m     = m;
+            job->plane = p;
+            job->y0    = bh *  i      / n;
+            job->y1    = bh * (i + 1) / n;
+            job->last  = i == n - 1;
+            job->sums  = av_malloc(2 * FFMAX(bw, 1) * sizeof(*job->sums));
+        }
+    }
+    return m;
+}
+
+static void metric_free(MetricContext *m)
+{
+    MetricFrame ref;
+    int i;
+
+    if (!m)
+        return;
+    while (av_fifo_size(m->refs) >= sizeof(ref)) {
+        av_fifo_generic_read(m->refs, &ref, sizeof(ref), NULL);
+        avpicture_free(&ref.pict);
+    }
+    av_fifo_free(m->refs);
+    for (i = 0; i < m->nb_jobs; i++)
+        av_free(m->jobs[i].sums);
+    av_free(m->jobs);
+    avcodec_close(m->dec);
+    av_free(m->dec);
+    av_free(m->frame);
+    av_free(m);
+}
+
+/**
+ * Keeps a copy of a picture given to the encoder until the decoded
+ * version of it comes back.
+ */
+static void metric_push(MetricContext *m, const AVPicture *pict, int64_t pts)
+{
+    MetricFrame ref;
+
+    if (avpicture_alloc(&ref.pict, m->pix_fmt, m->width[0], m->height[0]) < 0)
+        return;
+    av_picture_copy(&ref.pict, pict, m->pix_fmt, m->width[0], m->height[0]);
+    ref.pts = pts;
+    if (av_fifo_space(m->refs) < sizeof(ref))
+        av_fifo_realloc2(m->refs, av_fifo_size(m->refs) + 4 * sizeof(ref));
+    av_fifo_generic_write(m->refs, &ref, sizeof(ref), NULL);
+}
+
+static int64_t metric_sse(const uint8_t *pix1, int stride1,
+                          const uint8_t *pix2, int stride2, int w, int h)
+{
+    int64_t sse = 0;
+    int x, y;
+
+    for (y = 0; y < h; y++) {
+        for (x = 0; x < w; x++) {
+            int d = pix1[x] - pix2[x];
+            sse += d * d;
+        }
+        pix1 += stride1;
+        pix2 += stride2;
+    }
+    return sse;
+}
+
+/**
+ * SSIM of the 8x8 windows whose top left 4x4 blocks are in row top,
+ * windows overlap by 4 pixels in both directions.
+ */
+static double metric_ssim_row(int (*top)[4], int (*bottom)[4], int bw)
+{
+    static const int64_t c1 = (int)(.01*.01*255*255*64 + .5);
+    static const int64_t c2 = (int)(.03*.03*255*255*64*63 + .5);
+    double ssim = 0;
+    int x;
+
+    for (x = 0; x + 1 < bw; x++) {
+        int64_t s1  = top[x][0] + top[x+1][0] + bottom[x][0] + bottom[x+1][0];
+        int64_t s2  = top[x][1] + top[x+1][1] + bottom[x][1] + bottom[x+1][1];
+        int64_t ss  = top[x][2] + top[x+1][2] + bottom[x][2] + bottom[x+1][2];
+        int64_t s12 = top[x][3] + top[x+1][3] + bottom[x][3] + bottom[x+1][3];
+        int64_t vars  = ss * 64 - s1*s1 - s2*s2;
+        int64_t covar = s12 * 64 - s1*s2;
+
+        ssim += (double)(2*s1*s2 + c1) * (double)(2*covar + c2) /
+               ((double)(s1*s1 + s2*s2 + c1) * (double)(vars + c2));
+    }
+    return ssim;
+}
+
+static int metric_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    MetricJob *job = (MetricJob *)arg + jobnr;
+    MetricContext *m = job->m;
+    int p  = job->plane;
+    int w  = m->width[p], h = m->height[p];
+    int bw = w >> 2, bh = h >> 2;
+    const uint8_t *ref = m->ref->data[p], *cmp = m->cmp->data[p];
+    int rs = m->ref->linesize[p], cs = m->cmp->linesize[p];
+    int (*prev)[4] = NULL;
+    int x, y, end;
+
+    job->sse  = 0;
+    job->ssim = 0;
+
+    /* SSIM windows span two block rows, so the luma bands measure the
+       first block row of the next band too */
+    end = job->y1 + (!p && job->y1 < bh);
+    for (y = job->y0; y < end; y++) {
+        const uint8_t *r = ref + 4*y*rs, *c = cmp + 4*y*cs;
+        int (*sums)[4] = job->sums + (y & 1) * bw;
+
+        avcodec_ssim_block_sums(r, rs, c, cs, sums, bw);
+
+        if (y < job->y1)
+            for (x = 0; x < bw; x++)
+                job->sse += sums[x][2] - 2*sums[x][3];
+        if (!p && prev)
+            job->ssim += metric_ssim_row(prev, sums, bw);
+        prev = sums;
+    }
+    if (w & 3)
+        job->sse += metric_sse(ref + 4*job->y0*rs + 4*bw, rs,
+                               cmp + 4*job->y0*cs + 4*bw, cs,
+                               w & 3, 4*(job->y1 - job->y0));
+    if (job->last && h & 3)
+        job->sse += metric_sse(ref + 4*bh*rs, rs, cmp + 4*bh*cs, cs, w, h & 3);
+    return 0;
+}
+
+static void metric_compare(MetricContext *m, const AVPicture *ref, int64_t pts)
+{
+    int64_t windows = (int64_t)FFMAX((m->width[0] >> 2) - 1, 0) *
+                               FFMAX((m->height[0] >> 2) - 1, 0);
+    double ssim = 0;
+    int i, p;
+
+    m->ref = ref;
+    m->cmp = (const AVPicture *)m->frame;
+    m->dec->execute2(m->dec, metric_job, m->jobs, NULL, m->nb_jobs);
+
+    for (p = 0; p < 3; p++)
+        m->frame_sse[p] = 0;
+    for (i = 0; i < m->nb_jobs; i++) {
+        m->frame_sse[m->jobs[i].plane] += m->jobs[i].sse;
+        ssim += m->jobs[i].ssim;
+    }
+    m->frame_ssim = windows ? ssim / windows : 1.0;
+
+    m->frames++;
+    m->ssim += m->frame_ssim;
+    for (p = 0; p < m->nb_planes; p++)
+        m->sse[p] += m->frame_sse[p];
+
+    if (run_opts.vstats_filename && open_vstats_file() >= 0) {
+        fprintf(vstats_file, "metric frame= %5"PRIu64" pts= %"PRId64" SSIM= %6.4f PSNR=",
+                m->frames, pts, m->frame_ssim);
+        for (p = 0; p < m->nb_planes; p++)
+            fprintf(vstats_file, " %6.2f", psnr(m->frame_sse[p] /
+                    (m->width[p] * m->height[p] * 255.0 * 255.0)));
+        fprintf(vstats_file, "\n");
+    }
+}
+
+/**
+ * PSNR of all planes together, of the last frame or of all frames.
+ */
+static double metric_psnr(MetricContext *m, int all_frames)
+{
+    double sse = 0, scale = 0;
+    int p;
+
+    for (p = 0; p < m->nb_planes; p++) {
+        sse   += all_frames ? m->sse[p] : m->frame_sse[p];
+        scale += m->width[p] * m->height[p] * 255.0 * 255.0;
     }
+    return psnr(sse / (scale * (all_frames ? m->frames : 1)));
+}
+
+/**
+ * Decodes a packet produced by the encoder and compares the pictures
+ * it returns with the encoder input they were made from.
+ * @param size 0 to flush the decoder
+ */
+static void metric_decode(MetricContext *m, uint8_t *buf, int size, int64_t pts)
+{
+    AVPacket pkt;
+    MetricFrame ref;
+    int got_picture;
+
+    av_init_packet(&pkt);
+    pkt.data = buf;
+    pkt.size = size;
+    m->dec->reordered_opaque = pts;
+    do {
+        if (avcodec_decode_video2(m->dec, m->frame, &got_picture, &pkt) < 0) {
+            if (!m->warned++)
+                fprintf(stderr, "Error decoding encoded frame, SSIM/PSNR will be incomplete\n");
+            return;
+        }
+        if (!got_picture)
+            return;
+        /* skip encoder input pictures the encoder dropped */
+        for (;;) {
+            if (av_fifo_size(m->refs) < sizeof(ref))
+                return;
+            av_fifo_generic_read(m->refs, &ref, sizeof(ref), NULL);
+            if (m->frame->reordered_opaque == AV_NOPTS_VALUE ||
+                ref.pts >= m->frame->reordered_opaque ||
+                av_fifo_size(m->refs) < sizeof(ref))
+                break;
+            avpicture_free(&ref.pict);
+        }
+        if (m->dec->width  != m->width[0] || m->dec->height != m->height[0] ||
+            m->dec->pix_fmt != m->pix_fmt) {
+            if (!m->warned++)
+                fprintf(stderr, "Decoded format differs from encoder input, SSIM/PSNR not measured\n");
+        } else
+            metric_compare(m, &ref.pict, ref.pts);
+        avpicture_free(&ref.pict);
+    } while (!size);
 }
 
 static int bit_buffer_size= 1024*256;
 static uint8_t *bit_buffer= NULL;
 
-static void do_video_out(AVFormatContext *s,
-                         AVOutputStream *ost,
-                         AVInputStream *ist,
-                         AVFrame *in_picture,
-                         int *frame_size)
+static int do_video_out(AVFormatContext *s,
+                        AVOutputStream *ost,
+                        AVInputStream *ist,
+                        AVFrame *in_picture,
+                        int *frame_size)
 {
     int nb_frames, i, ret;
     int64_t topBand, bottomBand, leftBand, rightBand;
@@ -883,13 +1323,13 @@ static void do_video_out(AVFormatContext *s,
 
     *frame_size = 0;
 
-    if(video_sync_method){
+    if(run_opts.video_sync_method){
         double vdelta;
         vdelta = get_sync_ipts(ost) / av_q2d(enc->time_base) - ost->sync_opts;
         //FIXME set to 0.5 after we fix some dts/pts bugs like in avidec.c
         if (vdelta < -1.1)
             nb_frames = 0;
-        else if (video_sync_method == 2 || (video_sync_method<0 && (s->oformat->flags & AVFMT_VARIABLE_FPS))){
+        else if (run_opts.video_sync_method == 2 || (run_opts.video_sync_method<0 && (s->oformat->flags & AVFMT_VARIABLE_FPS))){
             if(vdelta<=-0.6){
                 nb_frames=0;
             }else if(vdelta>0.6)
@@ -899,26 +1339,26 @@ static void do_video_out(AVFormatContext *s,
 //fprintf(stderr, "vdelta:%f, ost->sync_opts:%"PRId64", ost->sync_ipts:%f nb_frames:%d\n", vdelta, ost->sync_opts, get_sync_ipts(ost), nb_frames);
         if (nb_frames == 0){
             ++nb_frames_drop;
-            if (verbose>2)
+            if (run_opts.verbose>2)
                 fprintf(stderr, "*** drop!\n");
         }else if (nb_frames > 1) {
             nb_frames_dup += nb_frames;
-            if (verbose>2)
+            if (run_opts.verbose>2)
                 fprintf(stderr, "*** %d dup!\n", nb_frames-1);
         }
     }else
         ost->sync_opts= lrintf(get_sync_ipts(ost) / av_q2d(enc->time_base));
 
-    nb_frames= FFMIN(nb_frames, max_frames[CODEC_TYPE_VIDEO] - ost->frame_number);
+    nb_frames= FFMIN(nb_frames, run_opts.max_frames[CODEC_TYPE_VIDEO] - ost->frame_number);
     if (nb_frames <= 0)
-        return;
+        return 0;
 
     if (ost->video_crop) {
         if (av_picture_crop((AVPicture *)&picture_crop_temp, (AVPicture *)in_picture, dec->pix_fmt, ost->topBand, ost->leftBand) < 0) {
             fprintf(stderr, "error cropping picture\n");
-            if (exit_on_error)
-                av_exit(1);
-            return;
+            if (run_opts.exit_on_error)
+                return AVERROR(EINVAL);
+            return 0;
         }
         formatted_picture = &picture_crop_temp;
     } else {
@@ -933,9 +1373,9 @@ static void do_video_out(AVFormatContext *s,
         if (ost->video_resample) {
             if (av_picture_crop((AVPicture *)&picture_pad_temp, (AVPicture *)final_picture, enc->pix_fmt, ost->padtop, ost->padleft) < 0) {
                 fprintf(stderr, "error padding picture\n");
-                if (exit_on_error)
-                    av_exit(1);
-                return;
+                if (run_opts.exit_on_error)
+                    return AVERROR(EINVAL);
+                return 0;
             }
             resampling_dst = &picture_pad_temp;
         }
@@ -972,7 +1412,7 @@ static void do_video_out(AVFormatContext *s,
 
             /* initialize a new scaler context */
             sws_freeContext(ost->img_resample_ctx);
-            sws_flags = av_get_int(sws_opts, "sws_flags", NULL);
+            run_opts.sws_flags = av_get_int(sws_opts, "sws_flags", NULL);
             ost->img_resample_ctx = sws_getContext(
                 ist->st->codec->width  - (ost->leftBand + ost->rightBand),
                 ist->st->codec->height - (ost->topBand  + ost->bottomBand),
@@ -980,10 +1420,10 @@ static void do_video_out(AVFormatContext *s,
                 ost->st->codec->width  - (ost->padleft  + ost->padright),
                 ost->st->codec->height - (ost->padtop   + ost->padbottom),
                 ost->st->codec->pix_fmt,
-                sws_flags, NULL, NULL, NULL);
+                run_opts.sws_flags, NULL, NULL, NULL);
             if (ost->img_resample_ctx == NULL) {
                 fprintf(stderr, "Cannot get resampling context\n");
-                av_exit(1);
+                return AVERROR(EINVAL);
             }
         }
         sws_scale(ost->img_resample_ctx, formatted_picture->data, formatted_picture->linesize,
@@ -993,7 +1433,7 @@ static void do_video_out(AVFormatContext *s,
     if (ost->video_pad) {
         av_picture_pad((AVPicture*)final_picture, (AVPicture *)padding_src,
                 enc->height, enc->width, enc->pix_fmt,
-                ost->padtop, ost->padbottom, ost->padleft, ost->padright, padcolor);
+                ost->padtop, ost->padbottom, ost->padleft, ost->padright, run_opts.padcolor);
     }
 
     /* duplicates frame if needed */
@@ -1013,7 +1453,8 @@ static void do_video_out(AVFormatContext *s,
             pkt.pts= av_rescale_q(ost->sync_opts, enc->time_base, ost->st->time_base);
             pkt.flags |= PKT_FLAG_KEY;
 
-            write_frame(s, &pkt, ost->st->codec, bitstream_filters[ost->file_index][pkt.stream_index]);
+            if (write_frame(s, &pkt, ost->st->codec, bitstream_filters[ost->file_index][pkt.stream_index]) < 0)
+                return AVERROR(EIO);
             enc->coded_frame = old_frame;
         } else {
             AVFrame big_picture;
@@ -1023,30 +1464,32 @@ static void do_video_out(AVFormatContext *s,
                settings */
             big_picture.interlaced_frame = in_picture->interlaced_frame;
             if(avcodec_opts[CODEC_TYPE_VIDEO]->flags & (CODEC_FLAG_INTERLACED_DCT|CODEC_FLAG_INTERLACED_ME)){
-                if(top_field_first == -1)
+                if(run_opts.top_field_first == -1)
                     big_picture.top_field_first = in_picture->top_field_first;
                 else
-                    big_picture.top_field_first = top_field_first;
+                    big_picture.top_field_first = run_opts.top_field_first;
             }
 
             /* handles sameq here. This is not correct because it may
                not be a global option */
-            if (same_quality) {
+            if (run_opts.same_quality) {
                 big_picture.quality = ist->st->quality;
             }else
                 big_picture.quality = ost->st->quality;
-            if(!me_threshold)
+            if(!run_opts.me_threshold)
                 big_picture.pict_type = 0;
 //            big_picture.pts = AV_NOPTS_VALUE;
             big_picture.pts= ost->sync_opts;
 //            big_picture.pts= av_rescale(ost->sync_opts, AV_TIME_BASE*(int64_t)enc->time_base.num, enc->time_base.den);
 //av_log(NULL, AV_LOG_DEBUG, "%"PRId64" -> encoder\n", ost->sync_opts);
+            if (ost->metric)
+                metric_push(ost->metric, (AVPicture *)final_picture, ost->sync_opts);
             ret = avcodec_encode_video(enc,
                                        bit_buffer, bit_buffer_size,
                                        &big_picture);
             if (ret < 0) {
                 fprintf(stderr, "Video encoding failed\n");
-                av_exit(1);
+                return AVERROR(EINVAL);
             }
 
             if(ret>0){
@@ -1060,7 +1503,10 @@ static void do_video_out(AVFormatContext *s,
 
                 if(enc->coded_frame->key_frame)
                     pkt.flags |= PKT_FLAG_KEY;
-                write_frame(s, &pkt, ost->st->codec, bitstream_filters[ost->file_index][pkt.stream_index]);
+                if (ost->metric)
+                    metric_decode(ost->metric, bit_buffer, ret, enc->coded_frame->pts);
+                if (write_frame(s, &pkt, ost->st->codec, bitstream_filters[ost->file_index][pkt.stream_index]) < 0)
+                    return AVERROR(EIO);
                 *frame_size = ret;
                 video_size += ret;
                 //fprintf(stderr,"\nFrame: %3d size: %5d type: %d",
@@ -1074,27 +1520,18 @@ static void do_video_out(AVFormatContext *s,
         ost->sync_opts++;
         ost->frame_number++;
     }
+    return 0;
 }
 
-static double psnr(double d){
-    return -10.0*log(d)/log(10.0);
-}
-
-static void do_video_stats(AVFormatContext *os, AVOutputStream *ost,
-                           int frame_size)
+static int do_video_stats(AVFormatContext *os, AVOutputStream *ost,
+                          int frame_size)
 {
     AVCodecContext *enc;
     int frame_number;
     double ti1, bitrate, avg_bitrate;
 
-    /* this is executed just the first time do_video_stats is called */
-    if (!vstats_file) {
-        vstats_file = fopen(vstats_filename, "w");
-        if (!vstats_file) {
-            perror("fopen");
-            av_exit(1);
-        }
-    }
+    if (open_vstats_file() < 0)
+        return AVERROR(EIO);
 
     enc = ost->st->codec;
     if (enc->codec_type == CODEC_TYPE_VIDEO) {
@@ -1115,6 +1552,7 @@ static void do_video_stats(AVFormatContext *os, AVOutputStream *ost,
             (double)video_size / 1024, ti1, bitrate, avg_bitrate);
         fprintf(vstats_file,"type= %c\n", av_get_pict_type_char(enc->coded_frame->pict_type));
     }
+    return 0;
 }
 
 static void print_report(AVFormatContext **output_files,
@@ -1172,7 +1610,7 @@ static void print_report(AVFormatContext **output_files,
                      enc->coded_frame->quality/(float)FF_QP2LAMBDA : -1);
             if(is_last_report)
                 snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "L");
-            if(qp_hist){
+            if(run_opts.qp_hist){
                 int j;
                 int qp= lrintf(enc->coded_frame->quality/(float)FF_QP2LAMBDA);
                 if(qp>=0 && qp<FF_ARRAY_ELEMS(qp_histogram))
@@ -1201,6 +1639,12 @@ static void print_report(AVFormatContext **output_files,
                 }
                 snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "*:%2.2f ", psnr(error_sum/scale_sum));
             }
+            if (ost->metric && ost->metric->frames) {
+                MetricContext *m = ost->metric;
+                snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "SSIM=%0.4f PSNR=%2.2f ",
+                         is_last_report ? m->ssim / m->frames : m->frame_ssim,
+                         metric_psnr(m, is_last_report));
+            }
             vid = 1;
         }
         /* compute min output value */
@@ -1211,24 +1655,24 @@ static void print_report(AVFormatContext **output_files,
     if (ti1 < 0.01)
         ti1 = 0.01;
 
-    if (verbose || is_last_report) {
+    if (run_opts.verbose || is_last_report) {
         bitrate = (double)(total_size * 8) / ti1 / 1000.0;
 
         snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf),
             "size=%8.0fkB time=%0.2f bitrate=%6.1fkbits/s",
             (double)total_size / 1024, ti1, bitrate);
 
-        if (verbose > 1)
+        if (run_opts.verbose > 1)
           snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), " dup=%d drop=%d",
                   nb_frames_dup, nb_frames_drop);
 
-        if (verbose >= 0)
+        if (run_opts.verbose >= 0)
             fprintf(stderr, "%s    \r", buf);
 
         fflush(stderr);
     }
 
-    if (is_last_report && verbose >= 0){
+    if (is_last_report && run_opts.verbose >= 0){
         int64_t raw= audio_size + video_size + extra_size;
         fprintf(stderr, "\n");
         fprintf(stderr, "video:%1.0fkB audio:%1.0fkB global headers:%1.0fkB muxing overhead %f%%\n",
@@ -1237,10 +1681,24 @@ static void print_report(AVFormatContext **output_files,
                 extra_size/1024.0,
                 100.0*(total_size - raw)/raw
         );
+        for(i=0;i<nb_ostreams;i++) {
+            MetricContext *m = ost_table[i]->metric;
+            int p;
+            if (!m || !m->frames)
+                continue;
+            fprintf(stderr, "stream #%d.%d: %"PRIu64" frames SSIM:%0.4f PSNR",
+                    ost_table[i]->file_index, ost_table[i]->index, m->frames, m->ssim / m->frames);
+            for (p = 0; p < m->nb_planes; p++)
+                fprintf(stderr, " %c:%2.2f", "YUV"[p],
+                        psnr(m->sse[p] / (m->width[p] * m->height[p] * 255.0 * 255.0 * m->frames)));
+            fprintf(stderr, " *:%2.2f\n", metric_psnr(m, 1));
+        }
     }
 }
 
-/* pkt = NULL means EOF (needed to flush decoder buffers) */
+/* pkt = NULL means EOF (needed to flush decoder buffers)
+   return -1 if the packet could not be decoded, or another negative
+   error code if an output stream could not be encoded or written */
 static int output_packet(AVInputStream *ist, int ist_index,
                          AVOutputStream **ost_table, int nb_ostreams,
                          const AVPacket *pkt)
@@ -1280,7 +1738,7 @@ static int output_packet(AVInputStream *ist, int ist_index,
         ist->pts= ist->next_pts;
 
         if(avpkt.size && avpkt.size != pkt->size &&
-           !(ist->st->codec->codec->capabilities & CODEC_CAP_SUBFRAMES) && verbose>0)
+           !(ist->st->codec->codec->capabilities & CODEC_CAP_SUBFRAMES) && run_opts.verbose>0)
             fprintf(stderr, "Multiple frames in a packet from stream %d\n", pkt->stream_index);
 
         /* decode the packet if needed */
@@ -1313,12 +1771,32 @@ static int output_packet(AVInputStream *ist, int ist_index,
                 data_buf = (uint8_t *)samples;
                 ist->next_pts += ((int64_t)AV_TIME_BASE/bps * data_size) /
                     (ist->st->codec->sample_rate * ist->st->codec->channels);
+                /* drop the samples before the trim point from the frame
+                   which crosses it */
+                if (ist->trim_pts != AV_NOPTS_VALUE &&
+                    ist->pts < ist->trim_pts && ist->next_pts > ist->trim_pts) {
+                    int skip = av_rescale(ist->trim_pts - ist->pts, ist->st->codec->sample_rate, AV_TIME_BASE) *
+                               ist->st->codec->channels * bps;
+                    skip = FFMIN(skip, data_size);
+                    data_buf  += skip;
+                    data_size -= skip;
+                    ist->pts   = ist->trim_pts;
+                }
                 break;}
             case CODEC_TYPE_VIDEO:
                     data_size = (ist->st->codec->width * ist->st->codec->height * 3) / 2;
                     /* XXX: allocate picture correctly */
                     avcodec_get_frame_defaults(&picture);
 
+                    /* frames before the trim point which no other frame
+                       references need not be decoded at all */
+                    if (ist->trim_pts != AV_NOPTS_VALUE && pkt) {
+                        ist->st->codec->skip_frame = ist->skip_frame;
+                        if (pkt->pts != AV_NOPTS_VALUE &&
+                            av_rescale_q(pkt->pts, ist->st->time_base, AV_TIME_BASE_Q) < ist->trim_pts)
+                            ist->st->codec->skip_frame = FFMAX(ist->skip_frame, AVDISCARD_NONREF);
+                    }
+
                     ret = avcodec_decode_video2(ist->st->codec,
                                                 &picture, &got_picture, &avpkt);
                     ist->st->quality= picture.quality;
@@ -1329,7 +1807,7 @@ static int output_packet(AVInputStream *ist, int ist_index,
                         goto discard_packet;
                     }
                     if (ist->st->codec->time_base.num != 0) {
-                        int ticks= ist->st->parser ? ist->st->parser->repeat_pict+1 : ist->st->codec->ticks_per_frame;
+                        int ticks= ist->repeat_pict >= 0 ? ist->repeat_pict+1 : ist->st->codec->ticks_per_frame;
                         ist->next_pts += ((int64_t)AV_TIME_BASE *
                                           ist->st->codec->time_base.num * ticks) /
                             ist->st->codec->time_base.den;
@@ -1358,7 +1836,7 @@ static int output_packet(AVInputStream *ist, int ist_index,
                 break;
             case CODEC_TYPE_VIDEO:
                 if (ist->st->codec->time_base.num != 0) {
-                    int ticks= ist->st->parser ? ist->st->parser->repeat_pict+1 : ist->st->codec->ticks_per_frame;
+                    int ticks= ist->repeat_pict >= 0 ? ist->repeat_pict+1 : ist->st->codec->ticks_per_frame;
                     ist->next_pts += ((int64_t)AV_TIME_BASE *
                                       ist->st->codec->time_base.num * ticks) /
                         ist->st->codec->time_base.den;
@@ -1379,11 +1857,11 @@ static int output_packet(AVInputStream *ist, int ist_index,
 
         // preprocess audio (volume)
         if (ist->st->codec->codec_type == CODEC_TYPE_AUDIO) {
-            if (audio_volume != 256) {
+            if (run_opts.audio_volume != 256) {
                 short *volp;
                 volp = samples;
                 for(i=0;i<(data_size / sizeof(short));i++) {
-                    int v = ((*volp) * audio_volume + 128) >> 8;
+                    int v = ((*volp) * run_opts.audio_volume + 128) >> 8;
                     if (v < -32768) v = -32768;
                     if (v >  32767) v = 32767;
                     *volp++ = v;
@@ -1392,7 +1870,7 @@ static int output_packet(AVInputStream *ist, int ist_index,
         }
 
         /* frame rate emulation */
-        if (rate_emu) {
+        if (run_opts.rate_emu) {
             int64_t pts = av_rescale(ist->pts, 1000000, AV_TIME_BASE);
             int64_t now = av_gettime() - ist->start;
             if (pts > now)
@@ -1401,7 +1879,8 @@ static int output_packet(AVInputStream *ist, int ist_index,
 
         /* if output time reached then transcode raw format,
            encode packets and output them */
-        if (start_time == 0 || ist->pts >= start_time)
+        if ((run_opts.start_time == 0 || ist->pts >= run_opts.start_time) &&
+            (ist->trim_pts == AV_NOPTS_VALUE || ist->pts >= ist->trim_pts))
             for(i=0;i<nb_ostreams;i++) {
                 int frame_size;
 
@@ -1415,16 +1894,16 @@ static int output_packet(AVInputStream *ist, int ist_index,
                     if (ost->encoding_needed) {
                         switch(ost->st->codec->codec_type) {
                         case CODEC_TYPE_AUDIO:
-                            do_audio_out(os, ost, ist, data_buf, data_size);
+                            ret = do_audio_out(os, ost, ist, data_buf, data_size);
                             break;
                         case CODEC_TYPE_VIDEO:
-                            do_video_out(os, ost, ist, &picture, &frame_size);
-                            if (vstats_filename && frame_size)
-                                do_video_stats(os, ost, frame_size);
+                            ret = do_video_out(os, ost, ist, &picture, &frame_size);
+                            if (ret >= 0 && run_opts.vstats_filename && frame_size)
+                                ret = do_video_stats(os, ost, frame_size);
                             break;
                         case CODEC_TYPE_SUBTITLE:
-                            do_subtitle_out(os, ost, ist, &subtitle,
-                                            pkt->pts);
+                            ret = do_subtitle_out(os, ost, ist, &subtitle,
+                                                  pkt->pts);
                             break;
                         default:
                             abort();
@@ -1432,11 +1911,11 @@ static int output_packet(AVInputStream *ist, int ist_index,
                     } else {
                         AVFrame avframe; //FIXME/XXX remove this
                         AVPacket opkt;
-                        int64_t ost_tb_start_time= av_rescale_q(start_time, AV_TIME_BASE_Q, ost->st->time_base);
+                        int64_t ost_tb_start_time= av_rescale_q(run_opts.start_time, AV_TIME_BASE_Q, ost->st->time_base);
 
                         av_init_packet(&opkt);
 
-                        if ((!ost->frame_number && !(pkt->flags & PKT_FLAG_KEY)) && !copy_initial_nonkeyframes)
+                        if ((!ost->frame_number && !(pkt->flags & PKT_FLAG_KEY)) && !run_opts.copy_initial_nonkeyframes)
                             continue;
 
                         /* no reencoding needed : output the packet directly */
@@ -1477,11 +1956,13 @@ static int output_packet(AVInputStream *ist, int ist_index,
                             opkt.size = data_size;
                         }
 
-                        write_frame(os, &opkt, ost->st->codec, bitstream_filters[ost->file_index][opkt.stream_index]);
+                        ret = write_frame(os, &opkt, ost->st->codec, bitstream_filters[ost->file_index][opkt.stream_index]);
                         ost->st->codec->frame_number++;
                         ost->frame_number++;
                         av_free_packet(&opkt);
                     }
+                    if (ret < 0)
+                        break;
                 }
             }
         av_free(buffer_to_free);
@@ -1498,6 +1979,8 @@ static int output_packet(AVInputStream *ist, int ist_index,
             subtitle_to_free->num_rects = 0;
             subtitle_to_free = NULL;
         }
+        if (ret < 0)
+            return ret;
     }
  discard_packet:
     if (pkt == NULL) {
@@ -1536,7 +2019,7 @@ static int output_packet(AVInputStream *ist, int ist_index,
                                 } else { /* pad */
                                     int frame_bytes = enc->frame_size*osize*enc->channels;
                                     if (samples_size < frame_bytes)
-                                        av_exit(1);
+                                        return AVERROR(EINVAL);
                                     memset((uint8_t*)samples+fifo_bytes, 0, frame_bytes - fifo_bytes);
                                 }
 
@@ -1550,7 +2033,7 @@ static int output_packet(AVInputStream *ist, int ist_index,
                             }
                             if (ret < 0) {
                                 fprintf(stderr, "Audio encoding failed\n");
-                                av_exit(1);
+                                return AVERROR(EINVAL);
                             }
                             audio_size += ret;
                             pkt.flags |= PKT_FLAG_KEY;
@@ -1559,7 +2042,7 @@ static int output_packet(AVInputStream *ist, int ist_index,
                             ret = avcodec_encode_video(enc, bit_buffer, bit_buffer_size, NULL);
                             if (ret < 0) {
                                 fprintf(stderr, "Video encoding failed\n");
-                                av_exit(1);
+                                return AVERROR(EINVAL);
                             }
                             video_size += ret;
                             if(enc->coded_frame && enc->coded_frame->key_frame)
@@ -1567,6 +2050,8 @@ static int output_packet(AVInputStream *ist, int ist_index,
                             if (ost->logfile && enc->stats_out) {
                                 fprintf(ost->logfile, "%s", enc->stats_out);
                             }
+                            if (ret > 0 && ost->metric)
+                                metric_decode(ost->metric, bit_buffer, ret, enc->coded_frame->pts);
                             break;
                         default:
                             ret=-1;
@@ -1578,8 +2063,11 @@ static int output_packet(AVInputStream *ist, int ist_index,
                         pkt.size= ret;
                         if(enc->coded_frame && enc->coded_frame->pts != AV_NOPTS_VALUE)
                             pkt.pts= av_rescale_q(enc->coded_frame->pts, enc->time_base, ost->st->time_base);
-                        write_frame(os, &pkt, ost->st->codec, bitstream_filters[ost->file_index][pkt.stream_index]);
+                        if (write_frame(os, &pkt, ost->st->codec, bitstream_filters[ost->file_index][pkt.stream_index]) < 0)
+                            return AVERROR(EIO);
                     }
+                    if (ost->metric)
+                        metric_decode(ost->metric, NULL, 0, AV_NOPTS_VALUE);
                 }
             }
         }
@@ -1625,6 +2113,177 @@ static int stream_index_from_inputs(AVFormatContext **input_files,
     return -1;
 }
 
+#if HAVE_PTHREADS
+static void *input_thread(void *arg)
+{
+    AVInputFile *f = arg;
+    AVInputPacket ipkt;
+    AVStream *st;
+    int64_t t;
+    int ret;
+
+    for (;;) {
+        ret = av_read_frame(f->ctx, &ipkt.pkt);
+        if (ret == AVERROR(EAGAIN)) {
+            if (input_threads_stop)
+                break;
+            usleep(10000);
+            continue;
+        }
+        if (ret < 0)
+            break;
+        av_dup_packet(&ipkt.pkt);
+        st = f->ctx->streams[ipkt.pkt.stream_index];
+        ipkt.repeat_pict = st->parser ? st->parser->repeat_pict : -1;
+
+        pthread_mutex_lock(&f->fifo_lock);
+        t = av_gettime();
+        while (av_fifo_space(f->fifo) < sizeof(ipkt) && !input_threads_stop)
+            pthread_cond_wait(&f->fifo_cond, &f->fifo_lock);
+        f->full_time += av_gettime() - t;
+        if (input_threads_stop) {
+            pthread_mutex_unlock(&f->fifo_lock);
+            av_free_packet(&ipkt.pkt);
+            break;
+        }
+        av_fifo_generic_write(f->fifo, &ipkt, sizeof(ipkt), NULL);
+        pthread_cond_signal(&f->fifo_cond);
+        pthread_mutex_unlock(&f->fifo_lock);
+    }
+
+    pthread_mutex_lock(&f->fifo_lock);
+    f->finished = 1;
+    f->ret = ret;
+    pthread_cond_signal(&f->fifo_cond);
+    pthread_mutex_unlock(&f->fifo_lock);
+    return NULL;
+}
+
+/* read each input on its own thread, so that a slow input does not
+   delay the reading of the others. The demuxer and the decoder share the
+   codec context of a stream, so inputs are still read by the main thread
+   if either may change what the other uses: parsers write to it, and
+   video decoders with delay update has_b_frames, from which the demuxer
+   computes timestamps. */
+static void init_input_threads(AVFormatContext **input_files,
+                               AVInputFile *file_table, int nb_input_files)
+{
+    int i, j;
+
+    if (nb_input_files < 2)
+        return;
+
+    input_threads_stop = 0;
+    for (i = 0; i < nb_input_files; i++) {
+        AVInputFile *f = &file_table[i];
+
+        for (j = 0; j < input_files[i]->nb_streams; j++) {
+            AVCodecContext *dec = input_files[i]->streams[j]->codec;
+            if (input_files[i]->streams[j]->need_parsing != AVSTREAM_PARSE_NONE ||
+                (dec->codec_type == CODEC_TYPE_VIDEO && dec->codec &&
+                 dec->codec->capabilities & CODEC_CAP_DELAY))
+                break;
+        }
+        if (j < input_files[i]->nb_streams)
+            continue;
+
+        f->ctx  = input_files[i];
+        f->fifo = av_fifo_alloc(INPUT_QUEUE_SIZE * sizeof(AVInputPacket));
+        if (!f->fifo)
+            continue;
+        pthread_mutex_init(&f->fifo_lock, NULL);
+        pthread_cond_init(&f->fifo_cond, NULL);
+        if (pthread_create(&f->thread, NULL, input_thread, f)) {
+            pthread_mutex_destroy(&f->fifo_lock);
+            pthread_cond_destroy(&f->fifo_cond);
+            av_fifo_free(f->fifo);
+            f->fifo = NULL;
+        }
+    }
+    if (using_stdin || run_opts.verbose < 0)
+        url_set_interrupt_cb(decode_interrupt_cb);
+}
+
+static void free_input_threads(AVInputFile *file_table, int nb_input_files)
+{
+    AVInputPacket ipkt;
+    int i;
+
+    input_threads_stop = 1;
+    for (i = 0; i < nb_input_files; i++) {
+        AVInputFile *f = &file_table[i];
+
+        if (!f->fifo)
+            continue;
+        pthread_mutex_lock(&f->fifo_lock);
+        pthread_cond_signal(&f->fifo_cond);
+        pthread_mutex_unlock(&f->fifo_lock);
+    }
+    for (i = 0; i < nb_input_files; i++) {
+        AVInputFile *f = &file_table[i];
+
+        if (!f->fifo)
+            continue;
+        pthread_join(f->thread, NULL);
+        while (av_fifo_size(f->fifo)) {
+            av_fifo_generic_read(f->fifo, &ipkt, sizeof(ipkt), NULL);
+            av_free_packet(&ipkt.pkt);
+        }
+        av_fifo_free(f->fifo);
+        f->fifo = NULL;
+        pthread_mutex_destroy(&f->fifo_lock);
+        pthread_cond_destroy(&f->fifo_cond);
+
+        if (run_opts.do_benchmark)
+            printf("bench: input=%d stalls=%d wait=%0.3fs full=%0.3fs\n",
+                   i, f->nb_stalls, f->stall_time / 1000000.0,
+                   f->full_time / 1000000.0);
+    }
+    input_threads_stop = 0;
+}
+#endif
+
+static int get_input_packet(AVFormatContext *is, AVInputFile *f, AVPacket *pkt,
+                            int *repeat_pict)
+{
+    AVStream *st;
+    int ret;
+
+#if HAVE_PTHREADS
+    if (f->fifo) {
+        AVInputPacket ipkt;
+        int64_t t;
+
+        ret = 0;
+
+        pthread_mutex_lock(&f->fifo_lock);
+        if (!av_fifo_size(f->fifo) && !f->finished) {
+            f->nb_stalls++;
+            t = av_gettime();
+            while (!av_fifo_size(f->fifo) && !f->finished)
+                pthread_cond_wait(&f->fifo_cond, &f->fifo_lock);
+            f->stall_time += av_gettime() - t;
+        }
+        if (av_fifo_size(f->fifo)) {
+            av_fifo_generic_read(f->fifo, &ipkt, sizeof(ipkt), NULL);
+            pthread_cond_signal(&f->fifo_cond);
+            *pkt         = ipkt.pkt;
+            *repeat_pict = ipkt.repeat_pict;
+        } else {
+            ret = f->ret;
+        }
+        pthread_mutex_unlock(&f->fifo_lock);
+        return ret;
+    }
+#endif
+    ret = av_read_frame(is, pkt);
+    if (ret >= 0) {
+        st = is->streams[pkt->stream_index];
+        *repeat_pict = st->parser ? st->parser->repeat_pict : -1;
+    }
+    return ret;
+}
+
 /*
  * The following code is the main loop of the file converter
  */
@@ -1645,6 +2304,7 @@ static int av_encode(AVFormatContext **output_files,
     int want_sdp = 1;
     uint8_t no_packet[MAX_FILES]={0};
     int no_packet_count=0;
+    int repeat_pict = -1;
 
     file_table= av_mallocz(nb_input_files * sizeof(AVInputFile));
     if (!file_table)
@@ -1681,7 +2341,7 @@ static int av_encode(AVFormatContext **output_files,
             ist->discard = 1; /* the stream is discarded by default
                                  (changed later) */
 
-            if (rate_emu) {
+            if (run_opts.rate_emu) {
                 ist->start = av_gettime();
             }
         }
@@ -1694,13 +2354,15 @@ static int av_encode(AVFormatContext **output_files,
         if (!os->nb_streams) {
             dump_format(output_files[i], i, output_files[i]->filename, 1);
             fprintf(stderr, "Output file #%d does not contain any stream\n", i);
-            av_exit(1);
+            ret = AVERROR(EINVAL);
+            goto fail;
         }
         nb_ostreams += os->nb_streams;
     }
     if (nb_stream_maps > 0 && nb_stream_maps != nb_ostreams) {
         fprintf(stderr, "Number of stream maps must match number of output streams\n");
-        av_exit(1);
+        ret = AVERROR(EINVAL);
+        goto fail;
     }
 
     /* Sanity check the mapping args -- do the input files & streams exist? */
@@ -1711,14 +2373,16 @@ static int av_encode(AVFormatContext **output_files,
         if (fi < 0 || fi > nb_input_files - 1 ||
             si < 0 || si > file_table[fi].nb_streams - 1) {
             fprintf(stderr,"Could not find input stream #%d.%d\n", fi, si);
-            av_exit(1);
+            ret = AVERROR(EINVAL);
+            goto fail;
         }
         fi = stream_maps[i].sync_file_index;
         si = stream_maps[i].sync_stream_index;
         if (fi < 0 || fi > nb_input_files - 1 ||
             si < 0 || si > file_table[fi].nb_streams - 1) {
             fprintf(stderr,"Could not find sync stream #%d.%d\n", fi, si);
-            av_exit(1);
+            ret = AVERROR(EINVAL);
+            goto fail;
         }
     }
 
@@ -1752,13 +2416,14 @@ static int av_encode(AVFormatContext **output_files,
                     fprintf(stderr, "Codec type mismatch for mapping #%d.%d -> #%d.%d\n",
                         stream_maps[n].file_index, stream_maps[n].stream_index,
                         ost->file_index, ost->index);
-                    av_exit(1);
+                    ret = AVERROR(EINVAL);
+                    goto fail;
                 }
 
             } else {
-                if(opt_programid) {
+                if(run_opts.opt_programid) {
                     found = 0;
-                    j = stream_index_from_inputs(input_files, nb_input_files, file_table, ist_table, ost->st->codec->codec_type, opt_programid);
+                    j = stream_index_from_inputs(input_files, nb_input_files, file_table, ist_table, ost->st->codec->codec_type, run_opts.opt_programid);
                     if(j != -1) {
                         ost->source_index = j;
                         found = 1;
@@ -1778,7 +2443,7 @@ static int av_encode(AVFormatContext **output_files,
                 }
 
                 if (!found) {
-                    if(! opt_programid) {
+                    if(! run_opts.opt_programid) {
                         /* try again and reuse existing stream */
                         for(j=0;j<nb_istreams;j++) {
                             ist = ist_table[j];
@@ -1793,7 +2458,8 @@ static int av_encode(AVFormatContext **output_files,
                         dump_format(output_files[i], i, output_files[i]->filename, 1);
                         fprintf(stderr, "Could not find input stream matching output stream #%d.%d\n",
                                 ost->file_index, ost->index);
-                        av_exit(1);
+                        ret = AVERROR(EINVAL);
+                        goto fail;
                     }
                 }
             }
@@ -1845,9 +2511,10 @@ static int av_encode(AVFormatContext **output_files,
                 codec->time_base = ist->st->time_base;
             switch(codec->codec_type) {
             case CODEC_TYPE_AUDIO:
-                if(audio_volume != 256) {
+                if(run_opts.audio_volume != 256) {
                     fprintf(stderr,"-acodec copy and -vol are incompatible (frames are not decoded)\n");
-                    av_exit(1);
+                    ret = AVERROR(EINVAL);
+                    goto fail;
                 }
                 codec->channel_layout = icodec->channel_layout;
                 codec->sample_rate = icodec->sample_rate;
@@ -1879,7 +2546,7 @@ static int av_encode(AVFormatContext **output_files,
                 if(!ost->fifo)
                     goto fail;
                 ost->reformat_pair = MAKE_SFMT_PAIR(SAMPLE_FMT_NONE,SAMPLE_FMT_NONE);
-                ost->audio_resample = codec->sample_rate != icodec->sample_rate || audio_sync_method > 1;
+                ost->audio_resample = codec->sample_rate != icodec->sample_rate || run_opts.audio_sync_method > 1;
                 icodec->request_channels = codec->channels;
                 ist->decoding_needed = 1;
                 ost->encoding_needed = 1;
@@ -1887,28 +2554,29 @@ static int av_encode(AVFormatContext **output_files,
             case CODEC_TYPE_VIDEO:
                 if (ost->st->codec->pix_fmt == PIX_FMT_NONE) {
                     fprintf(stderr, "Video pixel format is unknown, stream cannot be decoded\n");
-                    av_exit(1);
+                    ret = AVERROR(EINVAL);
+                    goto fail;
                 }
-                ost->video_crop = ((frame_leftBand + frame_rightBand + frame_topBand + frame_bottomBand) != 0);
-                ost->video_pad = ((frame_padleft + frame_padright + frame_padtop + frame_padbottom) != 0);
+                ost->video_crop = ((run_opts.frame_leftBand + run_opts.frame_rightBand + run_opts.frame_topBand + run_opts.frame_bottomBand) != 0);
+                ost->video_pad = ((run_opts.frame_padleft + run_opts.frame_padright + run_opts.frame_padtop + run_opts.frame_padbottom) != 0);
                 ost->video_resample = ((codec->width != icodec->width -
-                                (frame_leftBand + frame_rightBand) +
-                                (frame_padleft + frame_padright)) ||
+                                (run_opts.frame_leftBand + run_opts.frame_rightBand) +
+                                (run_opts.frame_padleft + run_opts.frame_padright)) ||
                         (codec->height != icodec->height -
-                                (frame_topBand  + frame_bottomBand) +
-                                (frame_padtop + frame_padbottom)) ||
+                                (run_opts.frame_topBand  + run_opts.frame_bottomBand) +
+                                (run_opts.frame_padtop + run_opts.frame_padbottom)) ||
                         (codec->pix_fmt != icodec->pix_fmt));
                 if (ost->video_crop) {
-                    ost->topBand    = ost->original_topBand    = frame_topBand;
-                    ost->bottomBand = ost->original_bottomBand = frame_bottomBand;
-                    ost->leftBand   = ost->original_leftBand   = frame_leftBand;
-                    ost->rightBand  = ost->original_rightBand  = frame_rightBand;
+                    ost->topBand    = ost->original_topBand    = run_opts.frame_topBand;
+                    ost->bottomBand = ost->original_bottomBand = run_opts.frame_bottomBand;
+                    ost->leftBand   = ost->original_leftBand   = run_opts.frame_leftBand;
+                    ost->rightBand  = ost->original_rightBand  = run_opts.frame_rightBand;
                 }
                 if (ost->video_pad) {
-                    ost->padtop = frame_padtop;
-                    ost->padleft = frame_padleft;
-                    ost->padbottom = frame_padbottom;
-                    ost->padright = frame_padright;
+                    ost->padtop = run_opts.frame_padtop;
+                    ost->padleft = run_opts.frame_padleft;
+                    ost->padbottom = run_opts.frame_padbottom;
+                    ost->padright = run_opts.frame_padright;
                     if (!ost->video_resample) {
                         avcodec_get_frame_defaults(&ost->pict_tmp);
                         if(avpicture_alloc((AVPicture*)&ost->pict_tmp, codec->pix_fmt,
@@ -1921,27 +2589,29 @@ static int av_encode(AVFormatContext **output_files,
                     if(avpicture_alloc((AVPicture*)&ost->pict_tmp, codec->pix_fmt,
                                          codec->width, codec->height)) {
                         fprintf(stderr, "Cannot allocate temp picture, check pix fmt\n");
-                        av_exit(1);
+                        ret = AVERROR(EINVAL);
+                        goto fail;
                     }
-                    sws_flags = av_get_int(sws_opts, "sws_flags", NULL);
+                    run_opts.sws_flags = av_get_int(sws_opts, "sws_flags", NULL);
                     ost->img_resample_ctx = sws_getContext(
-                            icodec->width - (frame_leftBand + frame_rightBand),
-                            icodec->height - (frame_topBand + frame_bottomBand),
+                            icodec->width - (run_opts.frame_leftBand + run_opts.frame_rightBand),
+                            icodec->height - (run_opts.frame_topBand + run_opts.frame_bottomBand),
                             icodec->pix_fmt,
-                            codec->width - (frame_padleft + frame_padright),
-                            codec->height - (frame_padtop + frame_padbottom),
+                            codec->width - (run_opts.frame_padleft + run_opts.frame_padright),
+                            codec->height - (run_opts.frame_padtop + run_opts.frame_padbottom),
                             codec->pix_fmt,
-                            sws_flags, NULL, NULL, NULL);
+                            run_opts.sws_flags, NULL, NULL, NULL);
                     if (ost->img_resample_ctx == NULL) {
                         fprintf(stderr, "Cannot get resampling context\n");
-                        av_exit(1);
+                        ret = AVERROR(EINVAL);
+                        goto fail;
                     }
 
                     ost->original_height = icodec->height;
                     ost->original_width  = icodec->width;
 
-                    ost->resample_height = icodec->height - (frame_topBand  + frame_bottomBand);
-                    ost->resample_width  = icodec->width  - (frame_leftBand + frame_rightBand);
+                    ost->resample_height = icodec->height - (run_opts.frame_topBand  + run_opts.frame_bottomBand);
+                    ost->resample_width  = icodec->width  - (run_opts.frame_leftBand + run_opts.frame_rightBand);
                     ost->resample_pix_fmt= icodec->pix_fmt;
                     codec->bits_per_raw_sample= 0;
                 }
@@ -1965,13 +2635,14 @@ static int av_encode(AVFormatContext **output_files,
                 char *logbuffer;
 
                 snprintf(logfilename, sizeof(logfilename), "%s-%d.log",
-                         pass_logfilename_prefix ? pass_logfilename_prefix : DEFAULT_PASS_LOGFILENAME_PREFIX,
+                         run_opts.pass_logfilename_prefix ? run_opts.pass_logfilename_prefix : DEFAULT_PASS_LOGFILENAME_PREFIX,
                          i);
                 if (codec->flags & CODEC_FLAG_PASS1) {
                     f = fopen(logfilename, "w");
                     if (!f) {
                         fprintf(stderr, "Cannot write log file '%s' for pass-1 encoding: %s\n", logfilename, strerror(errno));
-                        av_exit(1);
+                        ret = AVERROR(EINVAL);
+                        goto fail;
                     }
                     ost->logfile = f;
                 } else {
@@ -1979,7 +2650,8 @@ static int av_encode(AVFormatContext **output_files,
                     f = fopen(logfilename, "r");
                     if (!f) {
                         fprintf(stderr, "Cannot read log file '%s' for pass-2 encoding: %s\n", logfilename, strerror(errno));
-                        av_exit(1);
+                        ret = AVERROR(EINVAL);
+                        goto fail;
                     }
                     fseek(f, 0, SEEK_END);
                     size = ftell(f);
@@ -1987,7 +2659,9 @@ static int av_encode(AVFormatContext **output_files,
                     logbuffer = av_malloc(size + 1);
                     if (!logbuffer) {
                         fprintf(stderr, "Could not allocate log buffer\n");
-                        av_exit(1);
+                        fclose(f);
+                        ret = AVERROR(EINVAL);
+                        goto fail;
                     }
                     size = fread(logbuffer, 1, size, f);
                     fclose(f);
@@ -2031,6 +2705,8 @@ static int av_encode(AVFormatContext **output_files,
                 goto dump_format;
             }
             extra_size += ost->st->codec->extradata_size;
+            if (run_opts.do_ssim && ost->st->codec->codec_type == CODEC_TYPE_VIDEO)
+                ost->metric = metric_init(ost->st->codec);
         }
     }
 
@@ -2064,16 +2740,24 @@ static int av_encode(AVFormatContext **output_files,
         ist->pts = 0;
         ist->next_pts = AV_NOPTS_VALUE;
         ist->is_start = 1;
+        ist->skip_frame = ist->st->codec->skip_frame;
+        ist->trim_pts = AV_NOPTS_VALUE;
+        ist->repeat_pict = ist->st->parser ? ist->st->parser->repeat_pict : -1;
+        if (ist->decoding_needed) {
+            ist->trim_pts = input_files_trim_pts[ist->file_index];
+            if (run_opts.start_time && (ist->trim_pts == AV_NOPTS_VALUE || ist->trim_pts < run_opts.start_time))
+                ist->trim_pts = run_opts.start_time;
+        }
     }
 
     /* set meta data information from input file if required */
-    for (i=0;i<nb_meta_data_maps;i++) {
+    for (i=0;i<run_opts.nb_meta_data_maps;i++) {
         AVFormatContext *out_file;
         AVFormatContext *in_file;
         AVMetadataTag *mtag;
 
-        int out_file_index = meta_data_maps[i].out_file;
-        int in_file_index = meta_data_maps[i].in_file;
+        int out_file_index = run_opts.meta_data_maps[i].out_file;
+        int in_file_index = run_opts.meta_data_maps[i].in_file;
         if (out_file_index < 0 || out_file_index >= nb_output_files) {
             snprintf(error, sizeof(error), "Invalid output file index %d map_meta_data(%d,%d)",
                      out_file_index, out_file_index, in_file_index);
@@ -2119,7 +2803,7 @@ static int av_encode(AVFormatContext **output_files,
     }
 
     /* dump the stream mapping */
-    if (verbose >= 0) {
+    if (run_opts.verbose >= 0) {
         fprintf(stderr, "Stream mapping:\n");
         for(i=0;i<nb_ostreams;i++) {
             ost = ost_table[i];
@@ -2145,12 +2829,16 @@ static int av_encode(AVFormatContext **output_files,
         print_sdp(output_files, nb_output_files);
     }
 
-    if (!using_stdin && verbose >= 0) {
+    if (!using_stdin && run_opts.verbose >= 0) {
         fprintf(stderr, "Press [q] to stop encoding\n");
         url_set_interrupt_cb(decode_interrupt_cb);
     }
     term_init();
 
+#if HAVE_PTHREADS
+    init_input_threads(input_files, file_table, nb_input_files);
+#endif
+
     timer_start = av_gettime();
 
     for(; received_sigterm == 0;) {
@@ -2190,14 +2878,14 @@ static int av_encode(AVFormatContext **output_files,
             if (!file_table[ist->file_index].eof_reached){
                 if(ipts < ipts_min) {
                     ipts_min = ipts;
-                    if(input_sync ) file_index = ist->file_index;
+                    if(run_opts.input_sync ) file_index = ist->file_index;
                 }
                 if(opts < opts_min) {
                     opts_min = opts;
-                    if(!input_sync) file_index = ist->file_index;
+                    if(!run_opts.input_sync) file_index = ist->file_index;
                 }
             }
-            if(ost->frame_number >= max_frames[ost->st->codec->codec_type]){
+            if(ost->frame_number >= run_opts.max_frames[ost->st->codec->codec_type]){
                 file_index= -1;
                 break;
             }
@@ -2214,16 +2902,16 @@ static int av_encode(AVFormatContext **output_files,
         }
 
         /* finish if recording time exhausted */
-        if (opts_min >= (recording_time / 1000000.0))
+        if (opts_min >= (run_opts.recording_time / 1000000.0))
             break;
 
         /* finish if limit size exhausted */
-        if (limit_filesize != 0 && limit_filesize < url_ftell(output_files[0]->pb))
+        if (run_opts.limit_filesize != 0 && run_opts.limit_filesize < url_ftell(output_files[0]->pb))
             break;
 
         /* read a frame from it and output it in the fifo */
         is = input_files[file_index];
-        ret= av_read_frame(is, &pkt);
+        ret= get_input_packet(is, &file_table[file_index], &pkt, &repeat_pict);
         if(ret == AVERROR(EAGAIN)){
             no_packet[file_index]=1;
             no_packet_count++;
@@ -2231,7 +2919,7 @@ static int av_encode(AVFormatContext **output_files,
         }
         if (ret < 0) {
             file_table[file_index].eof_reached = 1;
-            if (opt_shortest)
+            if (run_opts.opt_shortest)
                 break;
             else
                 continue;
@@ -2240,8 +2928,8 @@ static int av_encode(AVFormatContext **output_files,
         no_packet_count=0;
         memset(no_packet, 0, sizeof(no_packet));
 
-        if (do_pkt_dump) {
-            av_pkt_dump_log(NULL, AV_LOG_DEBUG, &pkt, do_hex_dump);
+        if (run_opts.do_pkt_dump) {
+            av_pkt_dump_log(NULL, AV_LOG_DEBUG, &pkt, run_opts.do_hex_dump);
         }
         /* the following test is needed in case new streams appear
            dynamically in stream : we ignore them */
@@ -2251,17 +2939,18 @@ static int av_encode(AVFormatContext **output_files,
         ist = ist_table[ist_index];
         if (ist->discard)
             goto discard_packet;
+        ist->repeat_pict = repeat_pict;
 
         if (pkt.dts != AV_NOPTS_VALUE)
             pkt.dts += av_rescale_q(input_files_ts_offset[ist->file_index], AV_TIME_BASE_Q, ist->st->time_base);
         if (pkt.pts != AV_NOPTS_VALUE)
             pkt.pts += av_rescale_q(input_files_ts_offset[ist->file_index], AV_TIME_BASE_Q, ist->st->time_base);
 
-        if(input_files_ts_scale[file_index][pkt.stream_index]){
+        if(run_opts.input_files_ts_scale[file_index][pkt.stream_index]){
             if(pkt.pts != AV_NOPTS_VALUE)
-                pkt.pts *= input_files_ts_scale[file_index][pkt.stream_index];
+                pkt.pts *= run_opts.input_files_ts_scale[file_index][pkt.stream_index];
             if(pkt.dts != AV_NOPTS_VALUE)
-                pkt.dts *= input_files_ts_scale[file_index][pkt.stream_index];
+                pkt.dts *= run_opts.input_files_ts_scale[file_index][pkt.stream_index];
         }
 
 //        fprintf(stderr, "next:%"PRId64" dts:%"PRId64" off:%"PRId64" %d\n", ist->next_pts, pkt.dts, input_files_ts_offset[ist->file_index], ist->st->codec->codec_type);
@@ -2269,9 +2958,9 @@ static int av_encode(AVFormatContext **output_files,
             && (is->iformat->flags & AVFMT_TS_DISCONT)) {
             int64_t pkt_dts= av_rescale_q(pkt.dts, ist->st->time_base, AV_TIME_BASE_Q);
             int64_t delta= pkt_dts - ist->next_pts;
-            if((FFABS(delta) > 1LL*dts_delta_threshold*AV_TIME_BASE || pkt_dts+1<ist->pts)&& !copy_ts){
+            if((FFABS(delta) > 1LL*run_opts.dts_delta_threshold*AV_TIME_BASE || pkt_dts+1<ist->pts)&& !run_opts.copy_ts){
                 input_files_ts_offset[ist->file_index]-= delta;
-                if (verbose > 2)
+                if (run_opts.verbose > 2)
                     fprintf(stderr, "timestamp discontinuity %"PRId64", new offset= %"PRId64"\n", delta, input_files_ts_offset[ist->file_index]);
                 pkt.dts-= av_rescale_q(delta, AV_TIME_BASE_Q, ist->st->time_base);
                 if(pkt.pts != AV_NOPTS_VALUE)
@@ -2280,14 +2969,16 @@ static int av_encode(AVFormatContext **output_files,
         }
 
         //fprintf(stderr,"read #%d.%d size=%d\n", ist->file_index, ist->index, pkt.size);
-        if (output_packet(ist, ist_index, ost_table, nb_ostreams, &pkt) < 0) {
+        if ((ret = output_packet(ist, ist_index, ost_table, nb_ostreams, &pkt)) < 0) {
+            av_free_packet(&pkt);
+            if (ret != -1)
+                goto stop;
 
-            if (verbose >= 0)
+            if (run_opts.verbose >= 0)
                 fprintf(stderr, "Error while decoding stream #%d.%d\n",
                         ist->file_index, ist->index);
-            if (exit_on_error)
-                av_exit(1);
-            av_free_packet(&pkt);
+            if (run_opts.exit_on_error)
+                goto stop;
             goto redo;
         }
 
@@ -2298,16 +2989,19 @@ static int av_encode(AVFormatContext **output_files,
         print_report(output_files, ost_table, nb_ostreams, 0);
     }
 
+#if HAVE_PTHREADS
+    free_input_threads(file_table, nb_input_files);
+#endif
+
     /* at the end of stream, we must flush the decoder buffers */
     for(i=0;i<nb_istreams;i++) {
         ist = ist_table[i];
         if (ist->decoding_needed) {
-            output_packet(ist, i, ost_table, nb_ostreams, NULL);
+            if ((ret = output_packet(ist, i, ost_table, nb_ostreams, NULL)) < -1)
+                goto stop;
         }
     }
 
-    term_exit();
-
     /* write the trailer if needed and close file */
     for(i=0;i<nb_output_files;i++) {
         os = output_files[i];
@@ -2317,27 +3011,35 @@ static int av_encode(AVFormatContext **output_files,
     /* dump report by using the first video and audio streams */
     print_report(output_files, ost_table, nb_ostreams, 1);
 
+    /* finished ! */
+    ret = 0;
+
+    /* a job that fails once the encoding started also ends up here, so
+       that a batch can go on with the next one */
+ stop:
+#if HAVE_PTHREADS
+    free_input_threads(file_table, nb_input_files);
+#endif
+    term_exit();
+
+ fail:
     /* close each encoder */
-    for(i=0;i<nb_ostreams;i++) {
+    for(i=0;ost_table && i<nb_ostreams;i++) {
         ost = ost_table[i];
-        if (ost->encoding_needed) {
+        if (ost && ost->encoding_needed) {
             av_freep(&ost->st->codec->stats_in);
             avcodec_close(ost->st->codec);
         }
     }
 
     /* close each decoder */
-    for(i=0;i<nb_istreams;i++) {
+    for(i=0;ist_table && i<nb_istreams;i++) {
         ist = ist_table[i];
-        if (ist->decoding_needed) {
+        if (ist && ist->decoding_needed) {
             avcodec_close(ist->st->codec);
         }
     }
 
-    /* finished ! */
-    ret = 0;
-
- fail:
     av_freep(&bit_buffer);
     av_free(file_table);
 
@@ -2365,6 +3067,7 @@ static int av_encode(AVFormatContext **output_files,
                     audio_resample_close(ost->resample);
                 if (ost->reformat_ctx)
                     av_audio_convert_free(ost->reformat_ctx);
+                metric_free(ost->metric);
                 av_free(ost);
             }
         }
@@ -2377,35 +3080,35 @@ static void opt_format(const char *arg)
 {
     /* compatibility stuff for pgmyuv */
     if (!strcmp(arg, "pgmyuv")) {
-        pgmyuv_compatibility_hack=1;
+        run_opts.pgmyuv_compatibility_hack=1;
 //        opt_image_format(arg);
         arg = "image2";
         fprintf(stderr, "pgmyuv format is deprecated, use image2\n");
     }
 
-    last_asked_format = arg;
+    run_opts.last_asked_format = arg;
 }
 
 static void opt_video_rc_override_string(const char *arg)
 {
-    video_rc_override_string = arg;
+    run_opts.video_rc_override_string = arg;
 }
 
 static int opt_me_threshold(const char *opt, const char *arg)
 {
-    me_threshold = parse_number_or_die(opt, arg, OPT_INT64, INT_MIN, INT_MAX);
+    run_opts.me_threshold = parse_number_or_die(opt, arg, OPT_INT64, INT_MIN, INT_MAX);
     return 0;
 }
 
 static int opt_verbose(const char *opt, const char *arg)
 {
-    verbose = parse_number_or_die(opt, arg, OPT_INT64, -10, 10);
+    run_opts.verbose = parse_number_or_die(opt, arg, OPT_INT64, -10, 10);
     return 0;
 }
 
 static int opt_frame_rate(const char *opt, const char *arg)
 {
-    if (av_parse_video_frame_rate(&frame_rate, arg) < 0) {
+    if (av_parse_video_frame_rate(&run_opts.frame_rate, arg) < 0) {
         fprintf(stderr, "Incorrect value for %s: %s\n", opt, arg);
         av_exit(1);
     }
@@ -2426,63 +3129,63 @@ static int opt_bitrate(const char *opt, const char *arg)
 
 static void opt_frame_crop_top(const char *arg)
 {
-    frame_topBand = atoi(arg);
-    if (frame_topBand < 0) {
+    run_opts.frame_topBand = atoi(arg);
+    if (run_opts.frame_topBand < 0) {
         fprintf(stderr, "Incorrect top crop size\n");
         av_exit(1);
     }
-    if ((frame_topBand) >= frame_height){
+    if ((run_opts.frame_topBand) >= run_opts.frame_height){
         fprintf(stderr, "Vertical crop dimensions are outside the range of the original image.\nRemember to crop first and scale second.\n");
         av_exit(1);
     }
-    frame_height -= frame_topBand;
+    run_opts.frame_height -= run_opts.frame_topBand;
 }
 
 static void opt_frame_crop_bottom(const char *arg)
 {
-    frame_bottomBand = atoi(arg);
-    if (frame_bottomBand < 0) {
+    run_opts.frame_bottomBand = atoi(arg);
+    if (run_opts.frame_bottomBand < 0) {
         fprintf(stderr, "Incorrect bottom crop size\n");
         av_exit(1);
     }
-    if ((frame_bottomBand) >= frame_height){
+    if ((run_opts.frame_bottomBand) >= run_opts.frame_height){
         fprintf(stderr, "Vertical crop dimensions are outside the range of the original image.\nRemember to crop first and scale second.\n");
         av_exit(1);
     }
-    frame_height -= frame_bottomBand;
+    run_opts.frame_height -= run_opts.frame_bottomBand;
 }
 
 static void opt_frame_crop_left(const char *arg)
 {
-    frame_leftBand = atoi(arg);
-    if (frame_leftBand < 0) {
+    run_opts.frame_leftBand = atoi(arg);
+    if (run_opts.frame_leftBand < 0) {
         fprintf(stderr, "Incorrect left crop size\n");
         av_exit(1);
     }
-    if ((frame_leftBand) >= frame_width){
+    if ((run_opts.frame_leftBand) >= run_opts.frame_width){
         fprintf(stderr, "Horizontal crop dimensions are outside the range of the original image.\nRemember to crop first and scale second.\n");
         av_exit(1);
     }
-    frame_width -= frame_leftBand;
+    run_opts.frame_width -= run_opts.frame_leftBand;
 }
 
 static void opt_frame_crop_right(const char *arg)
 {
-    frame_rightBand = atoi(arg);
-    if (frame_rightBand < 0) {
+    run_opts.frame_rightBand = atoi(arg);
+    if (run_opts.frame_rightBand < 0) {
         fprintf(stderr, "Incorrect right crop size\n");
         av_exit(1);
     }
-    if ((frame_rightBand) >= frame_width){
+    if ((run_opts.frame_rightBand) >= run_opts.frame_width){
         fprintf(stderr, "Horizontal crop dimensions are outside the range of the original image.\nRemember to crop first and scale second.\n");
         av_exit(1);
     }
-    frame_width -= frame_rightBand;
+    run_opts.frame_width -= run_opts.frame_rightBand;
 }
 
 static void opt_frame_size(const char *arg)
 {
-    if (av_parse_video_frame_size(&frame_width, &frame_height, arg) < 0) {
+    if (av_parse_video_frame_size(&run_opts.frame_width, &run_opts.frame_height, arg) < 0) {
         fprintf(stderr, "Incorrect frame size\n");
         av_exit(1);
     }
@@ -2498,15 +3201,15 @@ static void opt_pad_color(const char *arg) {
     g = ((rgb >> 8) & 255);
     b = (rgb & 255);
 
-    padcolor[0] = RGB_TO_Y(r,g,b);
-    padcolor[1] = RGB_TO_U(r,g,b,0);
-    padcolor[2] = RGB_TO_V(r,g,b,0);
+    run_opts.padcolor[0] = RGB_TO_Y(r,g,b);
+    run_opts.padcolor[1] = RGB_TO_U(r,g,b,0);
+    run_opts.padcolor[2] = RGB_TO_V(r,g,b,0);
 }
 
 static void opt_frame_pad_top(const char *arg)
 {
-    frame_padtop = atoi(arg);
-    if (frame_padtop < 0) {
+    run_opts.frame_padtop = atoi(arg);
+    if (run_opts.frame_padtop < 0) {
         fprintf(stderr, "Incorrect top pad size\n");
         av_exit(1);
     }
@@ -2514,8 +3217,8 @@ static void opt_frame_pad_top(const char *arg)
 
 static void opt_frame_pad_bottom(const char *arg)
 {
-    frame_padbottom = atoi(arg);
-    if (frame_padbottom < 0) {
+    run_opts.frame_padbottom = atoi(arg);
+    if (run_opts.frame_padbottom < 0) {
         fprintf(stderr, "Incorrect bottom pad size\n");
         av_exit(1);
     }
@@ -2524,8 +3227,8 @@ static void opt_frame_pad_bottom(const char *arg)
 
 static void opt_frame_pad_left(const char *arg)
 {
-    frame_padleft = atoi(arg);
-    if (frame_padleft < 0) {
+    run_opts.frame_padleft = atoi(arg);
+    if (run_opts.frame_padleft < 0) {
         fprintf(stderr, "Incorrect left pad size\n");
         av_exit(1);
     }
@@ -2534,8 +3237,8 @@ static void opt_frame_pad_left(const char *arg)
 
 static void opt_frame_pad_right(const char *arg)
 {
-    frame_padright = atoi(arg);
-    if (frame_padright < 0) {
+    run_opts.frame_padright = atoi(arg);
+    if (run_opts.frame_padright < 0) {
         fprintf(stderr, "Incorrect right pad size\n");
         av_exit(1);
     }
@@ -2554,8 +3257,8 @@ static void list_fmts(void (*get_fmt_string)(char *buf, int buf_size, int fmt),
 static void opt_frame_pix_fmt(const char *arg)
 {
     if (strcmp(arg, "list")) {
-        frame_pix_fmt = avcodec_get_pix_fmt(arg);
-        if (frame_pix_fmt == PIX_FMT_NONE) {
+        run_opts.frame_pix_fmt = avcodec_get_pix_fmt(arg);
+        if (run_opts.frame_pix_fmt == PIX_FMT_NONE) {
             fprintf(stderr, "Unknown pixel format requested: %s\n", arg);
             av_exit(1);
         }
@@ -2586,7 +3289,7 @@ static void opt_frame_aspect_ratio(const char *arg)
         fprintf(stderr, "Incorrect aspect ratio specification.\n");
         av_exit(1);
     }
-    frame_aspect_ratio = ar;
+    run_opts.frame_aspect_ratio = ar;
 }
 
 static int opt_metadata(const char *opt, const char *arg)
@@ -2599,19 +3302,19 @@ static int opt_metadata(const char *opt, const char *arg)
     }
     *mid++= 0;
 
-    metadata_count++;
-    metadata= av_realloc(metadata, sizeof(*metadata)*metadata_count);
-    metadata[metadata_count-1].key  = av_strdup(arg);
-    metadata[metadata_count-1].value= av_strdup(mid);
+    run_opts.metadata_count++;
+    run_opts.metadata= av_realloc(run_opts.metadata, sizeof(*run_opts.metadata)*run_opts.metadata_count);
+    run_opts.metadata[run_opts.metadata_count-1].key  = av_strdup(arg);
+    run_opts.metadata[run_opts.metadata_count-1].value= av_strdup(mid);
 
     return 0;
 }
 
 static void opt_qscale(const char *arg)
 {
-    video_qscale = atof(arg);
-    if (video_qscale <= 0 ||
-        video_qscale > 255) {
+    run_opts.video_qscale = atof(arg);
+    if (run_opts.video_qscale <= 0 ||
+        run_opts.video_qscale > 255) {
         fprintf(stderr, "qscale must be > 0.0 and <= 255\n");
         av_exit(1);
     }
@@ -2619,14 +3322,14 @@ static void opt_qscale(const char *arg)
 
 static void opt_top_field_first(const char *arg)
 {
-    top_field_first= atoi(arg);
+    run_opts.top_field_first= atoi(arg);
 }
 
 static int opt_thread_count(const char *opt, const char *arg)
 {
-    thread_count= parse_number_or_die(opt, arg, OPT_INT64, 0, INT_MAX);
+    run_opts.thread_count= parse_number_or_die(opt, arg, OPT_INT64, 0, INT_MAX);
 #if !HAVE_THREADS
-    if (verbose >= 0)
+    if (run_opts.verbose >= 0)
         fprintf(stderr, "Warning: not compiled with thread support, using thread emulation\n");
 #endif
     return 0;
@@ -2635,7 +3338,7 @@ static int opt_thread_count(const char *opt, const char *arg)
 static void opt_audio_sample_fmt(const char *arg)
 {
     if (strcmp(arg, "list"))
-        audio_sample_fmt = avcodec_get_sample_fmt(arg);
+        run_opts.audio_sample_fmt = avcodec_get_sample_fmt(arg);
     else {
         list_fmts(avcodec_sample_fmt_string, SAMPLE_FMT_NB);
         av_exit(0);
@@ -2644,24 +3347,24 @@ static void opt_audio_sample_fmt(const char *arg)
 
 static int opt_audio_rate(const char *opt, const char *arg)
 {
-    audio_sample_rate = parse_number_or_die(opt, arg, OPT_INT64, 0, INT_MAX);
+    run_opts.audio_sample_rate = parse_number_or_die(opt, arg, OPT_INT64, 0, INT_MAX);
     return 0;
 }
 
 static int opt_audio_channels(const char *opt, const char *arg)
 {
-    audio_channels = parse_number_or_die(opt, arg, OPT_INT64, 0, INT_MAX);
+    run_opts.audio_channels = parse_number_or_die(opt, arg, OPT_INT64, 0, INT_MAX);
     return 0;
 }
 
 static void opt_video_channel(const char *arg)
 {
-    video_channel = strtol(arg, NULL, 0);
+    run_opts.video_channel = strtol(arg, NULL, 0);
 }
 
 static void opt_video_standard(const char *arg)
 {
-    video_standard = av_strdup(arg);
+    run_opts.video_standard = av_strdup(arg);
 }
 
 static void opt_codec(int *pstream_copy, char **pcodec_name,
@@ -2677,44 +3380,44 @@ static void opt_codec(int *pstream_copy, char **pcodec_name,
 
 static void opt_audio_codec(const char *arg)
 {
-    opt_codec(&audio_stream_copy, &audio_codec_name, CODEC_TYPE_AUDIO, arg);
+    opt_codec(&run_opts.audio_stream_copy, &run_opts.audio_codec_name, CODEC_TYPE_AUDIO, arg);
 }
 
 static void opt_audio_tag(const char *arg)
 {
     char *tail;
-    audio_codec_tag= strtol(arg, &tail, 0);
+    run_opts.audio_codec_tag= strtol(arg, &tail, 0);
 
     if(!tail || *tail)
-        audio_codec_tag= arg[0] + (arg[1]<<8) + (arg[2]<<16) + (arg[3]<<24);
+        run_opts.audio_codec_tag= arg[0] + (arg[1]<<8) + (arg[2]<<16) + (arg[3]<<24);
 }
 
 static void opt_video_tag(const char *arg)
 {
     char *tail;
-    video_codec_tag= strtol(arg, &tail, 0);
+    run_opts.video_codec_tag= strtol(arg, &tail, 0);
 
     if(!tail || *tail)
-        video_codec_tag= arg[0] + (arg[1]<<8) + (arg[2]<<16) + (arg[3]<<24);
+        run_opts.video_codec_tag= arg[0] + (arg[1]<<8) + (arg[2]<<16) + (arg[3]<<24);
 }
 
 static void opt_video_codec(const char *arg)
 {
-    opt_codec(&video_stream_copy, &video_codec_name, CODEC_TYPE_VIDEO, arg);
+    opt_codec(&run_opts.video_stream_copy, &run_opts.video_codec_name, CODEC_TYPE_VIDEO, arg);
 }
 
 static void opt_subtitle_codec(const char *arg)
 {
-    opt_codec(&subtitle_stream_copy, &subtitle_codec_name, CODEC_TYPE_SUBTITLE, arg);
+    opt_codec(&run_opts.subtitle_stream_copy, &run_opts.subtitle_codec_name, CODEC_TYPE_SUBTITLE, arg);
 }
 
 static void opt_subtitle_tag(const char *arg)
 {
     char *tail;
-    subtitle_codec_tag= strtol(arg, &tail, 0);
+    run_opts.subtitle_codec_tag= strtol(arg, &tail, 0);
 
     if(!tail || *tail)
-        subtitle_codec_tag= arg[0] + (arg[1]<<8) + (arg[2]<<16) + (arg[3]<<24);
+        run_opts.subtitle_codec_tag= arg[0] + (arg[1]<<8) + (arg[2]<<16) + (arg[3]<<24);
 }
 
 static void opt_map(const char *arg)
@@ -2722,7 +3425,7 @@ static void opt_map(const char *arg)
     AVStreamMap *m;
     char *p;
 
-    m = &stream_maps[nb_stream_maps++];
+    m = &run_opts.stream_maps[run_opts.nb_stream_maps++];
 
     m->file_index = strtol(arg, &p, 0);
     if (*p)
@@ -2746,7 +3449,7 @@ static void opt_map_meta_data(const char *arg)
     AVMetaDataMap *m;
     char *p;
 
-    m = &meta_data_maps[nb_meta_data_maps++];
+    m = &run_opts.meta_data_maps[run_opts.nb_meta_data_maps++];
 
     m->out_file = strtol(arg, &p, 0);
     if (*p)
@@ -2769,30 +3472,30 @@ static void opt_input_ts_scale(const char *arg)
     if(stream >= MAX_STREAMS)
         av_exit(1);
 
-    input_files_ts_scale[nb_input_files][stream]= scale;
+    run_opts.input_files_ts_scale[nb_input_files][stream]= scale;
 }
 
 static int opt_recording_time(const char *opt, const char *arg)
 {
-    recording_time = parse_time_or_die(opt, arg, 1);
+    run_opts.recording_time = parse_time_or_die(opt, arg, 1);
     return 0;
 }
 
 static int opt_start_time(const char *opt, const char *arg)
 {
-    start_time = parse_time_or_die(opt, arg, 1);
+    run_opts.start_time = parse_time_or_die(opt, arg, 1);
     return 0;
 }
 
 static int opt_rec_timestamp(const char *opt, const char *arg)
 {
-    rec_timestamp = parse_time_or_die(opt, arg, 0) / 1000000;
+    run_opts.rec_timestamp = parse_time_or_die(opt, arg, 0) / 1000000;
     return 0;
 }
 
 static int opt_input_ts_offset(const char *opt, const char *arg)
 {
-    input_ts_offset = parse_time_or_die(opt, arg, 1);
+    run_opts.input_ts_offset = parse_time_or_die(opt, arg, 1);
     return 0;
 }
 
@@ -2825,9 +3528,9 @@ static void opt_input_file(const char *filename)
     int err, i, ret, rfps, rfps_base;
     int64_t timestamp;
 
-    if (last_asked_format) {
-        file_iformat = av_find_input_format(last_asked_format);
-        last_asked_format = NULL;
+    if (run_opts.last_asked_format) {
+        file_iformat = av_find_input_format(run_opts.last_asked_format);
+        run_opts.last_asked_format = NULL;
     }
 
     if (!strcmp(filename, "-"))
@@ -2845,26 +3548,26 @@ static void opt_input_file(const char *filename)
 
     memset(ap, 0, sizeof(*ap));
     ap->prealloced_context = 1;
-    ap->sample_rate = audio_sample_rate;
-    ap->channels = audio_channels;
-    ap->time_base.den = frame_rate.num;
-    ap->time_base.num = frame_rate.den;
-    ap->width = frame_width + frame_padleft + frame_padright;
-    ap->height = frame_height + frame_padtop + frame_padbottom;
-    ap->pix_fmt = frame_pix_fmt;
+    ap->sample_rate = run_opts.audio_sample_rate;
+    ap->channels = run_opts.audio_channels;
+    ap->time_base.den = run_opts.frame_rate.num;
+    ap->time_base.num = run_opts.frame_rate.den;
+    ap->width = run_opts.frame_width + run_opts.frame_padleft + run_opts.frame_padright;
+    ap->height = run_opts.frame_height + run_opts.frame_padtop + run_opts.frame_padbottom;
+    ap->pix_fmt = run_opts.frame_pix_fmt;
    // ap->sample_fmt = audio_sample_fmt; //FIXME:not implemented in libavformat
-    ap->channel = video_channel;
-    ap->standard = video_standard;
-    ap->video_codec_id = find_codec_or_die(video_codec_name, CODEC_TYPE_VIDEO, 0);
-    ap->audio_codec_id = find_codec_or_die(audio_codec_name, CODEC_TYPE_AUDIO, 0);
-    if(pgmyuv_compatibility_hack)
+    ap->channel = run_opts.video_channel;
+    ap->standard = run_opts.video_standard;
+    ap->video_codec_id = find_codec_or_die(run_opts.video_codec_name, CODEC_TYPE_VIDEO, 0);
+    ap->audio_codec_id = find_codec_or_die(run_opts.audio_codec_name, CODEC_TYPE_AUDIO, 0);
+    if(run_opts.pgmyuv_compatibility_hack)
         ap->video_codec_id= CODEC_ID_PGMYUV;
 
     set_context_opts(ic, avformat_opts, AV_OPT_FLAG_DECODING_PARAM);
 
-    ic->video_codec_id   = find_codec_or_die(video_codec_name   , CODEC_TYPE_VIDEO   , 0);
-    ic->audio_codec_id   = find_codec_or_die(audio_codec_name   , CODEC_TYPE_AUDIO   , 0);
-    ic->subtitle_codec_id= find_codec_or_die(subtitle_codec_name, CODEC_TYPE_SUBTITLE, 0);
+    ic->video_codec_id   = find_codec_or_die(run_opts.video_codec_name   , CODEC_TYPE_VIDEO   , 0);
+    ic->audio_codec_id   = find_codec_or_die(run_opts.audio_codec_name   , CODEC_TYPE_AUDIO   , 0);
+    ic->subtitle_codec_id= find_codec_or_die(run_opts.subtitle_codec_name, CODEC_TYPE_SUBTITLE, 0);
     ic->flags |= AVFMT_FLAG_NONBLOCK;
 
     /* open the input file with generic libav function */
@@ -2873,96 +3576,101 @@ static void opt_input_file(const char *filename)
         print_error(filename, err);
         av_exit(1);
     }
-    if(opt_programid) {
+    if(run_opts.opt_programid) {
         int i;
         for(i=0; i<ic->nb_programs; i++)
-            if(ic->programs[i]->id != opt_programid)
+            if(ic->programs[i]->id != run_opts.opt_programid)
                 ic->programs[i]->discard = AVDISCARD_ALL;
     }
 
-    ic->loop_input = loop_input;
+    ic->loop_input = run_opts.loop_input;
 
     /* If not enough info to get the stream parameters, we decode the
        first frames to get it. (used in mpeg case for example) */
     ret = av_find_stream_info(ic);
-    if (ret < 0 && verbose >= 0) {
+    if (ret < 0 && run_opts.verbose >= 0) {
         fprintf(stderr, "%s: could not find codec parameters\n", filename);
         av_exit(1);
     }
 
-    timestamp = start_time;
+    timestamp = run_opts.start_time;
     /* add the stream start time */
     if (ic->start_time != AV_NOPTS_VALUE)
         timestamp += ic->start_time;
 
     /* if seeking requested, we execute it */
-    if (start_time != 0) {
+    input_files_trim_pts[nb_input_files] = AV_NOPTS_VALUE;
+    if (run_opts.start_time != 0) {
         ret = av_seek_frame(ic, -1, timestamp, AVSEEK_FLAG_BACKWARD);
         if (ret < 0) {
             fprintf(stderr, "%s: could not seek to position %0.3f\n",
                     filename, (double)timestamp / AV_TIME_BASE);
         }
+        /* the seek lands on the preceding keyframe, decode from there
+           and drop everything before the requested position */
+        if (run_opts.accurate_seek)
+            input_files_trim_pts[nb_input_files] = run_opts.input_ts_offset + (run_opts.copy_ts ? timestamp : 0);
         /* reset seek info */
-        start_time = 0;
+        run_opts.start_time = 0;
     }
 
     /* update the current parameters so that they match the one of the input stream */
     for(i=0;i<ic->nb_streams;i++) {
         AVCodecContext *enc = ic->streams[i]->codec;
-        if(thread_count>1)
-            avcodec_thread_init(enc, thread_count);
-        enc->thread_count= thread_count;
+        if(run_opts.thread_count>1)
+            avcodec_thread_init(enc, run_opts.thread_count);
+        enc->thread_count= run_opts.thread_count;
         switch(enc->codec_type) {
         case CODEC_TYPE_AUDIO:
             set_context_opts(enc, avcodec_opts[CODEC_TYPE_AUDIO], AV_OPT_FLAG_AUDIO_PARAM | AV_OPT_FLAG_DECODING_PARAM);
             //fprintf(stderr, "\nInput Audio channels: %d", enc->channels);
-            channel_layout = enc->channel_layout;
-            audio_channels = enc->channels;
-            audio_sample_rate = enc->sample_rate;
-            audio_sample_fmt = enc->sample_fmt;
-            input_codecs[nb_icodecs++] = avcodec_find_decoder_by_name(audio_codec_name);
-            if(audio_disable)
+            run_opts.channel_layout = enc->channel_layout;
+            run_opts.audio_channels = enc->channels;
+            run_opts.audio_sample_rate = enc->sample_rate;
+            run_opts.audio_sample_fmt = enc->sample_fmt;
+            input_codecs[nb_icodecs++] = avcodec_find_decoder_by_name(run_opts.audio_codec_name);
+            if(run_opts.audio_disable)
                 ic->streams[i]->discard= AVDISCARD_ALL;
             break;
         case CODEC_TYPE_VIDEO:
             set_context_opts(enc, avcodec_opts[CODEC_TYPE_VIDEO], AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_DECODING_PARAM);
-            frame_height = enc->height;
-            frame_width = enc->width;
+            run_opts.frame_height = enc->height;
+            run_opts.frame_width = enc->width;
             if(ic->streams[i]->sample_aspect_ratio.num)
-                frame_aspect_ratio=av_q2d(ic->streams[i]->sample_aspect_ratio);
+                run_opts.frame_aspect_ratio=av_q2d(ic->streams[i]->sample_aspect_ratio);
             else
-                frame_aspect_ratio=av_q2d(enc->sample_aspect_ratio);
-            frame_aspect_ratio *= (float) enc->width / enc->height;
-            frame_pix_fmt = enc->pix_fmt;
+                run_opts.frame_aspect_ratio=av_q2d(enc->sample_aspect_ratio);
+            run_opts.frame_aspect_ratio *= (float) enc->width / enc->height;
+            run_opts.frame_pix_fmt = enc->pix_fmt;
             rfps      = ic->streams[i]->r_frame_rate.num;
             rfps_base = ic->streams[i]->r_frame_rate.den;
             if(enc->lowres) enc->flags |= CODEC_FLAG_EMU_EDGE;
-            if(me_threshold)
+            if(run_opts.me_threshold)
                 enc->debug |= FF_DEBUG_MV;
 
             if (enc->time_base.den != rfps || enc->time_base.num != rfps_base) {
 
-                if (verbose >= 0)
+                if (run_opts.verbose >= 0)
                     fprintf(stderr,"\nSeems stream %d codec frame rate differs from container frame rate: %2.2f (%d/%d) -> %2.2f (%d/%d)\n",
                             i, (float)enc->time_base.den / enc->time_base.num, enc->time_base.den, enc->time_base.num,
 
                     (float)rfps / rfps_base, rfps, rfps_base);
             }
             /* update the current frame rate to match the stream frame rate */
-            frame_rate.num = rfps;
-            frame_rate.den = rfps_base;
+            run_opts.frame_rate.num = rfps;
+            run_opts.frame_rate.den = rfps_base;
 
-            input_codecs[nb_icodecs++] = avcodec_find_decoder_by_name(video_codec_name);
-            if(video_disable)
+            input_codecs[nb_icodecs++] = avcodec_find_decoder_by_name(run_opts.video_codec_name);
+            if(run_opts.video_disable)
                 ic->streams[i]->discard= AVDISCARD_ALL;
-            else if(video_discard)
-                ic->streams[i]->discard= video_discard;
+            else if(run_opts.video_discard)
+                ic->streams[i]->discard= run_opts.video_discard;
             break;
         case CODEC_TYPE_DATA:
             break;
         case CODEC_TYPE_SUBTITLE:
-            input_codecs[nb_icodecs++] = avcodec_find_decoder_by_name(subtitle_codec_name);
-            if(subtitle_disable)
+            input_codecs[nb_icodecs++] = avcodec_find_decoder_by_name(run_opts.subtitle_codec_name);
+            if(run_opts.subtitle_disable)
                 ic->streams[i]->discard = AVDISCARD_ALL;
             break;
         case CODEC_TYPE_ATTACHMENT:
@@ -2975,18 +3683,18 @@ static void opt_input_file(const char *filename)
     }
 
     input_files[nb_input_files] = ic;
-    input_files_ts_offset[nb_input_files] = input_ts_offset - (copy_ts ? 0 : timestamp);
+    input_files_ts_offset[nb_input_files] = run_opts.input_ts_offset - (run_opts.copy_ts ? 0 : timestamp);
     /* dump the file content */
-    if (verbose >= 0)
+    if (run_opts.verbose >= 0)
         dump_format(ic, nb_input_files, filename, 0);
 
     nb_input_files++;
 
-    video_channel = 0;
+    run_opts.video_channel = 0;
 
-    av_freep(&video_codec_name);
-    av_freep(&audio_codec_name);
-    av_freep(&subtitle_codec_name);
+    av_freep(&run_opts.video_codec_name);
+    av_freep(&run_opts.audio_codec_name);
+    av_freep(&run_opts.subtitle_codec_name);
 }
 
 static void check_audio_video_sub_inputs(int *has_video_ptr, int *has_audio_ptr,
@@ -3038,41 +3746,41 @@ static void new_video_stream(AVFormatContext *oc)
         av_exit(1);
     }
     avcodec_get_context_defaults2(st->codec, CODEC_TYPE_VIDEO);
-    bitstream_filters[nb_output_files][oc->nb_streams - 1]= video_bitstream_filters;
-    video_bitstream_filters= NULL;
+    bitstream_filters[nb_output_files][oc->nb_streams - 1]= run_opts.video_bitstream_filters;
+    run_opts.video_bitstream_filters= NULL;
 
-    if(thread_count>1)
-        avcodec_thread_init(st->codec, thread_count);
+    if(run_opts.thread_count>1)
+        avcodec_thread_init(st->codec, run_opts.thread_count);
 
     video_enc = st->codec;
 
-    if(video_codec_tag)
-        video_enc->codec_tag= video_codec_tag;
+    if(run_opts.video_codec_tag)
+        video_enc->codec_tag= run_opts.video_codec_tag;
 
-    if(   (video_global_header&1)
-       || (video_global_header==0 && (oc->oformat->flags & AVFMT_GLOBALHEADER))){
+    if(   (run_opts.video_global_header&1)
+       || (run_opts.video_global_header==0 && (oc->oformat->flags & AVFMT_GLOBALHEADER))){
         video_enc->flags |= CODEC_FLAG_GLOBAL_HEADER;
         avcodec_opts[CODEC_TYPE_VIDEO]->flags|= CODEC_FLAG_GLOBAL_HEADER;
     }
-    if(video_global_header&2){
+    if(run_opts.video_global_header&2){
         video_enc->flags2 |= CODEC_FLAG2_LOCAL_HEADER;
         avcodec_opts[CODEC_TYPE_VIDEO]->flags2|= CODEC_FLAG2_LOCAL_HEADER;
     }
 
-    if (video_stream_copy) {
+    if (run_opts.video_stream_copy) {
         st->stream_copy = 1;
         video_enc->codec_type = CODEC_TYPE_VIDEO;
         video_enc->sample_aspect_ratio =
-        st->sample_aspect_ratio = av_d2q(frame_aspect_ratio*frame_height/frame_width, 255);
+        st->sample_aspect_ratio = av_d2q(run_opts.frame_aspect_ratio*run_opts.frame_height/run_opts.frame_width, 255);
     } else {
         const char *p;
         int i;
         AVCodec *codec;
-        AVRational fps= frame_rate.num ? frame_rate : (AVRational){25,1};
+        AVRational fps= run_opts.frame_rate.num ? run_opts.frame_rate : (AVRational){25,1};
 
-        if (video_codec_name) {
-            codec_id = find_codec_or_die(video_codec_name, CODEC_TYPE_VIDEO, 1);
-            codec = avcodec_find_encoder_by_name(video_codec_name);
+        if (run_opts.video_codec_name) {
+            codec_id = find_codec_or_die(run_opts.video_codec_name, CODEC_TYPE_VIDEO, 1);
+            codec = avcodec_find_encoder_by_name(run_opts.video_codec_name);
             output_codecs[nb_ocodecs] = codec;
         } else {
             codec_id = av_guess_codec(oc->oformat, NULL, oc->filename, NULL, CODEC_TYPE_VIDEO);
@@ -3083,15 +3791,15 @@ static void new_video_stream(AVFormatContext *oc)
 
         set_context_opts(video_enc, avcodec_opts[CODEC_TYPE_VIDEO], AV_OPT_FLAG_VIDEO_PARAM | AV_OPT_FLAG_ENCODING_PARAM);
 
-        if (codec && codec->supported_framerates && !force_fps)
+        if (codec && codec->supported_framerates && !run_opts.force_fps)
             fps = codec->supported_framerates[av_find_nearest_q_idx(fps, codec->supported_framerates)];
         video_enc->time_base.den = fps.num;
         video_enc->time_base.num = fps.den;
 
-        video_enc->width = frame_width + frame_padright + frame_padleft;
-        video_enc->height = frame_height + frame_padtop + frame_padbottom;
-        video_enc->sample_aspect_ratio = av_d2q(frame_aspect_ratio*video_enc->height/video_enc->width, 255);
-        video_enc->pix_fmt = frame_pix_fmt;
+        video_enc->width = run_opts.frame_width + run_opts.frame_padright + run_opts.frame_padleft;
+        video_enc->height = run_opts.frame_height + run_opts.frame_padtop + run_opts.frame_padbottom;
+        video_enc->sample_aspect_ratio = av_d2q(run_opts.frame_aspect_ratio*video_enc->height/video_enc->width, 255);
+        video_enc->pix_fmt = run_opts.frame_pix_fmt;
         st->sample_aspect_ratio = video_enc->sample_aspect_ratio;
 
         if(codec && codec->pix_fmts){
@@ -3104,21 +3812,21 @@ static void new_video_stream(AVFormatContext *oc)
                 video_enc->pix_fmt = codec->pix_fmts[0];
         }
 
-        if (intra_only)
+        if (run_opts.intra_only)
             video_enc->gop_size = 0;
-        if (video_qscale || same_quality) {
+        if (run_opts.video_qscale || run_opts.same_quality) {
             video_enc->flags |= CODEC_FLAG_QSCALE;
             video_enc->global_quality=
-                st->quality = FF_QP2LAMBDA * video_qscale;
+                st->quality = FF_QP2LAMBDA * run_opts.video_qscale;
         }
 
-        if(intra_matrix)
-            video_enc->intra_matrix = intra_matrix;
-        if(inter_matrix)
-            video_enc->inter_matrix = inter_matrix;
+        if(run_opts.intra_matrix)
+            video_enc->intra_matrix = run_opts.intra_matrix;
+        if(run_opts.inter_matrix)
+            video_enc->inter_matrix = run_opts.inter_matrix;
 
-        video_enc->thread_count = thread_count;
-        p= video_rc_override_string;
+        video_enc->thread_count = run_opts.thread_count;
+        p= run_opts.video_rc_override_string;
         for(i=0; p; i++){
             int start, end, q;
             int e=sscanf(p, "%d,%d,%d", &start, &end, &q);
@@ -3145,15 +3853,15 @@ static void new_video_stream(AVFormatContext *oc)
         video_enc->rc_override_count=i;
         if (!video_enc->rc_initial_buffer_occupancy)
             video_enc->rc_initial_buffer_occupancy = video_enc->rc_buffer_size*3/4;
-        video_enc->me_threshold= me_threshold;
-        video_enc->intra_dc_precision= intra_dc_precision - 8;
+        video_enc->me_threshold= run_opts.me_threshold;
+        video_enc->intra_dc_precision= run_opts.intra_dc_precision - 8;
 
-        if (do_psnr)
+        if (run_opts.do_psnr)
             video_enc->flags|= CODEC_FLAG_PSNR;
 
         /* two pass mode */
-        if (do_pass) {
-            if (do_pass == 1) {
+        if (run_opts.do_pass) {
+            if (run_opts.do_pass == 1) {
                 video_enc->flags |= CODEC_FLAG_PASS1;
             } else {
                 video_enc->flags |= CODEC_FLAG_PASS2;
@@ -3163,9 +3871,9 @@ static void new_video_stream(AVFormatContext *oc)
     nb_ocodecs++;
 
     /* reset some key parameters */
-    video_disable = 0;
-    av_freep(&video_codec_name);
-    video_stream_copy = 0;
+    run_opts.video_disable = 0;
+    av_freep(&run_opts.video_codec_name);
+    run_opts.video_stream_copy = 0;
 }
 
 static void new_audio_stream(AVFormatContext *oc)
@@ -3181,33 +3889,33 @@ static void new_audio_stream(AVFormatContext *oc)
     }
     avcodec_get_context_defaults2(st->codec, CODEC_TYPE_AUDIO);
 
-    bitstream_filters[nb_output_files][oc->nb_streams - 1]= audio_bitstream_filters;
-    audio_bitstream_filters= NULL;
+    bitstream_filters[nb_output_files][oc->nb_streams - 1]= run_opts.audio_bitstream_filters;
+    run_opts.audio_bitstream_filters= NULL;
 
-    if(thread_count>1)
-        avcodec_thread_init(st->codec, thread_count);
+    if(run_opts.thread_count>1)
+        avcodec_thread_init(st->codec, run_opts.thread_count);
 
     audio_enc = st->codec;
     audio_enc->codec_type = CODEC_TYPE_AUDIO;
 
-    if(audio_codec_tag)
-        audio_enc->codec_tag= audio_codec_tag;
+    if(run_opts.audio_codec_tag)
+        audio_enc->codec_tag= run_opts.audio_codec_tag;
 
     if (oc->oformat->flags & AVFMT_GLOBALHEADER) {
         audio_enc->flags |= CODEC_FLAG_GLOBAL_HEADER;
         avcodec_opts[CODEC_TYPE_AUDIO]->flags|= CODEC_FLAG_GLOBAL_HEADER;
     }
-    if (audio_stream_copy) {
+    if (run_opts.audio_stream_copy) {
         st->stream_copy = 1;
-        audio_enc->channels = audio_channels;
+        audio_enc->channels = run_opts.audio_channels;
     } else {
         AVCodec *codec;
 
         set_context_opts(audio_enc, avcodec_opts[CODEC_TYPE_AUDIO], AV_OPT_FLAG_AUDIO_PARAM | AV_OPT_FLAG_ENCODING_PARAM);
 
-        if (audio_codec_name) {
-            codec_id = find_codec_or_die(audio_codec_name, CODEC_TYPE_AUDIO, 1);
-            codec = avcodec_find_encoder_by_name(audio_codec_name);
+        if (run_opts.audio_codec_name) {
+            codec_id = find_codec_or_die(run_opts.audio_codec_name, CODEC_TYPE_AUDIO, 1);
+            codec = avcodec_find_encoder_by_name(run_opts.audio_codec_name);
             output_codecs[nb_ocodecs] = codec;
         } else {
             codec_id = av_guess_codec(oc->oformat, NULL, oc->filename, NULL, CODEC_TYPE_AUDIO);
@@ -3215,15 +3923,15 @@ static void new_audio_stream(AVFormatContext *oc)
         }
         audio_enc->codec_id = codec_id;
 
-        if (audio_qscale > QSCALE_NONE) {
+        if (run_opts.audio_qscale > QSCALE_NONE) {
             audio_enc->flags |= CODEC_FLAG_QSCALE;
-            audio_enc->global_quality = st->quality = FF_QP2LAMBDA * audio_qscale;
+            audio_enc->global_quality = st->quality = FF_QP2LAMBDA * run_opts.audio_qscale;
         }
-        audio_enc->thread_count = thread_count;
-        audio_enc->channels = audio_channels;
-        audio_enc->sample_fmt = audio_sample_fmt;
-        audio_enc->channel_layout = channel_layout;
-        if (avcodec_channel_layout_num_channels(channel_layout) != audio_channels)
+        audio_enc->thread_count = run_opts.thread_count;
+        audio_enc->channels = run_opts.audio_channels;
+        audio_enc->sample_fmt = run_opts.audio_sample_fmt;
+        audio_enc->channel_layout = run_opts.channel_layout;
+        if (avcodec_channel_layout_num_channels(run_opts.channel_layout) != run_opts.audio_channels)
             audio_enc->channel_layout = 0;
 
         if(codec && codec->sample_fmts){
@@ -3237,18 +3945,18 @@ static void new_audio_stream(AVFormatContext *oc)
         }
     }
     nb_ocodecs++;
-    audio_enc->sample_rate = audio_sample_rate;
-    audio_enc->time_base= (AVRational){1, audio_sample_rate};
-    if (audio_language) {
-        av_metadata_set(&st->metadata, "language", audio_language);
-        av_free(audio_language);
-        audio_language = NULL;
+    audio_enc->sample_rate = run_opts.audio_sample_rate;
+    audio_enc->time_base= (AVRational){1, run_opts.audio_sample_rate};
+    if (run_opts.audio_language) {
+        av_metadata_set(&st->metadata, "language", run_opts.audio_language);
+        av_free(run_opts.audio_language);
+        run_opts.audio_language = NULL;
     }
 
     /* reset some key parameters */
-    audio_disable = 0;
-    av_freep(&audio_codec_name);
-    audio_stream_copy = 0;
+    run_opts.audio_disable = 0;
+    av_freep(&run_opts.audio_codec_name);
+    run_opts.audio_stream_copy = 0;
 }
 
 static void new_subtitle_stream(AVFormatContext *oc)
@@ -3263,33 +3971,33 @@ static void new_subtitle_stream(AVFormatContext *oc)
     }
     avcodec_get_context_defaults2(st->codec, CODEC_TYPE_SUBTITLE);
 
-    bitstream_filters[nb_output_files][oc->nb_streams - 1]= subtitle_bitstream_filters;
-    subtitle_bitstream_filters= NULL;
+    bitstream_filters[nb_output_files][oc->nb_streams - 1]= run_opts.subtitle_bitstream_filters;
+    run_opts.subtitle_bitstream_filters= NULL;
 
     subtitle_enc = st->codec;
     subtitle_enc->codec_type = CODEC_TYPE_SUBTITLE;
 
-    if(subtitle_codec_tag)
-        subtitle_enc->codec_tag= subtitle_codec_tag;
+    if(run_opts.subtitle_codec_tag)
+        subtitle_enc->codec_tag= run_opts.subtitle_codec_tag;
 
-    if (subtitle_stream_copy) {
+    if (run_opts.subtitle_stream_copy) {
         st->stream_copy = 1;
     } else {
         set_context_opts(avcodec_opts[CODEC_TYPE_SUBTITLE], subtitle_enc, AV_OPT_FLAG_SUBTITLE_PARAM | AV_OPT_FLAG_ENCODING_PARAM);
-        subtitle_enc->codec_id = find_codec_or_die(subtitle_codec_name, CODEC_TYPE_SUBTITLE, 1);
-        output_codecs[nb_ocodecs] = avcodec_find_encoder_by_name(subtitle_codec_name);
+        subtitle_enc->codec_id = find_codec_or_die(run_opts.subtitle_codec_name, CODEC_TYPE_SUBTITLE, 1);
+        output_codecs[nb_ocodecs] = avcodec_find_encoder_by_name(run_opts.subtitle_codec_name);
     }
     nb_ocodecs++;
 
-    if (subtitle_language) {
-        av_metadata_set(&st->metadata, "language", subtitle_language);
-        av_free(subtitle_language);
-        subtitle_language = NULL;
+    if (run_opts.subtitle_language) {
+        av_metadata_set(&st->metadata, "language", run_opts.subtitle_language);
+        av_free(run_opts.subtitle_language);
+        run_opts.subtitle_language = NULL;
     }
 
-    subtitle_disable = 0;
-    av_freep(&subtitle_codec_name);
-    subtitle_stream_copy = 0;
+    run_opts.subtitle_disable = 0;
+    av_freep(&run_opts.subtitle_codec_name);
+    run_opts.subtitle_stream_copy = 0;
 }
 
 static void opt_new_audio_stream(void)
@@ -3342,13 +4050,13 @@ static void opt_output_file(const char *filename)
         av_exit(1);
     }
 
-    if (last_asked_format) {
-        file_oformat = guess_format(last_asked_format, NULL, NULL);
+    if (run_opts.last_asked_format) {
+        file_oformat = guess_format(run_opts.last_asked_format, NULL, NULL);
         if (!file_oformat) {
-            fprintf(stderr, "Requested output format '%s' is not a suitable output format\n", last_asked_format);
+            fprintf(stderr, "Requested output format '%s' is not a suitable output format\n", run_opts.last_asked_format);
             av_exit(1);
         }
-        last_asked_format = NULL;
+        run_opts.last_asked_format = NULL;
     } else {
         file_oformat = guess_format(NULL, filename, NULL);
         if (!file_oformat) {
@@ -3371,9 +4079,9 @@ static void opt_output_file(const char *filename)
             av_exit(1);
         }
     } else {
-        use_video = file_oformat->video_codec != CODEC_ID_NONE || video_stream_copy || video_codec_name;
-        use_audio = file_oformat->audio_codec != CODEC_ID_NONE || audio_stream_copy || audio_codec_name;
-        use_subtitle = file_oformat->subtitle_codec != CODEC_ID_NONE || subtitle_stream_copy || subtitle_codec_name;
+        use_video = file_oformat->video_codec != CODEC_ID_NONE || run_opts.video_stream_copy || run_opts.video_codec_name;
+        use_audio = file_oformat->audio_codec != CODEC_ID_NONE || run_opts.audio_stream_copy || run_opts.audio_codec_name;
+        use_subtitle = file_oformat->subtitle_codec != CODEC_ID_NONE || run_opts.subtitle_stream_copy || run_opts.subtitle_codec_name;
 
         /* disable if no corresponding type found and at least one
            input file */
@@ -3389,13 +4097,13 @@ static void opt_output_file(const char *filename)
         }
 
         /* manual disable */
-        if (audio_disable) {
+        if (run_opts.audio_disable) {
             use_audio = 0;
         }
-        if (video_disable) {
+        if (run_opts.video_disable) {
             use_video = 0;
         }
-        if (subtitle_disable) {
+        if (run_opts.subtitle_disable) {
             use_subtitle = 0;
         }
 
@@ -3411,11 +4119,13 @@ static void opt_output_file(const char *filename)
             new_subtitle_stream(oc);
         }
 
-        oc->timestamp = rec_timestamp;
+        oc->timestamp = run_opts.rec_timestamp;
 
-        for(; metadata_count>0; metadata_count--){
-            av_metadata_set(&oc->metadata, metadata[metadata_count-1].key,
-                                           metadata[metadata_count-1].value);
+        for(; run_opts.metadata_count>0; run_opts.metadata_count--){
+            av_metadata_set(&oc->metadata, run_opts.metadata[run_opts.metadata_count-1].key,
+                                           run_opts.metadata[run_opts.metadata_count-1].value);
+            av_freep(&run_opts.metadata[run_opts.metadata_count-1].key);
+            av_freep(&run_opts.metadata[run_opts.metadata_count-1].value);
         }
         av_metadata_conv(oc, oc->oformat->metadata_conv, NULL);
     }
@@ -3432,7 +4142,7 @@ static void opt_output_file(const char *filename)
 
     if (!(oc->oformat->flags & AVFMT_NOFILE)) {
         /* test if it already exists to avoid loosing precious files */
-        if (!file_overwrite &&
+        if (!run_opts.file_overwrite &&
             (strchr(filename, ':') == NULL ||
              filename[1] == ':' ||
              av_strstart(filename, "file:", NULL))) {
@@ -3466,9 +4176,9 @@ static void opt_output_file(const char *filename)
         av_exit(1);
     }
 
-    oc->preload= (int)(mux_preload*AV_TIME_BASE);
-    oc->max_delay= (int)(mux_max_delay*AV_TIME_BASE);
-    oc->loop_output = loop_output;
+    oc->preload= (int)(run_opts.mux_preload*AV_TIME_BASE);
+    oc->max_delay= (int)(run_opts.mux_max_delay*AV_TIME_BASE);
+    oc->loop_output = run_opts.loop_output;
     oc->flags |= AVFMT_FLAG_NONBLOCK;
 
     set_context_opts(oc, avformat_opts, AV_OPT_FLAG_ENCODING_PARAM);
@@ -3483,7 +4193,7 @@ static void opt_pass(const char *pass_str)
         fprintf(stderr, "pass number can be only 1 or 2\n");
         av_exit(1);
     }
-    do_pass = pass;
+    run_opts.do_pass = pass;
 }
 
 static int64_t getutime(void)
@@ -3523,14 +4233,14 @@ static void parse_matrix_coeffs(uint16_t *dest, const char *str)
 
 static void opt_inter_matrix(const char *arg)
 {
-    inter_matrix = av_mallocz(sizeof(uint16_t) * 64);
-    parse_matrix_coeffs(inter_matrix, arg);
+    run_opts.inter_matrix = av_mallocz(sizeof(uint16_t) * 64);
+    parse_matrix_coeffs(run_opts.inter_matrix, arg);
 }
 
 static void opt_intra_matrix(const char *arg)
 {
-    intra_matrix = av_mallocz(sizeof(uint16_t) * 64);
-    parse_matrix_coeffs(intra_matrix, arg);
+    run_opts.intra_matrix = av_mallocz(sizeof(uint16_t) * 64);
+    parse_matrix_coeffs(run_opts.intra_matrix, arg);
 }
 
 /**
@@ -3596,7 +4306,7 @@ static void opt_target(const char *arg)
     } else {
         int fr;
         /* Calculate FR via float to avoid int overflow */
-        fr = (int)(frame_rate.num * 1000.0 / frame_rate.den);
+        fr = (int)(run_opts.frame_rate.num * 1000.0 / run_opts.frame_rate.den);
         if(fr == 25000) {
             norm = 0;
         } else if((fr == 29970) || (fr == 23976)) {
@@ -3624,7 +4334,7 @@ static void opt_target(const char *arg)
                 }
             }
         }
-        if(verbose && norm >= 0)
+        if(run_opts.verbose && norm >= 0)
             fprintf(stderr, "Assuming %s for target.\n", norm ? "NTSC" : "PAL");
     }
 
@@ -3651,8 +4361,8 @@ static void opt_target(const char *arg)
         opt_default("bufsize", "327680"); // 40*1024*8;
 
         opt_default("ab", "224000");
-        audio_sample_rate = 44100;
-        audio_channels = 2;
+        run_opts.audio_sample_rate = 44100;
+        run_opts.audio_channels = 2;
 
         opt_default("packetsize", "2324");
         opt_default("muxrate", "1411200"); // 2352 * 75 * 8;
@@ -3662,7 +4372,7 @@ static void opt_target(const char *arg)
            and the first pack from the other stream, respectively, may also have
            been written before.
            So the real data starts at SCR 36000+3*1200. */
-        mux_preload= (36000+3*1200) / 90000.0; //0.44
+        run_opts.mux_preload= (36000+3*1200) / 90000.0; //0.44
     } else if(!strcmp(arg, "svcd")) {
 
         opt_video_codec("mpeg2video");
@@ -3681,7 +4391,7 @@ static void opt_target(const char *arg)
 
 
         opt_default("ab", "224000");
-        audio_sample_rate = 44100;
+        run_opts.audio_sample_rate = 44100;
 
         opt_default("packetsize", "2324");
 
@@ -3704,7 +4414,7 @@ static void opt_target(const char *arg)
         opt_default("muxrate", "10080000"); // from mplex project: data_rate = 1260000. mux_rate = data_rate * 8
 
         opt_default("ab", "448000");
-        audio_sample_rate = 48000;
+        run_opts.audio_sample_rate = 48000;
 
     } else if(!strncmp(arg, "dv", 2)) {
 
@@ -3715,8 +4425,8 @@ static void opt_target(const char *arg)
                                              (norm ? "yuv411p" : "yuv420p"));
         opt_frame_rate(NULL, frame_rates[norm]);
 
-        audio_sample_rate = 48000;
-        audio_channels = 2;
+        run_opts.audio_sample_rate = 48000;
+        run_opts.audio_channels = 2;
 
     } else {
         fprintf(stderr, "Unknown target: %s\n", arg);
@@ -3726,8 +4436,8 @@ static void opt_target(const char *arg)
 
 static void opt_vstats_file (const char *arg)
 {
-    av_free (vstats_filename);
-    vstats_filename=av_strdup (arg);
+    av_free (run_opts.vstats_filename);
+    run_opts.vstats_filename=av_strdup (arg);
 }
 
 static void opt_vstats (void)
@@ -3751,9 +4461,9 @@ static int opt_bsf(const char *opt, const char *arg)
         av_exit(1);
     }
 
-    bsfp= *opt == 'v' ? &video_bitstream_filters :
-          *opt == 'a' ? &audio_bitstream_filters :
-                        &subtitle_bitstream_filters;
+    bsfp= *opt == 'v' ? &run_opts.video_bitstream_filters :
+          *opt == 'a' ? &run_opts.audio_bitstream_filters :
+                        &run_opts.subtitle_bitstream_filters;
     while(*bsfp)
         bsfp= &(*bsfp)->next;
 
@@ -3776,9 +4486,9 @@ static int opt_preset(const char *opt, const char *arg)
             snprintf(filename, sizeof(filename), "%s%s/%s.ffpreset", base[i], i ? "" : "/.ffmpeg", arg);
             f= fopen(filename, "r");
             if(!f){
-                char *codec_name= *opt == 'v' ? video_codec_name :
-                                  *opt == 'a' ? audio_codec_name :
-                                                subtitle_codec_name;
+                char *codec_name= *opt == 'v' ? run_opts.video_codec_name :
+                                  *opt == 'a' ? run_opts.audio_codec_name :
+                                                run_opts.subtitle_codec_name;
                 snprintf(filename, sizeof(filename), "%s%s/%s-%s.ffpreset", base[i],  i ? "" : "/.ffmpeg", codec_name, arg);
                 f= fopen(filename, "r");
             }
@@ -3824,44 +4534,46 @@ static const OptionDef options[] = {
 #include "cmdutils_common_opts.h"
     { "f", HAS_ARG, {(void*)opt_format}, "force format", "fmt" },
     { "i", HAS_ARG, {(void*)opt_input_file}, "input file name", "filename" },
-    { "y", OPT_BOOL, {(void*)&file_overwrite}, "overwrite output files" },
+    { "y", OPT_BOOL, {(void*)&run_opts.file_overwrite}, "overwrite output files" },
     { "map", HAS_ARG | OPT_EXPERT, {(void*)opt_map}, "set input stream mapping", "file:stream[:syncfile:syncstream]" },
     { "map_meta_data", HAS_ARG | OPT_EXPERT, {(void*)opt_map_meta_data}, "set meta data information of outfile from infile", "outfile:infile" },
     { "t", OPT_FUNC2 | HAS_ARG, {(void*)opt_recording_time}, "record or transcode \"duration\" seconds of audio/video", "duration" },
-    { "fs", HAS_ARG | OPT_INT64, {(void*)&limit_filesize}, "set the limit file size in bytes", "limit_size" }, //
+    { "fs", HAS_ARG | OPT_INT64, {(void*)&run_opts.limit_filesize}, "set the limit file size in bytes", "limit_size" }, //
     { "ss", OPT_FUNC2 | HAS_ARG, {(void*)opt_start_time}, "set the start time offset", "time_off" },
     { "itsoffset", OPT_FUNC2 | HAS_ARG, {(void*)opt_input_ts_offset}, "set the input ts offset", "time_off" },
+    { "accurate_seek", OPT_BOOL | OPT_EXPERT, {(void*)&run_opts.accurate_seek}, "decode from the keyframe before an input -ss position and drop everything before it" },
     { "itsscale", HAS_ARG, {(void*)opt_input_ts_scale}, "set the input ts scale", "stream:scale" },
     { "timestamp", OPT_FUNC2 | HAS_ARG, {(void*)opt_rec_timestamp}, "set the timestamp ('now' to set the current time)", "time" },
     { "metadata", OPT_FUNC2 | HAS_ARG, {(void*)opt_metadata}, "add metadata", "string=string" },
-    { "dframes", OPT_INT | HAS_ARG, {(void*)&max_frames[CODEC_TYPE_DATA]}, "set the number of data frames to record", "number" },
-    { "benchmark", OPT_BOOL | OPT_EXPERT, {(void*)&do_benchmark},
+    { "dframes", OPT_INT | HAS_ARG, {(void*)&run_opts.max_frames[CODEC_TYPE_DATA]}, "set the number of data frames to record", "number" },
+    { "benchmark", OPT_BOOL | OPT_EXPERT, {(void*)&run_opts.do_benchmark},
       "add timings for benchmarking" },
-    { "dump", OPT_BOOL | OPT_EXPERT, {(void*)&do_pkt_dump},
+    { "dump", OPT_BOOL | OPT_EXPERT, {(void*)&run_opts.do_pkt_dump},
       "dump each input packet" },
-    { "hex", OPT_BOOL | OPT_EXPERT, {(void*)&do_hex_dump},
+    { "hex", OPT_BOOL | OPT_EXPERT, {(void*)&run_opts.do_hex_dump},
       "when dumping packets, also dump the payload" },
-    { "re", OPT_BOOL | OPT_EXPERT, {(void*)&rate_emu}, "read input at native frame rate", "" },
-    { "loop_input", OPT_BOOL | OPT_EXPERT, {(void*)&loop_input}, "loop (current only works with images)" },
-    { "loop_output", HAS_ARG | OPT_INT | OPT_EXPERT, {(void*)&loop_output}, "number of times to loop output in formats that support looping (0 loops forever)", "" },
+    { "re", OPT_BOOL | OPT_EXPERT, {(void*)&run_opts.rate_emu}, "read input at native frame rate", "" },
+    { "loop_input", OPT_BOOL | OPT_EXPERT, {(void*)&run_opts.loop_input}, "loop (current only works with images)" },
+    { "loop_output", HAS_ARG | OPT_INT | OPT_EXPERT, {(void*)&run_opts.loop_output}, "number of times to loop output in formats that support looping (0 loops forever)", "" },
     { "v", HAS_ARG | OPT_FUNC2, {(void*)opt_verbose}, "set ffmpeg verbosity level", "number" },
     { "target", HAS_ARG, {(void*)opt_target}, "specify target file type (\"vcd\", \"svcd\", \"dvd\", \"dv\", \"dv50\", \"pal-vcd\", \"ntsc-svcd\", ...)", "type" },
     { "threads", OPT_FUNC2 | HAS_ARG | OPT_EXPERT, {(void*)opt_thread_count}, "thread count", "count" },
-    { "vsync", HAS_ARG | OPT_INT | OPT_EXPERT, {(void*)&video_sync_method}, "video sync method", "" },
-    { "async", HAS_ARG | OPT_INT | OPT_EXPERT, {(void*)&audio_sync_method}, "audio sync method", "" },
-    { "adrift_threshold", HAS_ARG | OPT_FLOAT | OPT_EXPERT, {(void*)&audio_drift_threshold}, "audio drift threshold", "threshold" },
-    { "vglobal", HAS_ARG | OPT_INT | OPT_EXPERT, {(void*)&video_global_header}, "video global header storage type", "" },
-    { "copyts", OPT_BOOL | OPT_EXPERT, {(void*)&copy_ts}, "copy timestamps" },
-    { "shortest", OPT_BOOL | OPT_EXPERT, {(void*)&opt_shortest}, "finish encoding within shortest input" }, //
-    { "dts_delta_threshold", HAS_ARG | OPT_FLOAT | OPT_EXPERT, {(void*)&dts_delta_threshold}, "timestamp discontinuity delta threshold", "threshold" },
-    { "programid", HAS_ARG | OPT_INT | OPT_EXPERT, {(void*)&opt_programid}, "desired program number", "" },
-    { "xerror", OPT_BOOL, {(void*)&exit_on_error}, "exit on error", "error" },
-    { "copyinkf", OPT_BOOL | OPT_EXPERT, {(void*)&copy_initial_nonkeyframes}, "copy initial non-keyframes" },
+    { "batch", OPT_STRING | HAS_ARG | OPT_EXPERT, {(void*)&batch_filename}, "read jobs from file, one command line per line ('-' for stdin)", "filename" },
+    { "vsync", HAS_ARG | OPT_INT | OPT_EXPERT, {(void*)&run_opts.video_sync_method}, "video sync method", "" },
+    { "async", HAS_ARG | OPT_INT | OPT_EXPERT, {(void*)&run_opts.audio_sync_method}, "audio sync method", "" },
+    { "adrift_threshold", HAS_ARG | OPT_FLOAT | OPT_EXPERT, {(void*)&run_opts.audio_drift_threshold}, "audio drift threshold", "threshold" },
+    { "vglobal", HAS_ARG | OPT_INT | OPT_EXPERT, {(void*)&run_opts.video_global_header}, "video global header storage type", "" },
+    { "copyts", OPT_BOOL | OPT_EXPERT, {(void*)&run_opts.copy_ts}, "copy timestamps" },
+    { "shortest", OPT_BOOL | OPT_EXPERT, {(void*)&run_opts.opt_shortest}, "finish encoding within shortest input" }, //
+    { "dts_delta_threshold", HAS_ARG | OPT_FLOAT | OPT_EXPERT, {(void*)&run_opts.dts_delta_threshold}, "timestamp discontinuity delta threshold", "threshold" },
+    { "programid", HAS_ARG | OPT_INT | OPT_EXPERT, {(void*)&run_opts.opt_programid}, "desired program number", "" },
+    { "xerror", OPT_BOOL, {(void*)&run_opts.exit_on_error}, "exit on error", "error" },
+    { "copyinkf", OPT_BOOL | OPT_EXPERT, {(void*)&run_opts.copy_initial_nonkeyframes}, "copy initial non-keyframes" },
 
     /* video options */
     { "b", OPT_FUNC2 | HAS_ARG | OPT_VIDEO, {(void*)opt_bitrate}, "set bitrate (in bits/s)", "bitrate" },
     { "vb", OPT_FUNC2 | HAS_ARG | OPT_VIDEO, {(void*)opt_bitrate}, "set bitrate (in bits/s)", "bitrate" },
-    { "vframes", OPT_INT | HAS_ARG | OPT_VIDEO, {(void*)&max_frames[CODEC_TYPE_VIDEO]}, "set the number of video frames to record", "number" },
+    { "vframes", OPT_INT | HAS_ARG | OPT_VIDEO, {(void*)&run_opts.max_frames[CODEC_TYPE_VIDEO]}, "set the number of video frames to record", "number" },
     { "r", OPT_FUNC2 | HAS_ARG | OPT_VIDEO, {(void*)opt_frame_rate}, "set frame rate (Hz value, fraction or abbreviation)", "rate" },
     { "s", HAS_ARG | OPT_VIDEO, {(void*)opt_frame_size}, "set frame size (WxH or abbreviation)", "size" },
     { "aspect", HAS_ARG | OPT_VIDEO, {(void*)opt_frame_aspect_ratio}, "set aspect ratio (4:3, 16:9 or 1.3333, 1.7777)", "aspect" },
@@ -3875,60 +4587,61 @@ static const OptionDef options[] = {
     { "padleft", HAS_ARG | OPT_VIDEO, {(void*)opt_frame_pad_left}, "set left pad band size (in pixels)", "size" },
     { "padright", HAS_ARG | OPT_VIDEO, {(void*)opt_frame_pad_right}, "set right pad band size (in pixels)", "size" },
     { "padcolor", HAS_ARG | OPT_VIDEO, {(void*)opt_pad_color}, "set color of pad bands (Hex 000000 thru FFFFFF)", "color" },
-    { "intra", OPT_BOOL | OPT_EXPERT | OPT_VIDEO, {(void*)&intra_only}, "use only intra frames"},
-    { "vn", OPT_BOOL | OPT_VIDEO, {(void*)&video_disable}, "disable video" },
-    { "vdt", OPT_INT | HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)&video_discard}, "discard threshold", "n" },
+    { "intra", OPT_BOOL | OPT_EXPERT | OPT_VIDEO, {(void*)&run_opts.intra_only}, "use only intra frames"},
+    { "vn", OPT_BOOL | OPT_VIDEO, {(void*)&run_opts.video_disable}, "disable video" },
+    { "vdt", OPT_INT | HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)&run_opts.video_discard}, "discard threshold", "n" },
     { "qscale", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_qscale}, "use fixed video quantizer scale (VBR)", "q" },
     { "rc_override", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_video_rc_override_string}, "rate control override for specific intervals", "override" },
     { "vcodec", HAS_ARG | OPT_VIDEO, {(void*)opt_video_codec}, "force video codec ('copy' to copy stream)", "codec" },
     { "me_threshold", HAS_ARG | OPT_FUNC2 | OPT_EXPERT | OPT_VIDEO, {(void*)opt_me_threshold}, "motion estimaton threshold",  "threshold" },
-    { "sameq", OPT_BOOL | OPT_VIDEO, {(void*)&same_quality},
+    { "sameq", OPT_BOOL | OPT_VIDEO, {(void*)&run_opts.same_quality},
       "use same video quality as source (implies VBR)" },
     { "pass", HAS_ARG | OPT_VIDEO, {(void*)&opt_pass}, "select the pass number (1 or 2)", "n" },
-    { "passlogfile", HAS_ARG | OPT_STRING | OPT_VIDEO, {(void*)&pass_logfilename_prefix}, "select two pass log file name prefix", "prefix" },
-    { "deinterlace", OPT_BOOL | OPT_EXPERT | OPT_VIDEO, {(void*)&do_deinterlace},
+    { "passlogfile", HAS_ARG | OPT_STRING | OPT_VIDEO, {(void*)&run_opts.pass_logfilename_prefix}, "select two pass log file name prefix", "prefix" },
+    { "deinterlace", OPT_BOOL | OPT_EXPERT | OPT_VIDEO, {(void*)&run_opts.do_deinterlace},
       "deinterlace pictures" },
-    { "psnr", OPT_BOOL | OPT_EXPERT | OPT_VIDEO, {(void*)&do_psnr}, "calculate PSNR of compressed frames" },
+    { "psnr", OPT_BOOL | OPT_EXPERT | OPT_VIDEO, {(void*)&run_opts.do_psnr}, "calculate PSNR of compressed frames" },
+    { "ssim", OPT_BOOL | OPT_EXPERT | OPT_VIDEO, {(void*)&run_opts.do_ssim}, "calculate SSIM and PSNR of compressed frames by decoding them" },
     { "vstats", OPT_EXPERT | OPT_VIDEO, {(void*)&opt_vstats}, "dump video coding statistics to file" },
     { "vstats_file", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_vstats_file}, "dump video coding statistics to file", "file" },
     { "intra_matrix", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_intra_matrix}, "specify intra matrix coeffs", "matrix" },
     { "inter_matrix", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_inter_matrix}, "specify inter matrix coeffs", "matrix" },
     { "top", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_top_field_first}, "top=1/bottom=0/auto=-1 field first", "" },
-    { "dc", OPT_INT | HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)&intra_dc_precision}, "intra_dc_precision", "precision" },
+    { "dc", OPT_INT | HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)&run_opts.intra_dc_precision}, "intra_dc_precision", "precision" },
     { "vtag", HAS_ARG | OPT_EXPERT | OPT_VIDEO, {(void*)opt_video_tag}, "force video tag/fourcc", "fourcc/tag" },
     { "newvideo", OPT_VIDEO, {(void*)opt_new_video_stream}, "add a new video stream to the current output stream" },
-    { "qphist", OPT_BOOL | OPT_EXPERT | OPT_VIDEO, { (void *)&qp_hist }, "show QP histogram" },
-    { "force_fps", OPT_BOOL | OPT_EXPERT | OPT_VIDEO, {(void*)&force_fps}, "force the selected framerate, disable the best supported framerate selection" },
+    { "qphist", OPT_BOOL | OPT_EXPERT | OPT_VIDEO, { (void *)&run_opts.qp_hist }, "show QP histogram" },
+    { "force_fps", OPT_BOOL | OPT_EXPERT | OPT_VIDEO, {(void*)&run_opts.force_fps}, "force the selected framerate, disable the best supported framerate selection" },
 
     /* audio options */
     { "ab", OPT_FUNC2 | HAS_ARG | OPT_AUDIO, {(void*)opt_bitrate}, "set bitrate (in bits/s)", "bitrate" },
-    { "aframes", OPT_INT | HAS_ARG | OPT_AUDIO, {(void*)&max_frames[CODEC_TYPE_AUDIO]}, "set the number of audio frames to record", "number" },
-    { "aq", OPT_FLOAT | HAS_ARG | OPT_AUDIO, {(void*)&audio_qscale}, "set audio quality (codec-specific)", "quality", },
+    { "aframes", OPT_INT | HAS_ARG | OPT_AUDIO, {(void*)&run_opts.max_frames[CODEC_TYPE_AUDIO]}, "set the number of audio frames to record", "number" },
+    { "aq", OPT_FLOAT | HAS_ARG | OPT_AUDIO, {(void*)&run_opts.audio_qscale}, "set audio quality (codec-specific)", "quality", },
     { "ar", HAS_ARG | OPT_FUNC2 | OPT_AUDIO, {(void*)opt_audio_rate}, "set audio sampling rate (in Hz)", "rate" },
     { "ac", HAS_ARG | OPT_FUNC2 | OPT_AUDIO, {(void*)opt_audio_channels}, "set number of audio channels", "channels" },
-    { "an", OPT_BOOL | OPT_AUDIO, {(void*)&audio_disable}, "disable audio" },
+    { "an", OPT_BOOL | OPT_AUDIO, {(void*)&run_opts.audio_disable}, "disable audio" },
     { "acodec", HAS_ARG | OPT_AUDIO, {(void*)opt_audio_codec}, "force audio codec ('copy' to copy stream)", "codec" },
     { "atag", HAS_ARG | OPT_EXPERT | OPT_AUDIO, {(void*)opt_audio_tag}, "force audio tag/fourcc", "fourcc/tag" },
-    { "vol", OPT_INT | HAS_ARG | OPT_AUDIO, {(void*)&audio_volume}, "change audio volume (256=normal)" , "volume" }, //
+    { "vol", OPT_INT | HAS_ARG | OPT_AUDIO, {(void*)&run_opts.audio_volume}, "change audio volume (256=normal)" , "volume" }, //
     { "newaudio", OPT_AUDIO, {(void*)opt_new_audio_stream}, "add a new audio stream to the current output stream" },
-    { "alang", HAS_ARG | OPT_STRING | OPT_AUDIO, {(void *)&audio_language}, "set the ISO 639 language code (3 letters) of the current audio stream" , "code" },
+    { "alang", HAS_ARG | OPT_STRING | OPT_AUDIO, {(void *)&run_opts.audio_language}, "set the ISO 639 language code (3 letters) of the current audio stream" , "code" },
     { "sample_fmt", HAS_ARG | OPT_EXPERT | OPT_AUDIO, {(void*)opt_audio_sample_fmt}, "set sample format, 'list' as argument shows all the sample formats supported", "format" },
 
     /* subtitle options */
-    { "sn", OPT_BOOL | OPT_SUBTITLE, {(void*)&subtitle_disable}, "disable subtitle" },
+    { "sn", OPT_BOOL | OPT_SUBTITLE, {(void*)&run_opts.subtitle_disable}, "disable subtitle" },
     { "scodec", HAS_ARG | OPT_SUBTITLE, {(void*)opt_subtitle_codec}, "force subtitle codec ('copy' to copy stream)", "codec" },
     { "newsubtitle", OPT_SUBTITLE, {(void*)opt_new_subtitle_stream}, "add a new subtitle stream to the current output stream" },
-    { "slang", HAS_ARG | OPT_STRING | OPT_SUBTITLE, {(void *)&subtitle_language}, "set the ISO 639 language code (3 letters) of the current subtitle stream" , "code" },
+    { "slang", HAS_ARG | OPT_STRING | OPT_SUBTITLE, {(void *)&run_opts.subtitle_language}, "set the ISO 639 language code (3 letters) of the current subtitle stream" , "code" },
     { "stag", HAS_ARG | OPT_EXPERT | OPT_SUBTITLE, {(void*)opt_subtitle_tag}, "force subtitle tag/fourcc", "fourcc/tag" },
 
     /* grab options */
     { "vc", HAS_ARG | OPT_EXPERT | OPT_VIDEO | OPT_GRAB, {(void*)opt_video_channel}, "set video grab channel (DV1394 only)", "channel" },
     { "tvstd", HAS_ARG | OPT_EXPERT | OPT_VIDEO | OPT_GRAB, {(void*)opt_video_standard}, "set television standard (NTSC, PAL (SECAM))", "standard" },
-    { "isync", OPT_BOOL | OPT_EXPERT | OPT_GRAB, {(void*)&input_sync}, "sync read on input", "" },
+    { "isync", OPT_BOOL | OPT_EXPERT | OPT_GRAB, {(void*)&run_opts.input_sync}, "sync read on input", "" },
 
     /* muxer options */
-    { "muxdelay", OPT_FLOAT | HAS_ARG | OPT_EXPERT, {(void*)&mux_max_delay}, "set the maximum demux-decode delay", "seconds" },
-    { "muxpreload", OPT_FLOAT | HAS_ARG | OPT_EXPERT, {(void*)&mux_preload}, "set the initial demux-decode delay", "seconds" },
+    { "muxdelay", OPT_FLOAT | HAS_ARG | OPT_EXPERT, {(void*)&run_opts.mux_max_delay}, "set the maximum demux-decode delay", "seconds" },
+    { "muxpreload", OPT_FLOAT | HAS_ARG | OPT_EXPERT, {(void*)&run_opts.mux_preload}, "set the initial demux-decode delay", "seconds" },
 
     { "absf", OPT_FUNC2 | HAS_ARG | OPT_AUDIO | OPT_EXPERT, {(void*)opt_bsf}, "", "bitstream_filter" },
     { "vbsf", OPT_FUNC2 | HAS_ARG | OPT_VIDEO | OPT_EXPERT, {(void*)opt_bsf}, "", "bitstream_filter" },
@@ -3943,9 +4656,162 @@ static const OptionDef options[] = {
     { NULL, },
 };
 
-int main(int argc, char **argv)
+static void alloc_opts(void)
 {
     int i;
+
+    for(i=0; i<CODEC_TYPE_NB; i++){
+        avcodec_opts[i]= avcodec_alloc_context2(i);
+    }
+    avformat_opts = avformat_alloc_context();
+    sws_opts = sws_getContext(16,16,0, 16,16,0, run_opts.sws_flags, NULL,NULL,NULL);
+}
+
+static void free_bitstream_filters(AVBitStreamFilterContext **bsfc)
+{
+    while (*bsfc) {
+        AVBitStreamFilterContext *next = (*bsfc)->next;
+        av_bitstream_filter_close(*bsfc);
+        *bsfc = next;
+    }
+}
+
+/**
+ * Restore every option global to its default, so that the next job of
+ * a batch starts from the same state as a fresh process. Options which
+ * add a global must reset it here as well.
+ */
+static void reset_options(void)
+{
+    int i, j;
+
+    for(i=0;i<MAX_FILES;i++)
+        for(j=0;j<MAX_STREAMS;j++)
+            free_bitstream_filters(&bitstream_filters[i][j]);
+    free_bitstream_filters(&run_opts.video_bitstream_filters);
+    free_bitstream_filters(&run_opts.audio_bitstream_filters);
+    free_bitstream_filters(&run_opts.subtitle_bitstream_filters);
+
+    av_free(run_opts.intra_matrix);
+    av_free(run_opts.inter_matrix);
+    av_free(run_opts.video_codec_name);
+    av_free(run_opts.audio_codec_name);
+    av_free(run_opts.subtitle_codec_name);
+    av_free(run_opts.audio_language);
+    av_free(run_opts.subtitle_language);
+    av_free(run_opts.video_standard);
+    av_free(run_opts.pass_logfilename_prefix);
+    av_free(run_opts.vstats_filename);
+    for(i=0;i<run_opts.metadata_count;i++) {
+        av_free(run_opts.metadata[i].key);
+        av_free(run_opts.metadata[i].value);
+    }
+    av_free(run_opts.metadata);
+
+    run_opts = default_run_opts;
+
+    /* sws_opts is created with run_opts.sws_flags */
+    uninit_opts();
+    alloc_opts();
+
+    if (vstats_file)
+        fclose(vstats_file);
+    vstats_file = NULL;
+
+    nb_icodecs = nb_ocodecs = 0;
+    using_stdin = 0;
+    q_pressed = 0;
+    video_size = audio_size = extra_size = 0;
+    nb_frames_dup = nb_frames_drop = 0;
+}
+
+static int run_job(int argc, char **argv)
+{
+    int ret;
+
+    /* the option handlers exit through av_exit(), av_encode() returns
+       its errors so that it can clean up after itself */
+    if (setjmp(batch_job_env))
+        return -1;
+    in_batch_job = 1;
+    parse_options(argc, argv, options, opt_output_file);
+    in_batch_job = 0;
+
+    if (!nb_output_files || !nb_input_files) {
+        fprintf(stderr, "At least one input and one output file must be specified\n");
+        ret = -1;
+    } else
+        ret = av_encode(output_files, nb_output_files, input_files, nb_input_files,
+                        run_opts.stream_maps, run_opts.nb_stream_maps);
+
+    return ret;
+}
+
+/**
+ * Run the jobs read from batch_filename, one command line per line.
+ * The options given on the real command line are applied before the
+ * options of each job. Registration, static tables and the audio and
+ * sample buffers are set up once and reused by all the jobs. An error
+ * that would make ffmpeg exit only aborts the current job, except for
+ * invalid option syntax, which cmdutils still treats as fatal.
+ */
+static int run_batch(int argc, char **argv)
+{
+    FILE *f;
+    char line[4096];
+    int nb_jobs = 0, nb_failed = 0;
+
+    if (!strcmp(batch_filename, "-")) {
+        f = stdin;
+        using_stdin = 1;
+    } else
+        f = fopen(batch_filename, "r");
+    if (!f) {
+        fprintf(stderr, "Could not open batch file '%s'\n", batch_filename);
+        return -1;
+    }
+
+    while (!received_sigterm && fgets(line, sizeof(line), f)) {
+        char *job_argv[1024], *p, *tok;
+        int job_argc, i;
+        int64_t ti;
+
+        job_argc = 0;
+        job_argv[job_argc++] = argv[0];
+        for (i = 1; i < argc && job_argc < FF_ARRAY_ELEMS(job_argv) - 1; i++)
+            job_argv[job_argc++] = argv[i];
+        for (p = line; job_argc < FF_ARRAY_ELEMS(job_argv) - 1 &&
+                       (tok = strtok(p, " \t\r\n")); p = NULL)
+            job_argv[job_argc++] = tok;
+        job_argv[job_argc] = NULL;
+        if (job_argc == argc)
+            continue;
+
+        reset_options();
+        using_stdin = f == stdin;
+        av_freep(&batch_filename);
+
+        nb_jobs++;
+        ti = getutime();
+        if (run_job(job_argc, job_argv) < 0) {
+            fprintf(stderr, "job %d failed\n", nb_jobs);
+            nb_failed++;
+        } else if (run_opts.do_benchmark) {
+            ti = getutime() - ti;
+            printf("bench: job=%d utime=%0.3fs\n", nb_jobs, ti / 1000000.0);
+        }
+        close_files();
+    }
+
+    if (f != stdin)
+        fclose(f);
+    if (run_opts.verbose >= 0)
+        fprintf(stderr, "%d jobs run, %d failed\n", nb_jobs, nb_failed);
+    return nb_failed ? -1 : 0;
+}
+
+int main(int argc, char **argv)
+{
     int64_t ti;
 
     avcodec_register_all();
@@ -3957,17 +4823,22 @@ int main(int argc, char **argv)
         url_set_interrupt_cb(decode_interrupt_cb);
 #endif
 
-    for(i=0; i<CODEC_TYPE_NB; i++){
-        avcodec_opts[i]= avcodec_alloc_context2(i);
-    }
-    avformat_opts = avformat_alloc_context();
-    sws_opts = sws_getContext(16,16,0, 16,16,0, sws_flags, NULL,NULL,NULL);
+    run_opts = default_run_opts;
+    alloc_opts();
 
     show_banner();
 
     /* parse options */
     parse_options(argc, argv, options, opt_output_file);
 
+    if (batch_filename) {
+        if (nb_input_files || nb_output_files) {
+            fprintf(stderr, "Input and output files must be given in the batch file\n");
+            av_exit(1);
+        }
+        return av_exit(run_batch(argc, argv) < 0);
+    }
+
     /* file converter / grab */
     if (nb_output_files <= 0) {
         fprintf(stderr, "At least one output file must be specified\n");
@@ -3981,10 +4852,10 @@ int main(int argc, char **argv)
 
     ti = getutime();
     if (av_encode(output_files, nb_output_files, input_files, nb_input_files,
-                  stream_maps, nb_stream_maps) < 0)
+                  run_opts.stream_maps, run_opts.nb_stream_maps) < 0)
         av_exit(1);
     ti = getutime() - ti;
-    if (do_benchmark) {
+    if (run_opts.do_benchmark) {
         printf("bench: utime=%0.3fs\n", ti / 1000000.0);
     }
 
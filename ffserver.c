@@ -33,6 +33,7 @@
 #include "libavformat/network.h"
 #include "libavformat/os_support.h"
 #include "libavformat/rtpdec.h"
+#include "libavformat/rtpenc.h"
 #include "libavformat/rtsp.h"
 #include "libavutil/avstring.h"
 #include "libavutil/lfg.h"
@@ -55,6 +56,11 @@
 #if HAVE_DLFCN_H
 #include <dlfcn.h>
 #endif
+#if HAVE_PTHREADS
+#include <pthread.h>
+#include "libavutil/fifo.h"
+#include "libswscale/swscale.h"
+#endif
 
 #include "cmdutils.h"
 
@@ -146,6 +152,7 @@ typedef struct HTTPContext {
     int feed_streams[MAX_STREAMS]; /* index of streams in the feed */
     int switch_feed_streams[MAX_STREAMS]; /* index of streams in the feed */
     int switch_pending;
+    int feed_generation; /* feed_generation of the feed when it was opened */
     AVFormatContext fmt_ctx; /* instance of FFStream for one user */
     int last_packet_sent; /* true if last data packet was sent */
     int suppress_log;
@@ -197,6 +204,27 @@ typedef struct IPAddressACL {
     struct in_addr last;
 } IPAddressACL;
 
+#define RTP_CACHE_SIZE 64
+
+/* RTP packets of one frame, shared by the RTP sessions of a stream */
+typedef struct RTPCacheEntry {
+    int generation;     /* feed generation the frame was read in */
+    int64_t pos;        /* position of the frame in the input file, or -1 */
+    int64_t dts;
+    int size;           /* size of the frame */
+    uint8_t *buf;       /* RTP packets, each preceded by its 32 bit size */
+    int len;
+} RTPCacheEntry;
+
+/* packetizes the frames of a video stream once for all the RTP sessions,
+   which only write their own packet headers */
+typedef struct RTPPacketizer {
+    AVFormatContext *ctx;
+    int max_packet_size;
+    RTPCacheEntry cache[RTP_CACHE_SIZE];
+    int next;           /* cache entry replaced next */
+} RTPPacketizer;
+
 /* description of each stream of the ffserver.conf file */
 typedef struct FFStream {
     enum StreamType stream_type;
@@ -235,6 +263,7 @@ typedef struct FFStream {
 
     /* feed specific */
     int feed_opened;     /* true if someone is writing to the feed */
+    int feed_generation; /* incremented each time someone starts writing */
     int is_feed;         /* true if it is a feed */
     int readonly;        /* True if writing is prohibited to the file */
     int truncate;        /* True if feeder connection truncate the feed file */
@@ -244,6 +273,10 @@ typedef struct FFStream {
     int64_t feed_write_index;   /* current write position in feed (it wraps around) */
     int64_t feed_size;          /* current size of feed */
     struct FFStream *next_feed;
+    RTPPacketizer *rtp_packetizer[MAX_STREAMS];
+    char *encode_input;         /* input encoded by the server itself into the feed */
+    AVInputFormat *encode_ifmt;
+    struct FeedEncoder *encoder;
 } FFStream;
 
 typedef struct FeedData {
@@ -291,6 +324,7 @@ static HTTPContext *rtp_new_connection(struct sockaddr_in *from_addr,
 static int rtp_new_av_stream(HTTPContext *c,
                              int stream_index, struct sockaddr_in *dest_addr,
                              HTTPContext *rtsp_c);
+static void rtp_free_packetizers(FFStream *stream);
 
 static const char *my_program_name;
 static const char *my_program_dir;
@@ -397,12 +431,643 @@ static int compute_datarate(DataRateData *drd, int64_t count)
 }
 
 
+#if HAVE_PTHREADS
+/* in-process feed encoding, see the Encode directive */
+
+typedef struct FeedEncoderStream {
+    AVStream *st;               /* feed stream, its codec is the opened encoder */
+    AVStream *ist;              /* input stream it is encoded from */
+    struct SwsContext *sws;     /* NULL if the input needs no scaling */
+    AVPicture pict;             /* scaled picture */
+    ReSampleContext *resample;  /* NULL if the input needs no resampling */
+    int16_t *resampled;
+    AVFifoBuffer *fifo;         /* samples waiting for a complete frame */
+    int64_t next_pts;           /* in encoder time base */
+} FeedEncoderStream;
+
+typedef struct FeedEncoder {
+    FFStream *feed;
+    AVFormatContext *ic;
+    AVFormatContext *oc;        /* ffm muxer writing into the feed file */
+    FeedEncoderStream streams[MAX_STREAMS];
+    int64_t start_ts[MAX_STREAMS]; /* first timestamp of each input stream */
+    uint8_t io_buffer[FFM_PACKET_SIZE];
+    uint8_t packet[FFM_PACKET_SIZE];
+    int packet_fill;
+    int64_t packet_count;       /* packets written by the muxer, the first is the header */
+    int fd;                     /* feed file */
+    int64_t write_index;
+    int64_t feed_size;
+    int pipe_fd[2];             /* write index updates for the server loop */
+    struct pollfd *poll_entry;
+    pthread_t thread;
+    int started;                /* the encoder parameters have been published */
+    time_t start;
+    uint8_t *bit_buffer;
+    int bit_buffer_size;
+    int16_t *samples;           /* decoded audio */
+    int16_t *frame_samples;     /* one frame of audio for the encoder */
+} FeedEncoder;
+
+/* sent by an encoder thread, a negative write_index means it stopped */
+typedef struct FeedUpdate {
+    int64_t write_index;
+    int64_t feed_size;
+} FeedUpdate;
+
+/* encoder threads open codecs while the server probes its inputs */
+static int ffserver_lockmgr(void **mutex, enum AVLockOp op)
+{
+    pthread_mutex_t **m = (pthread_mutex_t **)mutex;
+
+    switch (op) {
+    case AV_LOCK_CREATE:
+        *m = av_malloc(sizeof(pthread_mutex_t));
+        return !*m || pthread_mutex_init(*m, NULL);
+    case AV_LOCK_OBTAIN:
+        return !!pthread_mutex_lock(*m);
+    case AV_LOCK_RELEASE:
+        return !!pthread_mutex_unlock(*m);
+    case AV_LOCK_DESTROY:
+        pthread_mutex_destroy(*m);
+        av_freep(m);
+        return 0;
+    }
+    return 1;
+}
+
+static void feed_encoder_notify(FeedEncoder *fe, int64_t write_index)
+{
+    FeedUpdate u;
+
+    u.write_index = write_index;
+    u.feed_size   = fe->feed_size;
+    write(fe->pipe_fd[1], &u, sizeof(u));
+}
+
+/* stores the FFM packets of the muxer in the feed file, like
+   http_receive_data() does for packets sent by a feeder */
+static int feed_encoder_write(void *opaque, uint8_t *buf, int buf_size)
+{
+    FeedEncoder *fe = opaque;
+    int size = buf_size;
+
+    while (size > 0) {
+        int len = FFMIN(size, FFM_PACKET_SIZE - fe->packet_fill);
+
+        memcpy(fe->packet + fe->packet_fill, buf, len);
+        fe->packet_fill += len;
+        buf  += len;
+        size -= len;
+        if (fe->packet_fill < FFM_PACKET_SIZE)
+            break;
+        fe->packet_fill = 0;
+
+        /* the header was written when the feed file was created */
+        if (!fe->packet_count++)
+            continue;
+
+        if (pwrite(fe->fd, fe->packet, FFM_PACKET_SIZE, fe->write_index) != FFM_PACKET_SIZE) {
+            http_log("Error writing to feed file: %s\n", strerror(errno));
+            return -1;
+        }
+        fe->write_index += FFM_PACKET_SIZE;
+        if (fe->write_index > fe->feed_size)
+            fe->feed_size = fe->write_index;
+        /* handle wrap around if max file size reached */
+        if (fe->feed->feed_max_size && fe->write_index >= fe->feed->feed_max_size)
+            fe->write_index = FFM_PACKET_SIZE;
+        if (ffm_write_write_index(fe->fd, fe->write_index) < 0) {
+            http_log("Error writing index to feed file: %s\n", strerror(errno));
+            return -1;
+        }
+        feed_encoder_notify(fe, fe->write_index);
+    }
+    return buf_size;
+}
+
+static void feed_encoder_mux(FeedEncoder *fe, FeedEncoderStream *fes, int size,
+                             int64_t pts, int key_frame)
+{
+    AVPacket pkt;
+
+    av_init_packet(&pkt);
+    pkt.stream_index = fes->st->index;
+    pkt.data = fe->bit_buffer;
+    pkt.size = size;
+    if (pts != AV_NOPTS_VALUE)
+        pkt.pts = av_rescale_q(pts, fes->st->codec->time_base, fes->st->time_base);
+    if (key_frame)
+        pkt.flags |= PKT_FLAG_KEY;
+    av_interleaved_write_frame(fe->oc, &pkt);
+}
+
+static void feed_encode_video(FeedEncoder *fe, FeedEncoderStream *fes,
+                              AVFrame *in, int64_t ts)
+{
+    AVCodecContext *enc = fes->st->codec;
+    AVFrame picture;
+    int i, n = 1, ret;
+
+    /* drop or duplicate frames to keep the frame rate of the feed */
+    if (ts != AV_NOPTS_VALUE) {
+        int64_t t = av_rescale_q(ts, fes->ist->time_base, enc->time_base);
+        if (t < fes->next_pts)
+            return;
+        if (t - fes->next_pts > 10)
+            fes->next_pts = t;
+        n = t - fes->next_pts + 1;
+    }
+
+    avcodec_get_frame_defaults(&picture);
+    if (fes->sws) {
+        sws_scale(fes->sws, in->data, in->linesize, 0, fes->ist->codec->height,
+                  fes->pict.data, fes->pict.linesize);
+        in = (AVFrame *)&fes->pict;
+    }
+    for (i = 0; i < 4; i++) {
+        picture.data[i]     = in->data[i];
+        picture.linesize[i] = in->linesize[i];
+    }
+
+    while (n--) {
+        picture.pts = fes->next_pts++;
+        ret = avcodec_encode_video(enc, fe->bit_buffer, fe->bit_buffer_size, &picture);
+        if (ret > 0)
+            feed_encoder_mux(fe, fes, ret, enc->coded_frame->pts,
+                             enc->coded_frame->key_frame);
+    }
+}
+
+static void feed_encode_audio(FeedEncoder *fe, FeedEncoderStream *fes,
+                              int16_t *samples, int size)
+{
+    AVCodecContext *dec = fes->ist->codec, *enc = fes->st->codec;
+    int frame_bytes = enc->frame_size * enc->channels * 2;
+    int ret;
+
+    if (fes->resample) {
+        int isize = av_get_bits_per_sample_format(dec->sample_fmt) / 8 * dec->channels;
+        size = audio_resample(fes->resample, fes->resampled, samples, size / isize) *
+               enc->channels * 2;
+        samples = fes->resampled;
+    }
+    if (av_fifo_space(fes->fifo) < size)
+        av_fifo_realloc2(fes->fifo, av_fifo_size(fes->fifo) + size);
+    av_fifo_generic_write(fes->fifo, samples, size, NULL);
+
+    while (av_fifo_size(fes->fifo) >= frame_bytes) {
+        av_fifo_generic_read(fes->fifo, fe->frame_samples, frame_bytes, NULL);
+        ret = avcodec_encode_audio(enc, fe->bit_buffer, fe->bit_buffer_size,
+                                   fe->frame_samples);
+        if (ret > 0)
+            feed_encoder_mux(fe, fes, ret, fes->next_pts, 1);
+        fes->next_pts += enc->frame_size;
+    }
+}
+
+static void feed_encoder_decode(FeedEncoder *fe, AVPacket *pkt)
+{
+    AVStream *ist = fe->ic->streams[pkt->stream_index];
+    AVCodecContext *dec = ist->codec;
+    AVPacket avpkt = *pkt;
+    AVFrame frame;
+    int64_t ts;
+    int i, ret, got_picture, size;
+
+    if (fe->start_ts[ist->index] == AV_NOPTS_VALUE)
+        fe->start_ts[ist->index] = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+
+    while (avpkt.size > 0) {
+        if (dec->codec_type == CODEC_TYPE_VIDEO) {
+            dec->reordered_opaque = pkt->pts;
+            ret = avcodec_decode_video2(dec, &frame, &got_picture, &avpkt);
+            if (ret < 0)
+                return;
+            if (got_picture) {
+                ts = frame.reordered_opaque != AV_NOPTS_VALUE ?
+                     frame.reordered_opaque : pkt->dts;
+                if (ts != AV_NOPTS_VALUE && fe->start_ts[ist->index] != AV_NOPTS_VALUE)
+                    ts -= fe->start_ts[ist->index];
+                for (i = 0; i < fe->oc->nb_streams; i++)
+                    if (fe->streams[i].ist == ist)
+                        feed_encode_video(fe, &fe->streams[i], &frame, ts);
+            }
+        } else {
+            size = AVCODEC_MAX_AUDIO_FRAME_SIZE;
+            ret = avcodec_decode_audio3(dec, fe->samples, &size, &avpkt);
+            if (ret < 0)
+                return;
+            if (size > 0)
+                for (i = 0; i < fe->oc->nb_streams; i++)
+                    if (fe->streams[i].ist == ist)
+                        feed_encode_audio(fe, &fe->streams[i], fe->samples, size);
+        }
+        if (!ret)
+            break;
+        avpkt.data += ret;
+        avpkt.size -= ret;
+    }
+}
+
+static void feed_encoder_close(FeedEncoder *fe)
+{
+    int i;
+
+    for (i = 0; i < MAX_STREAMS; i++) {
+        FeedEncoderStream *fes = &fe->streams[i];
+        if (!fes->st)
+            continue;
+        if (fes->st->codec->codec)
+            avcodec_close(fes->st->codec);
+        if (fes->sws)
+            sws_freeContext(fes->sws);
+        avpicture_free(&fes->pict);
+        if (fes->resample)
+            audio_resample_close(fes->resample);
+        av_free(fes->resampled);
+        av_fifo_free(fes->fifo);
+        av_free(fes->st->codec->extradata);
+        av_free(fes->st->codec);
+        av_free(fes->st->priv_data);
+        av_free(fes->st);
+    }
+    if (fe->ic) {
+        for (i = 0; i < fe->ic->nb_streams; i++)
+            if (fe->ic->streams[i]->codec->codec)
+                avcodec_close(fe->ic->streams[i]->codec);
+        av_close_input_file(fe->ic);
+    }
+    if (fe->oc) {
+        av_free(fe->oc->pb);
+        av_free(fe->oc->priv_data);
+        av_free(fe->oc);
+    }
+    if (fe->fd >= 0)
+        close(fe->fd);
+    if (fe->pipe_fd[0] >= 0) {
+        close(fe->pipe_fd[0]);
+        close(fe->pipe_fd[1]);
+    }
+    av_free(fe->bit_buffer);
+    av_free(fe->samples);
+    av_free(fe->frame_samples);
+    av_free(fe);
+}
+
+/* the codec contexts of a feed only hold what is stored in the FFM
+   header, set up the encoder like ffmpeg does when it reads that header */
+static void feed_encoder_copy_codec(AVCodecContext *enc, const AVCodecContext *fst)
+{
+#define COPY(field) enc->field = fst->field
+    avcodec_get_context_defaults2(enc, fst->codec_type);
+    COPY(codec_id);
+    COPY(codec_type);
+    COPY(bit_rate);
+    COPY(flags);
+    COPY(flags2);
+    COPY(debug);
+    if (fst->codec_type == CODEC_TYPE_VIDEO) {
+        COPY(time_base);
+        COPY(width);
+        COPY(height);
+        COPY(gop_size);
+        COPY(pix_fmt);
+        COPY(qmin);
+        COPY(qmax);
+        COPY(max_qdiff);
+        COPY(qcompress);
+        COPY(qblur);
+        COPY(bit_rate_tolerance);
+        COPY(rc_eq);
+        COPY(rc_max_rate);
+        COPY(rc_min_rate);
+        COPY(rc_buffer_size);
+        COPY(i_quant_factor);
+        COPY(b_quant_factor);
+        COPY(i_quant_offset);
+        COPY(b_quant_offset);
+        COPY(dct_algo);
+        COPY(strict_std_compliance);
+        COPY(max_b_frames);
+        COPY(luma_elim_threshold);
+        COPY(chroma_elim_threshold);
+        COPY(mpeg_quant);
+        COPY(intra_dc_precision);
+        COPY(me_method);
+        COPY(mb_decision);
+        COPY(nsse_weight);
+        COPY(frame_skip_cmp);
+        COPY(rc_buffer_aggressivity);
+        COPY(codec_tag);
+        COPY(thread_count);
+        COPY(coder_type);
+        COPY(me_cmp);
+        COPY(partitions);
+        COPY(me_subpel_quality);
+        COPY(me_range);
+        COPY(keyint_min);
+        COPY(scenechange_threshold);
+        COPY(b_frame_strategy);
+        COPY(refs);
+        COPY(directpred);
+    } else {
+        COPY(sample_rate);
+        COPY(channels);
+    }
+#undef COPY
+}
+
+static int feed_encoder_open_stream(FeedEncoder *fe, int index)
+{
+    FFStream *feed = fe->feed;
+    FeedEncoderStream *fes = &fe->streams[index];
+    AVCodecContext *enc, *dec;
+    AVCodec *codec;
+    AVStream *st;
+    int i;
+
+    /* encode every feed stream from the first input stream of its type */
+    for (i = 0; i < fe->ic->nb_streams; i++)
+        if (fe->ic->streams[i]->codec->codec_type == feed->streams[index]->codec->codec_type)
+            break;
+    if (i == fe->ic->nb_streams) {
+        http_log("No input for stream %d of feed '%s'\n", index, feed->filename);
+        return -1;
+    }
+    fes->ist = fe->ic->streams[i];
+    dec = fes->ist->codec;
+    if (!dec->codec) {
+        codec = avcodec_find_decoder(dec->codec_id);
+        if (!codec || avcodec_open(dec, codec) < 0) {
+            http_log("Could not open decoder for input stream %d of feed '%s'\n",
+                     i, feed->filename);
+            return -1;
+        }
+        fes->ist->discard = AVDISCARD_DEFAULT;
+    }
+
+    st = fes->st = av_new_stream(fe->oc, feed->streams[index]->id);
+    if (!st)
+        return -1;
+    enc = st->codec;
+    feed_encoder_copy_codec(enc, feed->streams[index]->codec);
+    codec = avcodec_find_encoder(enc->codec_id);
+    if (!codec) {
+        http_log("No encoder for stream %d of feed '%s'\n", index, feed->filename);
+        return -1;
+    }
+
+    if (enc->codec_type == CODEC_TYPE_VIDEO) {
+        if (codec->pix_fmts) {
+            const enum PixelFormat *p = codec->pix_fmts;
+            while (*p != PIX_FMT_NONE && *p != enc->pix_fmt)
+                p++;
+            if (*p == PIX_FMT_NONE)
+                enc->pix_fmt = codec->pix_fmts[0];
+        }
+    } else {
+        enc->sample_fmt = SAMPLE_FMT_S16;
+        enc->time_base  = (AVRational){1, enc->sample_rate};
+    }
+    if (enc->thread_count > 1)
+        avcodec_thread_init(enc, enc->thread_count);
+    else
+        enc->thread_count = 1;
+    if (avcodec_open(enc, codec) < 0) {
+        http_log("Could not open encoder for stream %d of feed '%s'\n",
+                 index, feed->filename);
+        return -1;
+    }
+
+    if (enc->codec_type == CODEC_TYPE_VIDEO) {
+        if (dec->width != enc->width || dec->height != enc->height ||
+            dec->pix_fmt != enc->pix_fmt) {
+            fes->sws = sws_getContext(dec->width, dec->height, dec->pix_fmt,
+                                      enc->width, enc->height, enc->pix_fmt,
+                                      SWS_BICUBIC, NULL, NULL, NULL);
+            if (!fes->sws ||
+                avpicture_alloc(&fes->pict, enc->pix_fmt, enc->width, enc->height) < 0)
+                return -1;
+        }
+        fe->bit_buffer_size = FFMAX(fe->bit_buffer_size,
+                                    6 * enc->width * enc->height + FF_MIN_BUFFER_SIZE);
+    } else {
+        if (enc->frame_size <= 1) {
+            http_log("Encoding audio without fixed frame size is not supported (feed '%s')\n",
+                     feed->filename);
+            return -1;
+        }
+        if (dec->sample_rate != enc->sample_rate || dec->channels != enc->channels ||
+            dec->sample_fmt != enc->sample_fmt) {
+            /* enough room for a maximal decoded frame of 8 bit samples */
+            int size = (int64_t)AVCODEC_MAX_AUDIO_FRAME_SIZE / dec->channels *
+                       (enc->sample_rate / dec->sample_rate + 1) * enc->channels * 2;
+            fes->resample = av_audio_resample_init(enc->channels, dec->channels,
+                                                   enc->sample_rate, dec->sample_rate,
+                                                   enc->sample_fmt, dec->sample_fmt,
+                                                   16, 10, 0, 0.8);
+            fes->resampled = av_malloc(size);
+            if (!fes->resample || !fes->resampled)
+                return -1;
+        }
+        fes->fifo = av_fifo_alloc(2 * AVCODEC_MAX_AUDIO_FRAME_SIZE);
+        fe->bit_buffer_size = FFMAX(fe->bit_buffer_size, FF_MIN_BUFFER_SIZE);
+    }
+    return 0;
+}
+
+static int feed_encoder_init(FeedEncoder *fe)
+{
+    FFStream *feed = fe->feed;
+    int i;
+
+    if (av_open_input_file(&fe->ic, feed->encode_input, feed->encode_ifmt, 0, NULL) < 0) {
+        http_log("Could not open input '%s' of feed '%s'\n",
+                 feed->encode_input, feed->filename);
+        fe->ic = NULL;
+        return -1;
+    }
+    if (av_find_stream_info(fe->ic) < 0) {
+        http_log("Could not find the parameters of input '%s' of feed '%s'\n",
+                 feed->encode_input, feed->filename);
+        return -1;
+    }
+    for (i = 0; i < fe->ic->nb_streams; i++) {
+        fe->ic->streams[i]->discard = AVDISCARD_ALL;
+        fe->start_ts[i] = AV_NOPTS_VALUE;
+    }
+
+    fe->oc = avformat_alloc_context();
+    if (!fe->oc)
+        return -1;
+    fe->oc->oformat = feed->fmt;
+    for (i = 0; i < feed->nb_streams; i++)
+        if (feed_encoder_open_stream(fe, i) < 0)
+            return -1;
+
+    fe->bit_buffer    = av_malloc(fe->bit_buffer_size);
+    fe->samples       = av_malloc(AVCODEC_MAX_AUDIO_FRAME_SIZE);
+    fe->frame_samples = av_malloc(AVCODEC_MAX_AUDIO_FRAME_SIZE);
+    if (!fe->bit_buffer || !fe->samples || !fe->frame_samples)
+        return -1;
+
+    /* open feed */
+    fe->fd = open(feed->feed_filename, O_RDWR);
+    if (fe->fd < 0) {
+        http_log("Error opening feeder file: %s\n", strerror(errno));
+        return -1;
+    }
+    if (feed->truncate) {
+        /* truncate feed file */
+        ffm_write_write_index(fe->fd, FFM_PACKET_SIZE);
+        ftruncate(fe->fd, FFM_PACKET_SIZE);
+        http_log("Truncating feed file '%s'\n", feed->feed_filename);
+    }
+    fe->write_index = FFMAX(ffm_read_write_index(fe->fd), FFM_PACKET_SIZE);
+    fe->feed_size   = lseek(fe->fd, 0, SEEK_END);
+
+    fe->oc->pb = av_alloc_put_byte(fe->io_buffer, FFM_PACKET_SIZE, 1, fe,
+                                   NULL, feed_encoder_write, NULL);
+    if (!fe->oc->pb || av_set_parameters(fe->oc, NULL) < 0 ||
+        av_write_header(fe->oc) < 0)
+        return -1;
+    return 0;
+}
+
+static void *feed_encoder_thread(void *arg)
+{
+    FeedEncoder *fe = arg;
+    AVPacket pkt;
+
+    if (feed_encoder_init(fe) < 0) {
+        http_log("Could not start encoding feed '%s'\n", fe->feed->filename);
+        feed_encoder_notify(fe, -1);
+        return NULL;
+    }
+    http_log("Encoding feed '%s' from '%s'\n", fe->feed->filename, fe->feed->encode_input);
+    /* the first update makes the encoder parameters known to the server */
+    feed_encoder_notify(fe, fe->write_index);
+
+    while (av_read_frame(fe->ic, &pkt) >= 0) {
+        if (fe->ic->streams[pkt.stream_index]->discard != AVDISCARD_ALL)
+            feed_encoder_decode(fe, &pkt);
+        av_free_packet(&pkt);
+        if (url_ferror(fe->oc->pb))
+            break;
+    }
+    av_write_trailer(fe->oc);
+    feed_encoder_notify(fe, -1);
+    return NULL;
+}
+
+/* the encoder thread opens its input and codecs itself, so that slow
+   inputs do not stall the server, see ffserver_lockmgr() */
+static void feed_encoder_start(FFStream *feed)
+{
+    FeedEncoder *fe;
+
+    if (feed->feed_opened)
+        return;
+
+    fe = av_mallocz(sizeof(*fe));
+    if (!fe)
+        return;
+    fe->feed  = feed;
+    fe->fd    = -1;
+    fe->start = time(0);
+
+    if (pipe(fe->pipe_fd) < 0) {
+        av_free(fe);
+        return;
+    }
+    fcntl(fe->pipe_fd[0], F_SETFL, O_NONBLOCK);
+    if (pthread_create(&fe->thread, NULL, feed_encoder_thread, fe)) {
+        http_log("Could not start encoding feed '%s'\n", feed->filename);
+        feed_encoder_close(fe);
+        return;
+    }
+    feed->encoder     = fe;
+    feed->feed_opened = 1;
+    feed->feed_generation++;
+}
+
+/* make what the encoders found out known to the clients of the feed */
+static void feed_encoder_started(FFStream *feed)
+{
+    FeedEncoder *fe = feed->encoder;
+    int i;
+
+    for (i = 0; i < feed->nb_streams; i++) {
+        AVCodecContext *fst = feed->streams[i]->codec;
+        AVCodecContext *enc = fe->streams[i].st->codec;
+        fst->frame_size = enc->frame_size;
+        fst->pix_fmt    = enc->pix_fmt;
+        if (enc->extradata_size) {
+            av_free(fst->extradata);
+            fst->extradata = av_malloc(enc->extradata_size);
+            fst->extradata_size = 0;
+            if (fst->extradata) {
+                memcpy(fst->extradata, enc->extradata, enc->extradata_size);
+                fst->extradata_size = enc->extradata_size;
+            }
+        }
+    }
+    fe->started = 1;
+}
+
+/* handle the write index updates of an encoder thread */
+static void feed_encoder_update(FFStream *feed)
+{
+    FeedEncoder *fe = feed->encoder;
+    HTTPContext *c;
+    FeedUpdate u;
+    int stopped = 0;
+
+    while (read(fe->pipe_fd[0], &u, sizeof(u)) == sizeof(u)) {
+        if (u.write_index < 0) {
+            stopped = 1;
+            break;
+        }
+        if (!fe->started)
+            feed_encoder_started(feed);
+        feed->feed_write_index = u.write_index;
+        feed->feed_size        = u.feed_size;
+    }
+
+    /* wake up any waiting connections */
+    for (c = first_http_ctx; c; c = c->next) {
+        if (c->state == HTTPSTATE_WAIT_FEED && c->stream->feed == feed)
+            c->state = stopped ? HTTPSTATE_SEND_DATA_TRAILER : HTTPSTATE_SEND_DATA;
+    }
+
+    if (stopped) {
+        int uptime = time(0) - fe->start;
+
+        pthread_join(fe->thread, NULL);
+        feed_encoder_close(fe);
+        feed->encoder     = NULL;
+        feed->feed_opened = 0;
+        http_log("%s: encoder stopped after %d seconds\n", feed->filename, uptime);
+
+        if (uptime < 30)
+            /* Turn off any more restarts */
+            av_freep(&feed->encode_input);
+        need_to_start_children = 1;
+    }
+}
+#endif
+
 static void start_children(FFStream *feed)
 {
     if (no_launch)
         return;
 
     for (; feed; feed = feed->next) {
+#if HAVE_PTHREADS
+        if (feed->encode_input && !feed->encoder)
+            feed_encoder_start(feed);
+#endif
         if (feed->child_argv && !feed->pid) {
             feed->pid_start = time(0);
 
@@ -553,8 +1218,13 @@ static int http_server(void)
     int ret, delay, delay1;
     struct pollfd *poll_table, *poll_entry;
     HTTPContext *c, *c_next;
+    FFStream *feed;
+    int nb_feeds = 0;
 
-    if(!(poll_table = av_mallocz((nb_max_http_connections + 2)*sizeof(*poll_table)))) {
+    for (feed = first_feed; feed; feed = feed->next_feed)
+        nb_feeds++;
+
+    if(!(poll_table = av_mallocz((nb_max_http_connections + 2 + nb_feeds)*sizeof(*poll_table)))) {
         http_log("Impossible to allocate a poll table handling %d connections.\n", nb_max_http_connections);
         return -1;
     }
@@ -645,6 +1315,18 @@ static int http_server(void)
             c = c->next;
         }
 
+#if HAVE_PTHREADS
+        /* wait for write index updates of the feed encoders */
+        for (feed = first_feed; feed; feed = feed->next_feed) {
+            if (feed->encoder) {
+                feed->encoder->poll_entry = poll_entry;
+                poll_entry->fd = feed->encoder->pipe_fd[0];
+                poll_entry->events = POLLIN;
+                poll_entry++;
+            }
+        }
+#endif
+
         /* wait for an event on one connection. We poll at least every
            second to handle timeouts */
         do {
@@ -656,6 +1338,14 @@ static int http_server(void)
 
         cur_time = av_gettime() / 1000;
 
+#if HAVE_PTHREADS
+        for (feed = first_feed; feed; feed = feed->next_feed) {
+            if (feed->encoder && feed->encoder->poll_entry &&
+                feed->encoder->poll_entry->revents & POLLIN)
+                feed_encoder_update(feed);
+        }
+#endif
+
         if (need_to_start_children) {
             need_to_start_children = 0;
             start_children(first_feed);
@@ -819,6 +1509,15 @@ static void close_connection(HTTPContext *c)
             url_close(h);
     }
 
+    /* the shared packetizers go away with the last RTP session */
+    if (c->stream && c->is_packetized) {
+        for(c1 = first_http_ctx; c1 != NULL; c1 = c1->next)
+            if (c1->stream == c->stream && c1->is_packetized)
+                break;
+        if (!c1)
+            rtp_free_packetizers(c->stream);
+    }
+
     ctx = &c->fmt_ctx;
 
     if (!c->last_packet_sent && c->state == HTTPSTATE_SEND_DATA_TRAILER) {
@@ -1999,6 +2698,7 @@ static int open_input_stream(HTTPContext *c, const char *info)
     }
     s->flags |= AVFMT_FLAG_GENPTS;
     c->fmt_in = s;
+    c->feed_generation = c->stream->feed ? c->stream->feed->feed_generation : 0;
     if (strcmp(s->iformat->name, "ffm") && av_find_stream_info(c->fmt_in) < 0) {
         http_log("Could not find stream info '%s'\n", input_filename);
         av_close_input_file(s);
@@ -2053,9 +2753,148 @@ static int64_t get_packet_send_clock(HTTPContext *c)
 }
 
 
+static AVFormatContext *rtp_open_muxer(FFStream *stream, int stream_index,
+                                       int max_packet_size)
+{
+    AVFormatContext *ctx;
+    AVStream *st;
+    uint8_t *dummy_buf;
+
+    ctx = avformat_alloc_context();
+    if (!ctx)
+        return NULL;
+    ctx->oformat = guess_format("rtp", NULL, NULL);
+
+    st = av_mallocz(sizeof(AVStream));
+    if (!st)
+        goto fail;
+    ctx->nb_streams = 1;
+    ctx->streams[0] = st;
+
+    if (!stream->feed || stream->feed == stream)
+        memcpy(st, stream->streams[stream_index], sizeof(AVStream));
+    else
+        memcpy(st, stream->feed->streams[stream->feed_streams[stream_index]],
+               sizeof(AVStream));
+    st->priv_data = NULL;
+
+    /* normally, no packets should be output here, but the packet size may be checked */
+    if (url_open_dyn_packet_buf(&ctx->pb, max_packet_size) < 0)
+        goto fail;
+    av_set_parameters(ctx, NULL);
+    if (av_write_header(ctx) < 0) {
+        url_close_dyn_buf(ctx->pb, &dummy_buf);
+        av_free(dummy_buf);
+        goto fail;
+    }
+    url_close_dyn_buf(ctx->pb, &dummy_buf);
+    av_free(dummy_buf);
+    return ctx;
+ fail:
+    av_free(st);
+    av_free(ctx);
+    return NULL;
+}
+
+static void rtp_free_packetizers(FFStream *stream)
+{
+    int i, j;
+
+    for (i = 0; i < MAX_STREAMS; i++) {
+        RTPPacketizer *p = stream->rtp_packetizer[i];
+        if (!p)
+            continue;
+        /* the dynamic buffer of the last frame is already closed */
+        p->ctx->pb = NULL;
+        av_write_trailer(p->ctx);
+        av_free(p->ctx->streams[0]);
+        av_free(p->ctx);
+        for (j = 0; j < RTP_CACHE_SIZE; j++)
+            av_free(p->cache[j].buf);
+        av_freep(&stream->rtp_packetizer[i]);
+    }
+}
+
+/* write a frame to the RTP muxer of a session. Video frames are
+   packetized only once for all the sessions of the stream, each session
+   just writes the packet headers with its own sequence numbers and
+   timestamps. A frame is identified by its dts and size, and by the feed
+   generation and its position in the feed, which tell apart the frames
+   of a restarted or wrapped around feed; frames without a dts are not
+   shared. Audio packetizers group several frames in a packet, so they
+   cannot be shared. */
+static int rtp_write_shared_frame(HTTPContext *c, AVFormatContext *ctx,
+                                  AVPacket *pkt, int max_packet_size)
+{
+    int stream_index = c->packet_stream_index;
+    RTPPacketizer *p = c->stream->rtp_packetizer[stream_index];
+    RTPMuxContext *s = ctx->priv_data;
+    RTPCacheEntry *e = NULL;
+    uint8_t *q, *end;
+    int i, len;
+
+    if (ctx->streams[0]->codec->codec_type != CODEC_TYPE_VIDEO ||
+        pkt->pts == AV_NOPTS_VALUE || pkt->dts == AV_NOPTS_VALUE)
+        return av_write_frame(ctx, pkt);
+
+    if (!p) {
+        p = av_mallocz(sizeof(RTPPacketizer));
+        if (!p)
+            return av_write_frame(ctx, pkt);
+        p->ctx = rtp_open_muxer(c->stream, stream_index, max_packet_size);
+        if (!p->ctx) {
+            av_free(p);
+            return av_write_frame(ctx, pkt);
+        }
+        p->max_packet_size = max_packet_size;
+        c->stream->rtp_packetizer[stream_index] = p;
+    }
+    if (p->max_packet_size != max_packet_size)
+        return av_write_frame(ctx, pkt);
+
+    for (i = 0; i < RTP_CACHE_SIZE; i++) {
+        if (p->cache[i].buf && p->cache[i].pos == pkt->pos &&
+            p->cache[i].generation == c->feed_generation &&
+            p->cache[i].dts == pkt->dts && p->cache[i].size == pkt->size) {
+            e = &p->cache[i];
+            break;
+        }
+    }
+    if (!e) {
+        e = &p->cache[p->next];
+        p->next = (p->next + 1) % RTP_CACHE_SIZE;
+        av_freep(&e->buf);
+        if (url_open_dyn_packet_buf(&p->ctx->pb, max_packet_size) < 0)
+            return -1;
+        p->ctx->pb->is_streamed = 1;
+        /* the sessions are not at the same position, so the frames do not
+           come in order, bypass the timestamp checks of av_write_frame() */
+        p->ctx->oformat->write_packet(p->ctx, pkt);
+        e->len  = url_close_dyn_buf(p->ctx->pb, &e->buf);
+        e->generation = c->feed_generation;
+        e->pos  = pkt->pos;
+        e->dts  = pkt->dts;
+        e->size = pkt->size;
+    }
+
+    ff_rtp_start_frame(ctx, pkt->pts);
+    for (q = e->buf, end = e->buf + e->len; end - q >= 4; q += len) {
+        len = AV_RB32(q);
+        q += 4;
+        if (len < 12 || len > end - q)
+            break;
+        /* skip the RTCP reports of the shared muxer */
+        if (q[1] == 200)
+            continue;
+        s->timestamp = s->cur_timestamp;
+        ff_rtp_send_data(ctx, q + 12, len - 12, q[1] >> 7);
+    }
+    return 0;
+}
+
 static int http_prepare_data(HTTPContext *c)
 {
-    int i, len, ret;
+    int i, len, ret, max_packet_size = 0;
     AVFormatContext *ctx;
 
     av_freep(&c->pb_buffer);
@@ -2215,7 +3054,6 @@ static int http_prepare_data(HTTPContext *c)
                     }
 
                     if (c->is_packetized) {
-                        int max_packet_size;
                         if (c->rtp_protocol == RTSP_LOWER_TRANSPORT_TCP)
                             max_packet_size = RTSP_TCP_MAX_PACKET_SIZE;
                         else
@@ -2236,7 +3074,11 @@ static int http_prepare_data(HTTPContext *c)
                     if (pkt.pts != AV_NOPTS_VALUE)
                         pkt.pts = av_rescale_q(pkt.pts, ist->time_base, ost->time_base);
                     pkt.duration = av_rescale_q(pkt.duration, ist->time_base, ost->time_base);
-                    if (av_write_frame(ctx, &pkt) < 0) {
+                    if (c->is_packetized)
+                        ret = rtp_write_shared_frame(c, ctx, &pkt, max_packet_size);
+                    else
+                        ret = av_write_frame(ctx, &pkt);
+                    if (ret < 0) {
                         http_log("Error writing frame to output\n");
                         c->state = HTTPSTATE_SEND_DATA_TRAILER;
                     }
@@ -2440,6 +3282,7 @@ static int http_start_receive_data(HTTPContext *c)
     c->buffer_ptr = c->buffer;
     c->buffer_end = c->buffer + FFM_PACKET_SIZE;
     c->stream->feed_opened = 1;
+    c->stream->feed_generation++;
     return 0;
 }
 
@@ -3160,34 +4003,11 @@ static int rtp_new_av_stream(HTTPContext *c,
                              HTTPContext *rtsp_c)
 {
     AVFormatContext *ctx;
-    AVStream *st;
     char *ipaddr;
+    char filename[1024];
     URLContext *h = NULL;
-    uint8_t *dummy_buf;
     int max_packet_size;
 
-    /* now we can open the relevant output stream */
-    ctx = avformat_alloc_context();
-    if (!ctx)
-        return -1;
-    ctx->oformat = guess_format("rtp", NULL, NULL);
-
-    st = av_mallocz(sizeof(AVStream));
-    if (!st)
-        goto fail;
-    st->codec= avcodec_alloc_context();
-    ctx->nb_streams = 1;
-    ctx->streams[0] = st;
-
-    if (!c->stream->feed ||
-        c->stream->feed == c->stream)
-        memcpy(st, c->stream->streams[stream_index], sizeof(AVStream));
-    else
-        memcpy(st,
-               c->stream->feed->streams[c->stream->feed_streams[stream_index]],
-               sizeof(AVStream));
-    st->priv_data = NULL;
-
     /* build destination RTP address */
     ipaddr = inet_ntoa(dest_addr->sin_addr);
 
@@ -3202,16 +4022,16 @@ static int rtp_new_av_stream(HTTPContext *c,
             ttl = c->stream->multicast_ttl;
             if (!ttl)
                 ttl = 16;
-            snprintf(ctx->filename, sizeof(ctx->filename),
+            snprintf(filename, sizeof(filename),
                      "rtp://%s:%d?multicast=1&ttl=%d",
                      ipaddr, ntohs(dest_addr->sin_port), ttl);
         } else {
-            snprintf(ctx->filename, sizeof(ctx->filename),
+            snprintf(filename, sizeof(filename),
                      "rtp://%s:%d", ipaddr, ntohs(dest_addr->sin_port));
         }
 
-        if (url_open(&h, ctx->filename, URL_WRONLY) < 0)
-            goto fail;
+        if (url_open(&h, filename, URL_WRONLY) < 0)
+            return -1;
         c->rtp_handles[stream_index] = h;
         max_packet_size = url_get_max_packet_size(h);
         break;
@@ -3221,28 +4041,22 @@ static int rtp_new_av_stream(HTTPContext *c,
         max_packet_size = RTSP_TCP_MAX_PACKET_SIZE;
         break;
     default:
-        goto fail;
+        return -1;
     }
 
     http_log("%s:%d - - \"PLAY %s/streamid=%d %s\"\n",
              ipaddr, ntohs(dest_addr->sin_port),
              c->stream->filename, stream_index, c->protocol);
 
-    /* normally, no packets should be output here, but the packet size may be checked */
-    if (url_open_dyn_packet_buf(&ctx->pb, max_packet_size) < 0) {
-        /* XXX: close stream */
-        goto fail;
-    }
-    av_set_parameters(ctx, NULL);
-    if (av_write_header(ctx) < 0) {
-    fail:
+    /* now we can open the relevant output stream */
+    ctx = rtp_open_muxer(c->stream, stream_index, max_packet_size);
+    if (!ctx) {
         if (h)
             url_close(h);
-        av_free(ctx);
+        c->rtp_handles[stream_index] = NULL;
         return -1;
     }
-    url_close_dyn_buf(ctx->pb, &dummy_buf);
-    av_free(dummy_buf);
+    av_strlcpy(ctx->filename, filename, sizeof(ctx->filename));
 
     c->rtp_ctx[stream_index] = ctx;
     return 0;
@@ -3898,6 +4712,27 @@ static int parse_ffconfig(const char *filename)
                     inet_ntoa(my_http_addr.sin_addr),
                     ntohs(my_http_addr.sin_port), feed->filename);
             }
+        } else if (!strcasecmp(cmd, "Encode")) {
+            if (feed) {
+#if HAVE_PTHREADS
+                get_arg(arg, sizeof(arg), &p);
+                av_freep(&feed->encode_input);
+                feed->encode_input = av_strdup(arg);
+                get_arg(arg, sizeof(arg), &p);
+                if (arg[0]) {
+                    feed->encode_ifmt = av_find_input_format(arg);
+                    if (!feed->encode_ifmt) {
+                        fprintf(stderr, "%s:%d: Unknown input format: %s\n",
+                                filename, line_num, arg);
+                        errors++;
+                    }
+                }
+#else
+                fprintf(stderr, "%s:%d: Encode requires thread support\n",
+                        filename, line_num);
+                errors++;
+#endif
+            }
         } else if (!strcasecmp(cmd, "ReadOnlyFile")) {
             if (feed) {
                 get_arg(feed->feed_filename, sizeof(feed->feed_filename), &p);
@@ -4484,6 +5319,9 @@ int main(int argc, char **argv)
     struct sigaction sigact;
 
     av_register_all();
+#if HAVE_PTHREADS
+    av_lockmgr_register(ffserver_lockmgr);
+#endif
 
     show_banner();
 
@@ -30,7 +30,7 @@
 #include "libavutil/avutil.h"
 
 #define LIBAVCODEC_VERSION_MAJOR 52
-#define LIBAVCODEC_VERSION_MINOR 43
+#define LIBAVCODEC_VERSION_MINOR 47
 #define LIBAVCODEC_VERSION_MICRO  0
 
 #define LIBAVCODEC_VERSION_INT  AV_VERSION_INT(LIBAVCODEC_VERSION_MAJOR, \
@@ -581,6 +581,7 @@ typedef struct RcOverride{
 #define CODEC_FLAG2_CHUNKS        0x00008000 ///< Input bitstream might be truncated at a packet boundaries instead of only at frame boundaries.
 #define CODEC_FLAG2_NON_LINEAR_QUANT 0x00010000 ///< Use MPEG-2 nonlinear quantizer.
 #define CODEC_FLAG2_BIT_RESERVOIR 0x00020000 ///< Use a bit reservoir when encoding if possible
+#define CODEC_FLAG2_WAVEFRONT     0x00040000 ///< Encode macroblock rows in parallel instead of slices, needs avcodec_thread_init() with pthreads
 
 /* Unsupported options :
  *              Syntax Arithmetic coding (SAC)
@@ -618,6 +619,11 @@ typedef struct RcOverride{
  * Codec can output multiple frames per AVPacket
  */
 #define CODEC_CAP_SUBFRAMES        0x0100
+/**
+ * Decoder can report the progress of decoding a picture row by row
+ * through the row_progress callback.
+ */
+#define CODEC_CAP_ROW_PROGRESS     0x0200
 
 //The following defines may change, don't expect compatibility if you use them.
 #define MB_TYPE_INTRA4x4   0x0001
@@ -2565,6 +2571,32 @@ typedef struct AVCodecContext {
      * - decoding: unused
      */
     int weighted_p_pred;
+
+    /**
+     * If non NULL, called by decoders with CODEC_CAP_ROW_PROGRESS each time
+     * more rows of the picture being decoded are finished, so that they can
+     * be processed before the whole picture is decoded.
+     * Unlike draw_horiz_band() it is called for every picture in decoding
+     * order, also for pictures which are only returned later because of
+     * reordering, and the rows include all in-loop filtering. The decoder
+     * does not change reported rows anymore, except for error concealment
+     * of damaged pictures. The callback must not modify the picture.
+     * - encoding: unused
+     * - decoding: Set by user.
+     * @param pic the picture being decoded, as allocated by get_buffer()
+     * @param rows number of finished rows from the top of the picture,
+     *             increases with each call for the same picture
+     */
+    void (*row_progress)(struct AVCodecContext *c, const AVFrame *pic, int rows);
+
+    /**
+     * List of CPUs the codec threads are bound to, like "0-3,8-11".
+     * Thread i runs on the (i modulo the number of CPUs)-th CPU of the list.
+     * Only supported with pthreads on systems with sched_setaffinity().
+     * - encoding: Set by user.
+     * - decoding: Set by user.
+     */
+    const char *thread_affinity;
 } AVCodecContext;
 
 /**
@@ -3712,6 +3744,18 @@ void *av_fast_realloc(void *ptr, unsigned int *size, unsigned int min_size);
  */
 void av_fast_malloc(void *ptr, unsigned int *size, unsigned int min_size);
 
+/**
+ * Compute the sums SSIM is built from for a row of 4x4 blocks.
+ * For each block x, sums[x] receives the sum of the pix1 samples, of the
+ * pix2 samples, of pix1^2 + pix2^2 and of pix1*pix2; the sum of squared
+ * errors of the block is sums[x][2] - 2*sums[x][3].
+ *
+ * @param width number of blocks, 4*width pixels are read from each row
+ */
+void avcodec_ssim_block_sums(const uint8_t *pix1, int stride1,
+                             const uint8_t *pix2, int stride2,
+                             int (*sums)[4], int width);
+
 /**
  * Copy image 'src' to 'dst'.
  */
@@ -291,6 +291,34 @@ static int sse4_c(void *v, uint8_t * pix1, uint8_t * pix2, int line_size, int h)
     return s;
 }
 
+static void ssim_4x4_core_c(const uint8_t *pix1, int stride1,
+                            const uint8_t *pix2, int stride2, int sums[4])
+{
+    int x, y;
+    int s1 = 0, s2 = 0, ss = 0, s12 = 0;
+
+    for (y = 0; y < 4; y++)
+        for (x = 0; x < 4; x++) {
+            int a = pix1[x + y*stride1];
+            int b = pix2[x + y*stride2];
+            s1  += a;
+            s2  += b;
+            ss  += a*a + b*b;
+            s12 += a*b;
+        }
+    sums[0] = s1;
+    sums[1] = s2;
+    sums[2] = ss;
+    sums[3] = s12;
+}
+
+static void ssim_4x4x2_core_c(const uint8_t *pix1, int stride1,
+                              const uint8_t *pix2, int stride2, int sums[2][4])
+{
+    ssim_4x4_core_c(pix1,     stride1, pix2,     stride2, sums[0]);
+    ssim_4x4_core_c(pix1 + 4, stride1, pix2 + 4, stride2, sums[1]);
+}
+
 static int sse8_c(void *v, uint8_t * pix1, uint8_t * pix2, int line_size, int h)
 {
     int s, i;
@@ -4320,6 +4348,18 @@ static int32_t scalarproduct_int16_c(int16_t * v1, int16_t * v2, int order, int
     return res;
 }
 
+static int32_t scalarproduct_and_madd_int16_c(int16_t *v1, int16_t *v2, int16_t *v3, int order, int mul)
+{
+    int res = 0;
+
+    while (order--) {
+        res   += *v1 * *v2++;
+        *v1++ += mul * *v3++;
+    }
+
+    return res;
+}
+
 #define W0 2048
 #define W1 2841 /* 2048*sqrt (2)*cos (1*pi/16) */
 #define W2 2676 /* 2048*sqrt (2)*cos (2*pi/16) */
@@ -4453,6 +4493,9 @@ static void ff_jref_idct1_add(uint8_t *dest, int line_size, DCTELEM *block)
 static void just_return(void *mem av_unused, int stride av_unused, int h av_unused) { return; }
 
 /* init static data */
+static void (*ssim_4x4x2_core)(const uint8_t *pix1, int stride1,
+                               const uint8_t *pix2, int stride2, int sums[2][4]);
+
 void dsputil_static_init(void)
 {
     int i;
@@ -4468,6 +4511,29 @@ void dsputil_static_init(void)
     }
 
     for(i=0; i<64; i++) inv_zigzag_direct16[ff_zigzag_direct[i]]= i+1;
+
+    {
+        /* pick the SSIM core for avcodec_ssim_block_sums() once, so that
+           callers on any thread only read it afterwards */
+        AVCodecContext avctx;
+        DSPContext dsp;
+
+        avcodec_get_context_defaults(&avctx);
+        dsputil_init(&dsp, &avctx);
+        ssim_4x4x2_core= dsp.ssim_4x4x2_core;
+    }
+}
+
+void avcodec_ssim_block_sums(const uint8_t *pix1, int stride1,
+                             const uint8_t *pix2, int stride2,
+                             int (*sums)[4], int width)
+{
+    int x;
+
+    for (x = 0; x + 1 < width; x += 2)
+        ssim_4x4x2_core(pix1 + 4*x, stride1, pix2 + 4*x, stride2, sums + x);
+    if (x < width)
+        ssim_4x4_core_c(pix1 + 4*x, stride1, pix2 + 4*x, stride2, sums[x]);
 }
 
 int ff_check_alignment(void){
@@ -4765,6 +4831,7 @@ void dsputil_init(DSPContext* c, AVCodecContext *avctx)
     c->sse[0]= sse16_c;
     c->sse[1]= sse8_c;
     c->sse[2]= sse4_c;
+    c->ssim_4x4x2_core= ssim_4x4x2_core_c;
     SET_CMP_FUNC(quant_psnr)
     SET_CMP_FUNC(rd)
     SET_CMP_FUNC(bit)
@@ -4851,6 +4918,7 @@ void dsputil_init(DSPContext* c, AVCodecContext *avctx)
     c->add_int16 = add_int16_c;
     c->sub_int16 = sub_int16_c;
     c->scalarproduct_int16 = scalarproduct_int16_c;
+    c->scalarproduct_and_madd_int16 = scalarproduct_and_madd_int16_c;
     c->scalarproduct_float = scalarproduct_float_c;
     c->butterflies_float = butterflies_float_c;
     c->vector_fmul_scalar = vector_fmul_scalar_c;
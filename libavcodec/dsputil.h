@@ -214,6 +214,13 @@ typedef struct DSPContext {
     void (*clear_blocks)(DCTELEM *blocks/*align 16*/);
     int (*pix_sum)(uint8_t * pix, int line_size);
     int (*pix_norm1)(uint8_t * pix, int line_size);
+    /**
+     * Computes for two horizontally adjacent 4x4 blocks the sums of pix1,
+     * of pix2, of pix1^2 + pix2^2 and of pix1*pix2, from which SSIM and
+     * the sum of squared errors (sums[2] - 2*sums[3]) are derived.
+     */
+    void (*ssim_4x4x2_core)(const uint8_t *pix1, int stride1,
+                            const uint8_t *pix2, int stride2, int sums[2][4]);
 // 16x16 8x8 4x4 2x2 16x8 8x4 4x2 8x16 4x8 2x4
 
     me_cmp_func sad[6]; /* identical to pix_absAxA except additional void * */
@@ -577,6 +584,13 @@ typedef struct DSPContext {
      * @param shift number of bits to discard from product
      */
     int32_t (*scalarproduct_int16)(int16_t *v1, int16_t *v2/*align 16*/, int len, int shift);
+    /**
+     * Calculate scalar product of v1 and v2,
+     * and v1[i] += v3[i] * mul
+     * in a single pass over the vectors.
+     * @param len length of vectors, should be multiple of 16
+     */
+    int32_t (*scalarproduct_and_madd_int16)(int16_t *v1/*align 16*/, int16_t *v2, int16_t *v3, int len, int mul);
 
     /* rv30 functions */
     qpel_mc_func put_rv30_tpel_pixels_tab[4][16];
@@ -52,6 +52,10 @@ typedef struct{
     int *utility_inc;
     int *nearest_cb;
     int *points;
+    int *dist_cb;
+    int numpoints;
+    int jobs;
+    int warm;      ///< nearest_cb holds the assignment of the previous step
     AVLFG *rand_state;
 } elbg_data;
 
@@ -314,10 +318,50 @@ static void do_shiftings(elbg_data *elbg)
         }
 }
 
+/**
+ * Find the nearest codebook entry for the points of one job.
+ * The search is seeded with a likely candidate (the previous assignment of
+ * the point, or the entry picked for the preceding point) so that
+ * distance_limited() can reject most of the other entries early. Ties are
+ * resolved towards the lowest index, as an unseeded search would.
+ */
+static int voronoi_partition_thread(AVCodecContext *avctx, void *arg,
+                                    int jobnr, int threadnr)
+{
+    elbg_data *elbg = arg;
+    int dim   = elbg->dim;
+    int start = (int64_t) jobnr    * elbg->numpoints / elbg->jobs;
+    int end   = (int64_t)(jobnr+1) * elbg->numpoints / elbg->jobs;
+    int i, k, dist, pick = 0;
+
+    for (i=start; i < end; i++) {
+        int *point = elbg->points + i*dim;
+        int best;
+
+        if (elbg->warm)
+            pick = elbg->nearest_cb[i];
+        best = distance_limited(point, elbg->codebook + pick*dim, dim, INT_MAX);
+
+        for (k=0; k < elbg->numCB; k++) {
+            if (k == pick)
+                continue;
+            dist = distance_limited(point, elbg->codebook + k*dim, dim, best);
+            if (dist < best || (dist == best && k < pick)) {
+                best = dist;
+                pick = k;
+            }
+        }
+        elbg->dist_cb[i]    = best;
+        elbg->nearest_cb[i] = pick;
+    }
+
+    return 0;
+}
+
 #define BIG_PRIME 433494437LL
 
-void ff_init_elbg(int *points, int dim, int numpoints, int *codebook,
-                  int numCB, int max_steps, int *closest_cb,
+void ff_init_elbg(AVCodecContext *avctx, int *points, int dim, int numpoints,
+                  int *codebook, int numCB, int max_steps, int *closest_cb,
                   AVLFG *rand_state)
 {
     int i, k;
@@ -331,8 +375,8 @@ void ff_init_elbg(int *points, int dim, int numpoints, int *codebook,
             memcpy(temp_points + i*dim, points + k*dim, dim*sizeof(int));
         }
 
-        ff_init_elbg(temp_points, dim, numpoints/8, codebook, numCB, 2*max_steps, closest_cb, rand_state);
-        ff_do_elbg(temp_points, dim, numpoints/8, codebook, numCB, 2*max_steps, closest_cb, rand_state);
+        ff_init_elbg(avctx, temp_points, dim, numpoints/8, codebook, numCB, 2*max_steps, closest_cb, rand_state);
+        ff_do_elbg(avctx, temp_points, dim, numpoints/8, codebook, numCB, 2*max_steps, closest_cb, rand_state);
 
         av_free(temp_points);
 
@@ -343,14 +387,13 @@ void ff_init_elbg(int *points, int dim, int numpoints, int *codebook,
 
 }
 
-void ff_do_elbg(int *points, int dim, int numpoints, int *codebook,
-                int numCB, int max_steps, int *closest_cb,
+void ff_do_elbg(AVCodecContext *avctx, int *points, int dim, int numpoints,
+                int *codebook, int numCB, int max_steps, int *closest_cb,
                 AVLFG *rand_state)
 {
-    int dist;
     elbg_data elbg_d;
     elbg_data *elbg = &elbg_d;
-    int i, j, k, last_error, steps=0;
+    int i, j, last_error, steps=0;
     int *dist_cb = av_malloc(numpoints*sizeof(int));
     int *size_part = av_malloc(numCB*sizeof(int));
     cell *list_buffer = av_malloc(numpoints*sizeof(cell));
@@ -365,6 +408,10 @@ void ff_do_elbg(int *points, int dim, int numpoints, int *codebook,
     elbg->nearest_cb = closest_cb;
     elbg->points = points;
     elbg->utility_inc = av_malloc(numCB*sizeof(int));
+    elbg->dist_cb = dist_cb;
+    elbg->numpoints = numpoints;
+    elbg->jobs = avctx ? FFMAX(FFMIN(avctx->thread_count, numpoints), 1) : 1;
+    elbg->warm = 0;
 
     elbg->rand_state = rand_state;
 
@@ -377,17 +424,18 @@ void ff_do_elbg(int *points, int dim, int numpoints, int *codebook,
 
         elbg->error = 0;
 
-        /* This loop evaluate the actual Voronoi partition. It is the most
-           costly part of the algorithm. */
+        /* Evaluating the Voronoi partition is the most costly part of the
+           algorithm, so it is split across the codec threads. The cells are
+           then linked serially so that the result does not depend on the
+           number of jobs. */
+        if (avctx)
+            avctx->execute2(avctx, voronoi_partition_thread, elbg, NULL, elbg->jobs);
+        else
+            for (i=0; i < elbg->jobs; i++)
+                voronoi_partition_thread(NULL, elbg, i, 0);
+        elbg->warm = 1;
+
         for (i=0; i < numpoints; i++) {
-            dist_cb[i] = INT_MAX;
-            for (k=0; k < elbg->numCB; k++) {
-                dist = distance_limited(elbg->points + i*elbg->dim, elbg->codebook + k*elbg->dim, dim, dist_cb[i]);
-                if (dist < dist_cb[i]) {
-                    dist_cb[i] = dist;
-                    elbg->nearest_cb[i] = k;
-                }
-            }
             elbg->error += dist_cb[i];
             elbg->utility[elbg->nearest_cb[i]] += dist_cb[i];
             free_cells->index = i;
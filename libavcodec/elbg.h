@@ -22,12 +22,15 @@
 #define AVCODEC_ELBG_H
 
 #include "libavutil/lfg.h"
+#include "avcodec.h"
 
 /**
  * Implementation of the Enhanced LBG Algorithm
  * Based on the paper "Neural Networks 14:1219-1237" that can be found in
  * http://citeseer.ist.psu.edu/patan01enhanced.html .
  *
+ * @param avctx Codec context whose execute2() is used to search the nearest
+ *              codebook entries in parallel, or NULL to run single-threaded.
  * @param points Input points.
  * @param dim Dimension of the points.
  * @param numpoints Num of points in **points.
@@ -37,8 +40,8 @@
  * @param closest_cb Return the closest codebook to each point. Must be allocated.
  * @param rand_state A random number generator state. Should be already initialized by av_lfg_init().
  */
-void ff_do_elbg(int *points, int dim, int numpoints, int *codebook,
-                int numCB, int num_steps, int *closest_cb,
+void ff_do_elbg(AVCodecContext *avctx, int *points, int dim, int numpoints,
+                int *codebook, int numCB, int num_steps, int *closest_cb,
                 AVLFG *rand_state);
 
 /**
@@ -48,8 +51,8 @@ void ff_do_elbg(int *points, int dim, int numpoints, int *codebook,
  * If not, it calls ff_do_elbg for a (smaller) random sample of the points in
  * **points. Get the same parameters as ff_do_elbg.
  */
-void ff_init_elbg(int *points, int dim, int numpoints, int *codebook,
-                  int numCB, int num_steps, int *closest_cb,
+void ff_init_elbg(AVCodecContext *avctx, int *points, int dim, int numpoints,
+                  int *codebook, int numCB, int num_steps, int *closest_cb,
                   AVLFG *rand_state);
 
 #endif /* AVCODEC_ELBG_H */
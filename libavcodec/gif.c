@@ -25,8 +25,11 @@
  * First version by Francois Revol revol@free.fr
  *
  * Features and limitations:
- * - currently no compression is performed,
- *   in fact the size of the data is 9/8 the size of the image in 8bpp
+ * - LZW compression through lzwenc, in GIF mode
+ * - with several threads, the image is cut in horizontal bands which are
+ *   compressed independently; each band except the last ends with clear
+ *   codes up to a byte boundary, so the bands simply append to a single
+ *   valid LZW stream
  * - uses only a global standard palette
  * - tested with IE 5.0, Opera for BeOS, NetPositive (BeOS), and Mozilla (BeOS).
  *
@@ -34,11 +37,6 @@
  * http://www.goice.co.jp/member/mo/formats/gif.html
  * http://astronomy.swin.edu.au/pbourke/dataformats/gif/
  * http://www.dcs.ed.ac.uk/home/mxr/gfx/2d/GIF89a.txt
- *
- * this url claims to have an LZW algorithm not covered by Unisys patent:
- * http://www.msg.net/utility/whirlgif/gifencod.html
- * could help reduce the size of the files _a lot_...
- * some sites mentions an RLE type compression also.
  */
 
 #include "avcodec.h"
@@ -49,9 +47,29 @@
 #define BITSTREAM_WRITER_LE
 
 #include "put_bits.h"
+#include "lzw.h"
+
+/* do not cut the image in bands smaller than this, the dictionary would
+ * be reset too often */
+#define GIF_MIN_BAND_HEIGHT 16
+#define GIF_MAX_BANDS       16
+
+typedef struct {
+    struct LZWEncodeState *lzw;
+    uint8_t *buf;               ///< compressed band
+    int buf_size;
+    const uint8_t *src;
+    int linesize;
+    int height;
+    int last;                   ///< last band, terminated by the end code
+    int size;                   ///< number of bytes in buf, -1 on error
+} GIFBand;
 
-/* bitstream minipacket size */
-#define GIF_CHUNKS 100
+typedef struct {
+    AVFrame picture;
+    GIFBand *bands;
+    int nb_bands;
+} GIFContext;
 
 /* GIF header */
 static int gif_image_write_header(uint8_t **bytestream,
@@ -79,74 +97,128 @@ static int gif_image_write_header(uint8_t **bytestream,
     return 0;
 }
 
-static int gif_image_write_image(uint8_t **bytestream,
-                                 int x1, int y1, int width, int height,
-                                 const uint8_t *buf, int linesize, int pix_fmt)
+static int gif_encode_band(AVCodecContext *avctx, void *arg)
 {
-    PutBitContext p;
-    uint8_t buffer[200]; /* 100 * 9 / 8 = 113 */
-    int i, left, w;
-    const uint8_t *ptr;
-    /* image block */
+    GIFBand *b = arg;
+    const uint8_t *ptr = b->src;
+    int y, ret, size = 0;
+
+    ff_lzw_encode_init(b->lzw, b->buf, b->buf_size, 12, FF_LZW_GIF, put_bits);
+    for (y = 0; y < b->height; y++) {
+        if ((ret = ff_lzw_encode(b->lzw, ptr, avctx->width)) < 0)
+            goto fail;
+        size += ret;
+        ptr  += b->linesize;
+    }
+    if (b->last)
+        ret = ff_lzw_encode_flush(b->lzw, flush_put_bits);
+    else
+        ret = ff_lzw_encode_split(b->lzw, flush_put_bits);
+    if (ret < 0)
+        goto fail;
+    b->size = size + ret;
+    return 0;
+fail:
+    b->size = -1;
+    return -1;
+}
+
+static int gif_image_write_image(AVCodecContext *avctx,
+                                 uint8_t **bytestream, uint8_t *end,
+                                 const uint8_t *buf, int linesize)
+{
+    GIFContext *s = avctx->priv_data;
+    uint8_t *data = s->bands[0].buf;
+    int i, y, len, size;
 
+    for (i = y = 0; i < s->nb_bands; i++) {
+        GIFBand *b = &s->bands[i];
+        b->src      = buf + y * linesize;
+        b->linesize = linesize;
+        b->height   = (avctx->height * (i + 1)) / s->nb_bands - y;
+        b->last     = i == s->nb_bands - 1;
+        y += b->height;
+    }
+    avctx->execute(avctx, gif_encode_band, s->bands, NULL, s->nb_bands, sizeof(GIFBand));
+
+    /* gather the bands behind the first one */
+    len = 0;
+    for (i = 0; i < s->nb_bands; i++) {
+        if (s->bands[i].size < 0) {
+            av_log(avctx, AV_LOG_ERROR, "LZW compression failed\n");
+            return -1;
+        }
+        if (i)
+            memmove(data + len, s->bands[i].buf, s->bands[i].size);
+        len += s->bands[i].size;
+    }
+
+    /* image block */
+    if (end - *bytestream < 10 + 1 + len + (len + 254) / 255 + 2) {
+        av_log(avctx, AV_LOG_ERROR, "output buffer too small\n");
+        return -1;
+    }
     bytestream_put_byte(bytestream, 0x2c);
-    bytestream_put_le16(bytestream, x1);
-    bytestream_put_le16(bytestream, y1);
-    bytestream_put_le16(bytestream, width);
-    bytestream_put_le16(bytestream, height);
+    bytestream_put_le16(bytestream, 0);
+    bytestream_put_le16(bytestream, 0);
+    bytestream_put_le16(bytestream, avctx->width);
+    bytestream_put_le16(bytestream, avctx->height);
     bytestream_put_byte(bytestream, 0x00); /* flags */
     /* no local clut */
 
     bytestream_put_byte(bytestream, 0x08);
 
-    left= width * height;
-
-    init_put_bits(&p, buffer, 130);
-
-/*
- * the thing here is the bitstream is written as little packets, with a size byte before
- * but it's still the same bitstream between packets (no flush !)
- */
-    ptr = buf;
-    w = width;
-    while(left>0) {
-
-        put_bits(&p, 9, 0x0100); /* clear code */
-
-        for(i=(left<GIF_CHUNKS)?left:GIF_CHUNKS;i;i--) {
-            put_bits(&p, 9, *ptr++);
-            if (--w == 0) {
-                w = width;
-                buf += linesize;
-                ptr = buf;
-            }
-        }
-
-        if(left<=GIF_CHUNKS) {
-            put_bits(&p, 9, 0x101); /* end of stream */
-            flush_put_bits(&p);
-        }
-        if(put_bits_ptr(&p) - p.buf > 0) {
-            bytestream_put_byte(bytestream, put_bits_ptr(&p) - p.buf); /* byte count of the packet */
-            bytestream_put_buffer(bytestream, p.buf, put_bits_ptr(&p) - p.buf); /* the actual buffer */
-            p.buf_ptr = p.buf; /* dequeue the bytes off the bitstream */
-        }
-        left-=GIF_CHUNKS;
+    /* the bitstream is written as little packets, with a size byte before */
+    while (len > 0) {
+        size = FFMIN(255, len);
+        bytestream_put_byte(bytestream, size);
+        bytestream_put_buffer(bytestream, data, size);
+        data += size;
+        len  -= size;
     }
     bytestream_put_byte(bytestream, 0x00); /* end of image block */
     bytestream_put_byte(bytestream, 0x3b);
     return 0;
 }
 
-typedef struct {
-    AVFrame picture;
-} GIFContext;
+static av_cold int gif_encode_close(AVCodecContext *avctx)
+{
+    GIFContext *s = avctx->priv_data;
+    int i;
+
+    for (i = 0; s->bands && i < s->nb_bands; i++) {
+        av_freep(&s->bands[i].buf);
+        av_freep(&s->bands[i].lzw);
+    }
+    av_freep(&s->bands);
+    return 0;
+}
 
 static av_cold int gif_encode_init(AVCodecContext *avctx)
 {
     GIFContext *s = avctx->priv_data;
+    int i, band_height;
 
     avctx->coded_frame = &s->picture;
+
+    s->nb_bands = av_clip(FFMIN(avctx->thread_count, avctx->height / GIF_MIN_BAND_HEIGHT),
+                          1, GIF_MAX_BANDS);
+    s->bands = av_mallocz(s->nb_bands * sizeof(GIFBand));
+    if (!s->bands)
+        return AVERROR(ENOMEM);
+    /* a code is at most 12 bits for one pixel, the first band buffer
+     * also gathers the whole stream */
+    band_height = (avctx->height + s->nb_bands - 1) / s->nb_bands;
+    for (i = 0; i < s->nb_bands; i++) {
+        GIFBand *b = &s->bands[i];
+        b->buf_size = avctx->width * (i ? band_height : avctx->height) * 2 + 64;
+        b->buf      = av_malloc(b->buf_size);
+        b->lzw      = av_malloc(ff_lzw_encode_state_size);
+        if (!b->buf || !b->lzw) {
+            gif_encode_close(avctx);
+            return AVERROR(ENOMEM);
+        }
+    }
     return 0;
 }
 
@@ -157,12 +229,18 @@ static int gif_encode_frame(AVCodecContext *avctx, unsigned char *outbuf, int bu
     AVFrame *pict = data;
     AVFrame *const p = (AVFrame *)&s->picture;
     uint8_t *outbuf_ptr = outbuf;
+    uint8_t *end = outbuf + buf_size;
 
     *p = *pict;
     p->pict_type = FF_I_TYPE;
     p->key_frame = 1;
+    if (buf_size < 13 + 256 * 3) {
+        av_log(avctx, AV_LOG_ERROR, "output buffer too small\n");
+        return -1;
+    }
     gif_image_write_header(&outbuf_ptr, avctx->width, avctx->height, (uint32_t *)pict->data[1]);
-    gif_image_write_image(&outbuf_ptr, 0, 0, avctx->width, avctx->height, pict->data[0], pict->linesize[0], PIX_FMT_PAL8);
+    if (gif_image_write_image(avctx, &outbuf_ptr, end, pict->data[0], pict->linesize[0]) < 0)
+        return -1;
     return outbuf_ptr - outbuf;
 }
 
@@ -173,7 +251,66 @@ AVCodec gif_encoder = {
     sizeof(GIFContext),
     gif_encode_init,
     gif_encode_frame,
-    NULL, //encode_end,
+    gif_encode_close,
     .pix_fmts= (const enum PixelFormat[]){PIX_FMT_RGB8, PIX_FMT_BGR8, PIX_FMT_RGB4_BYTE, PIX_FMT_BGR4_BYTE, PIX_FMT_GRAY8, PIX_FMT_PAL8, PIX_FMT_NONE},
     .long_name= NULL_IF_CONFIG_SMALL("GIF (Graphics Interchange Format)"),
 };
+
+#ifdef TEST
+#undef printf
+#include <stdio.h>
+#include "libavutil/lfg.h"
+
+#define TEST_SIZE 4400
+#define TEST_TAIL 1000
+
+/**
+ * Cut random data in two bands at every position and check that the joined
+ * stream decodes back, which covers bands ending on code size changes.
+ */
+int main(void)
+{
+    static uint8_t src[TEST_SIZE + TEST_TAIL], dst[TEST_SIZE + TEST_TAIL];
+    static uint8_t lzw[2 * (TEST_SIZE + TEST_TAIL) + 64];
+    static uint8_t gif[2 * (TEST_SIZE + TEST_TAIL) + 64 + 256];
+    struct LZWEncodeState *enc = av_malloc(ff_lzw_encode_state_size);
+    LZWState *dec;
+    AVLFG prng;
+    uint8_t *ptr;
+    int i, split, len, size, ret = 0;
+
+    av_lfg_init(&prng, 1);
+    for (i = 0; i < sizeof(src); i++)
+        src[i] = av_lfg_get(&prng);
+    ff_lzw_decode_open(&dec);
+
+    for (split = 1; split <= TEST_SIZE; split++) {
+        ff_lzw_encode_init(enc, lzw, sizeof(lzw), 12, FF_LZW_GIF, put_bits);
+        len  = ff_lzw_encode(enc, src, split);
+        len += ff_lzw_encode_split(enc, flush_put_bits);
+        ff_lzw_encode_init(enc, lzw + len, sizeof(lzw) - len, 12, FF_LZW_GIF, put_bits);
+        len += ff_lzw_encode(enc, src + split, TEST_TAIL);
+        len += ff_lzw_encode_flush(enc, flush_put_bits);
+
+        ptr = gif;
+        for (i = 0; i < len; i += size) {
+            size = FFMIN(255, len - i);
+            bytestream_put_byte(&ptr, size);
+            bytestream_put_buffer(&ptr, lzw + i, size);
+        }
+        bytestream_put_byte(&ptr, 0);
+
+        memset(dst, 0, sizeof(dst));
+        ff_lzw_decode_init(dec, 8, gif, ptr - gif, FF_LZW_GIF);
+        if (ff_lzw_decode(dec, dst, split + TEST_TAIL) != split + TEST_TAIL ||
+            memcmp(src, dst, split + TEST_TAIL)) {
+            printf("band split at %d failed\n", split);
+            ret = 1;
+        }
+    }
+
+    ff_lzw_decode_close(&dec);
+    av_free(enc);
+    return ret;
+}
+#endif /* TEST */
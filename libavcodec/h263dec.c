@@ -55,6 +55,11 @@ av_cold int ff_h263_decode_init(AVCodecContext *avctx)
     s->low_delay= 1;
     avctx->pix_fmt= avctx->get_format(avctx, avctx->codec->pix_fmts);
     s->unrestricted_mv= 1;
+    /* motion compensation emulates the edges for the few blocks reaching
+     * outside the picture, no need to draw edges per frame unless the
+     * caller gets to see them in its own buffers */
+    if (avctx->get_buffer == avcodec_default_get_buffer)
+        s->emu_edge = CODEC_FLAG_EMU_EDGE;
 
     /* select sub codec */
     switch(avctx->codec->id) {
@@ -346,7 +351,7 @@ int ff_h263_decode_frame(AVCodecContext *avctx,
 #ifdef PRINT_FRAME_TIME
 uint64_t time= rdtsc();
 #endif
-    s->flags= avctx->flags;
+    s->flags= avctx->flags | s->emu_edge;
     s->flags2= avctx->flags2;
 
     /* no supplementary picture */
@@ -738,7 +743,7 @@ AVCodec mpeg4_decoder = {
     NULL,
     ff_h263_decode_end,
     ff_h263_decode_frame,
-    CODEC_CAP_DRAW_HORIZ_BAND | CODEC_CAP_DR1 | CODEC_CAP_TRUNCATED | CODEC_CAP_DELAY,
+    CODEC_CAP_DRAW_HORIZ_BAND | CODEC_CAP_DR1 | CODEC_CAP_TRUNCATED | CODEC_CAP_DELAY | CODEC_CAP_ROW_PROGRESS,
     .flush= ff_mpeg_flush,
     .long_name= NULL_IF_CONFIG_SMALL("MPEG-4 part 2"),
     .pix_fmts= ff_hwaccel_pixfmt_list_420,
@@ -753,7 +758,7 @@ AVCodec h263_decoder = {
     NULL,
     ff_h263_decode_end,
     ff_h263_decode_frame,
-    CODEC_CAP_DRAW_HORIZ_BAND | CODEC_CAP_DR1 | CODEC_CAP_TRUNCATED | CODEC_CAP_DELAY,
+    CODEC_CAP_DRAW_HORIZ_BAND | CODEC_CAP_DR1 | CODEC_CAP_TRUNCATED | CODEC_CAP_DELAY | CODEC_CAP_ROW_PROGRESS,
     .flush= ff_mpeg_flush,
     .long_name= NULL_IF_CONFIG_SMALL("H.263 / H.263-1996, H.263+ / H.263-1998 / H.263 version 2"),
     .pix_fmts= ff_hwaccel_pixfmt_list_420,
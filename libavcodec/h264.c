@@ -2005,11 +2005,9 @@ static void free_tables(H264Context *h){
     }
 }
 
-static void init_dequant8_coeff_table(H264Context *h){
+static int init_dequant8_coeff_table(H264Context *h){
     int i,q,x;
     const int transpose = (h->s.dsp.h264_idct8_add != ff_h264_idct8_add_c); //FIXME ugly
-    h->dequant8_coeff[0] = h->dequant8_buffer[0];
-    h->dequant8_coeff[1] = h->dequant8_buffer[1];
 
     for(i=0; i<2; i++ ){
         if(i && !memcmp(h->pps.scaling_matrix8[0], h->pps.scaling_matrix8[1], 64*sizeof(uint8_t))){
@@ -2017,6 +2015,10 @@ static void init_dequant8_coeff_table(H264Context *h){
             break;
         }
 
+        if(!h->dequant8_buffer[i])
+            FF_ALLOC_OR_GOTO(h->s.avctx, h->dequant8_buffer[i], 52 * sizeof(*h->dequant8_buffer[i]), fail);
+        h->dequant8_coeff[i] = h->dequant8_buffer[i];
+
         for(q=0; q<52; q++){
             int shift = div6[q];
             int idx = rem6[q];
@@ -2026,13 +2028,15 @@ static void init_dequant8_coeff_table(H264Context *h){
                     h->pps.scaling_matrix8[i][x]) << shift;
         }
     }
+    return 0;
+fail:
+    return -1;
 }
 
-static void init_dequant4_coeff_table(H264Context *h){
+static int init_dequant4_coeff_table(H264Context *h){
     int i,j,q,x;
     const int transpose = (h->s.dsp.h264_idct_add != ff_h264_idct_add_c); //FIXME ugly
     for(i=0; i<6; i++ ){
-        h->dequant4_coeff[i] = h->dequant4_buffer[i];
         for(j=0; j<i; j++){
             if(!memcmp(h->pps.scaling_matrix4[j], h->pps.scaling_matrix4[i], 16*sizeof(uint8_t))){
                 h->dequant4_coeff[i] = h->dequant4_buffer[j];
@@ -2042,6 +2046,10 @@ static void init_dequant4_coeff_table(H264Context *h){
         if(j<i)
             continue;
 
+        if(!h->dequant4_buffer[i])
+            FF_ALLOC_OR_GOTO(h->s.avctx, h->dequant4_buffer[i], 52 * sizeof(*h->dequant4_buffer[i]), fail);
+        h->dequant4_coeff[i] = h->dequant4_buffer[i];
+
         for(q=0; q<52; q++){
             int shift = div6[q] + 2;
             int idx = rem6[q];
@@ -2051,13 +2059,17 @@ static void init_dequant4_coeff_table(H264Context *h){
                     h->pps.scaling_matrix4[i][x]) << shift;
         }
     }
+    return 0;
+fail:
+    return -1;
 }
 
-static void init_dequant_tables(H264Context *h){
+static int init_dequant_tables(H264Context *h){
     int i,x;
-    init_dequant4_coeff_table(h);
-    if(h->pps.transform_8x8_mode)
-        init_dequant8_coeff_table(h);
+    if(init_dequant4_coeff_table(h) < 0)
+        return -1;
+    if(h->pps.transform_8x8_mode && init_dequant8_coeff_table(h) < 0)
+        return -1;
     if(h->sps.transform_bypass){
         for(i=0; i<6; i++)
             for(x=0; x<16; x++)
@@ -2067,6 +2079,7 @@ static void init_dequant_tables(H264Context *h){
                 for(x=0; x<64; x++)
                     h->dequant8_coeff[i][0][x] = 1<<6;
     }
+    return 0;
 }
 
 
@@ -2086,9 +2099,6 @@ static int alloc_tables(H264Context *h){
     FF_ALLOCZ_OR_GOTO(h->s.avctx, h->cbp_table, big_mb_num * sizeof(uint16_t), fail)
 
     FF_ALLOCZ_OR_GOTO(h->s.avctx, h->chroma_pred_mode_table, big_mb_num * sizeof(uint8_t), fail)
-    FF_ALLOCZ_OR_GOTO(h->s.avctx, h->mvd_table[0], 32*big_mb_num * sizeof(uint16_t), fail);
-    FF_ALLOCZ_OR_GOTO(h->s.avctx, h->mvd_table[1], 32*big_mb_num * sizeof(uint16_t), fail);
-    FF_ALLOCZ_OR_GOTO(h->s.avctx, h->direct_table, 32*big_mb_num * sizeof(uint8_t) , fail);
 
     memset(h->slice_table_base, -1, (big_mb_num+s->mb_stride)  * sizeof(*h->slice_table_base));
     h->slice_table= h->slice_table_base + s->mb_stride*2 + 1;
@@ -2108,8 +2118,15 @@ static int alloc_tables(H264Context *h){
 
     s->obmc_scratchpad = NULL;
 
-    if(!h->dequant4_coeff[0])
-        init_dequant_tables(h);
+    if(!h->dequant4_coeff[0] && init_dequant_tables(h) < 0)
+        goto fail;
+
+    av_log(s->avctx, AV_LOG_DEBUG, "%d bytes of contexts, %d bytes of tables\n",
+           (int)sizeof(H264Context) * s->avctx->thread_count,
+           big_mb_num * (int)(sizeof(*h->intra4x4_pred_mode) + sizeof(*h->non_zero_count) +
+                              sizeof(*h->cbp_table) + sizeof(*h->chroma_pred_mode_table) +
+                              sizeof(*h->mb2b_xy) + sizeof(*h->mb2b8_xy)) +
+           (big_mb_num+s->mb_stride) * (int)sizeof(*h->slice_table_base));
 
     return 0;
 fail:
@@ -2117,6 +2134,36 @@ fail:
     return -1;
 }
 
+/**
+ * Allocates the tables used only by CABAC, on the first CABAC slice,
+ * and shares them with every context thread.
+ */
+static int alloc_cabac_tables(H264Context *h){
+    MpegEncContext * const s = &h->s;
+    const int big_mb_num= s->mb_stride * (s->mb_height+1);
+    int i;
+
+    FF_ALLOCZ_OR_GOTO(h->s.avctx, h->mvd_table[0], 32*big_mb_num * sizeof(uint16_t), fail);
+    FF_ALLOCZ_OR_GOTO(h->s.avctx, h->mvd_table[1], 32*big_mb_num * sizeof(uint16_t), fail);
+    FF_ALLOCZ_OR_GOTO(h->s.avctx, h->direct_table, 32*big_mb_num * sizeof(uint8_t) , fail);
+
+    av_log(s->avctx, AV_LOG_DEBUG, "%d bytes of CABAC tables\n",
+           32*big_mb_num * (int)(2*sizeof(uint16_t) + sizeof(uint8_t)));
+
+    for(i = 1; i < s->avctx->thread_count; i++) {
+        H264Context *hx = h->thread_context[i];
+        hx->mvd_table[0] = h->mvd_table[0];
+        hx->mvd_table[1] = h->mvd_table[1];
+        hx->direct_table = h->direct_table;
+    }
+    return 0;
+fail:
+    av_freep(&h->mvd_table[0]);
+    av_freep(&h->mvd_table[1]);
+    av_freep(&h->direct_table);
+    return -1;
+}
+
 /**
  * Mimic alloc_tables(), but for every context thread.
  */
@@ -2199,6 +2246,11 @@ static av_cold int decode_init(AVCodecContext *avctx){
     s->low_delay= 1;
 
     avctx->chroma_sample_location = AVCHROMA_LOC_LEFT;
+    /* mc_dir_part() emulates the edges for the few blocks reaching outside
+     * the picture, no need to draw edges per frame unless the caller gets
+     * to see them in its own buffers */
+    if (avctx->get_buffer == avcodec_default_get_buffer)
+        s->emu_edge = CODEC_FLAG_EMU_EDGE;
 
     decode_init_vlc();
 
@@ -3780,8 +3832,9 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
     h->sps = *h0->sps_buffers[h->pps.sps_id];
 
     if(h == h0 && h->dequant_coeff_pps != pps_id){
+        if(init_dequant_tables(h) < 0)
+            return -1;
         h->dequant_coeff_pps = pps_id;
-        init_dequant_tables(h);
     }
 
     s->mb_width= h->sps.mb_width;
@@ -3847,6 +3900,9 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
                 return -1;
     }
 
+    if(h->pps.cabac && !h0->mvd_table[0] && alloc_cabac_tables(h0) < 0)
+        return -1;
+
     h->frame_num= get_bits(&s->gb, h->sps.log2_max_frame_num);
 
     h->mb_mbaff = 0;
@@ -6672,6 +6728,22 @@ static void filter_mb( H264Context *h, int mb_x, int mb_y, uint8_t *img_y, uint8
 #endif
 }
 
+/**
+ * Reports the rows of the current picture up to and including the
+ * macroblock row mb_y as finished, as far as deblocking allows.
+ */
+static void report_row_progress(H264Context *h, int mb_y){
+    MpegEncContext * const s = &h->s;
+    int rows = ((mb_y >> FIELD_OR_MBAFF_PICTURE) + 1) << (4 + FIELD_OR_MBAFF_PICTURE);
+
+    if(FIELD_PICTURE && s->first_field)
+        return;
+    /* deblocking the next row changes the bottom of this one */
+    if(h->deblocking_filter && rows < s->avctx->height)
+        rows -= 16 << FIELD_OR_MBAFF_PICTURE;
+    ff_report_row_progress(s, rows);
+}
+
 static int decode_slice(struct AVCodecContext *avctx, void *arg){
     H264Context *h = *(void**)arg;
     MpegEncContext * const s = &h->s;
@@ -6734,6 +6806,8 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg){
             if( ++s->mb_x >= s->mb_width ) {
                 s->mb_x = 0;
                 ff_draw_horiz_band(s, 16*s->mb_y, 16);
+                if(h->report_rows)
+                    report_row_progress(h, s->mb_y);
                 ++s->mb_y;
                 if(FIELD_OR_MBAFF_PICTURE) {
                     ++s->mb_y;
@@ -6771,6 +6845,8 @@ static int decode_slice(struct AVCodecContext *avctx, void *arg){
             if(++s->mb_x >= s->mb_width){
                 s->mb_x=0;
                 ff_draw_horiz_band(s, 16*s->mb_y, 16);
+                if(h->report_rows)
+                    report_row_progress(h, s->mb_y);
                 ++s->mb_y;
                 if(FIELD_OR_MBAFF_PICTURE) {
                     ++s->mb_y;
@@ -7450,6 +7526,7 @@ static void execute_decode_slices(H264Context *h, int context_count){
         return;
     if(s->avctx->codec->capabilities&CODEC_CAP_HWACCEL_VDPAU)
         return;
+    h->report_rows = context_count == 1;
     if(context_count == 1) {
         decode_slice(avctx, &h);
     } else {
@@ -7470,6 +7547,11 @@ static void execute_decode_slices(H264Context *h, int context_count){
         s->picture_structure = hx->s.picture_structure;
         for(i = 1; i < context_count; i++)
             h->s.error_count += h->thread_context[i]->s.error_count;
+
+        /* the slices were decoded in parallel, rows above the end of the
+           last one are finished now */
+        if(s->mb_y >= 1 << FIELD_OR_MBAFF_PICTURE)
+            report_row_progress(h, s->mb_y - (1 << FIELD_OR_MBAFF_PICTURE));
     }
 }
 
@@ -7706,7 +7788,7 @@ static int decode_frame(AVCodecContext *avctx,
     AVFrame *pict = data;
     int buf_index;
 
-    s->flags= avctx->flags;
+    s->flags= avctx->flags | s->emu_edge;
     s->flags2= avctx->flags2;
 
    /* end of stream, output what is still in the buffers */
@@ -8140,6 +8222,11 @@ av_cold void ff_h264_free_context(H264Context *h)
 
     free_tables(h); //FIXME cleanup init stuff perhaps
 
+    for(i = 0; i < 6; i++)
+        av_freep(&h->dequant4_buffer[i]);
+    for(i = 0; i < 2; i++)
+        av_freep(&h->dequant8_buffer[i]);
+
     for(i = 0; i < MAX_SPS_COUNT; i++)
         av_freep(h->sps_buffers + i);
 
@@ -8171,7 +8258,7 @@ AVCodec h264_decoder = {
     NULL,
     decode_end,
     decode_frame,
-    /*CODEC_CAP_DRAW_HORIZ_BAND |*/ CODEC_CAP_DR1 | CODEC_CAP_DELAY,
+    /*CODEC_CAP_DRAW_HORIZ_BAND |*/ CODEC_CAP_DR1 | CODEC_CAP_DELAY | CODEC_CAP_ROW_PROGRESS,
     .flush= flush_dpb,
     .long_name = NULL_IF_CONFIG_SMALL("H.264 / AVC / MPEG-4 AVC / MPEG-4 part 10"),
     .pix_fmts= ff_hwaccel_pixfmt_list_420,
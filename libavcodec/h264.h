@@ -332,8 +332,8 @@ typedef struct H264Context{
      */
     PPS pps; //FIXME move to Picture perhaps? (->no) do we need that?
 
-    uint32_t dequant4_buffer[6][52][16];
-    uint32_t dequant8_buffer[2][52][64];
+    uint32_t (*dequant4_buffer[6])[16]; ///< allocated for the distinct scaling matrices only
+    uint32_t (*dequant8_buffer[2])[64];
     uint32_t (*dequant4_coeff[6])[16];
     uint32_t (*dequant8_coeff[2])[64];
     int dequant_coeff_pps;     ///< reinit tables when pps changes
@@ -446,9 +446,9 @@ typedef struct H264Context{
     /* chroma_pred_mode for i4x4 or i16x16, else 0 */
     uint8_t     *chroma_pred_mode_table;
     int         last_qscale_diff;
-    int16_t     (*mvd_table[2])[2];
+    int16_t     (*mvd_table[2])[2]; ///< allocated on the first CABAC slice
     DECLARE_ALIGNED_8(int16_t, mvd_cache[2][5*8][2]);
-    uint8_t     *direct_table;
+    uint8_t     *direct_table;      ///< allocated on the first CABAC slice
     uint8_t     direct_cache[5*8];
 
     uint8_t zigzag_scan[16];
@@ -492,6 +492,12 @@ typedef struct H264Context{
     int single_decode_warning;
 
     int last_slice_type;
+
+    /**
+     * 1 if decode_slice() reports finished rows itself, which is only
+     * possible when slices are decoded one after another.
+     */
+    int report_rows;
     /** @} */
 
     int mb_xy;
@@ -42,4 +42,19 @@ int ff_is_hwaccel_pix_fmt(enum PixelFormat pix_fmt);
  */
 AVHWAccel *ff_find_hwaccel(enum CodecID codec_id, enum PixelFormat pix_fmt);
 
+/**
+ * Sets *progress to n and wakes up the threads waiting for it in
+ * ff_thread_await_progress().
+ * Only available with pthreads, after avcodec_thread_init().
+ */
+void ff_thread_report_progress(AVCodecContext *avctx, int *progress, int n);
+
+/**
+ * Waits until another job of the same execute() call has set *progress
+ * to at least n with ff_thread_report_progress().
+ * This may only be used if all jobs run at the same time, that is with
+ * pthreads and no more jobs than threads, otherwise it can deadlock.
+ */
+void ff_thread_await_progress(AVCodecContext *avctx, int *progress, int n);
+
 #endif /* AVCODEC_INTERNAL_H */
@@ -61,6 +61,7 @@ struct LZWState {
     uint8_t stack[LZW_SIZTABLE];
     uint8_t suffix[LZW_SIZTABLE];
     uint16_t prefix[LZW_SIZTABLE];
+    uint16_t length[LZW_SIZTABLE];  ///< length of the string of each code
     int bs;                     ///< current buffer size for GIF
 };
 
@@ -130,6 +131,7 @@ av_cold void ff_lzw_decode_close(LZWState **p)
 int ff_lzw_decode_init(LZWState *p, int csize, const uint8_t *buf, int buf_size, int mode)
 {
     struct LZWState *s = (struct LZWState *)p;
+    int i;
 
     if(csize < 1 || csize >= LZW_MAXBITS)
         return -1;
@@ -150,6 +152,8 @@ int ff_lzw_decode_init(LZWState *p, int csize, const uint8_t *buf, int buf_size,
     s->slot = s->newcodes = s->clear_code + 2;
     s->oc = s->fc = -1;
     s->sp = s->stack;
+    for (i = 0; i < s->newcodes; i++)
+        s->length[i] = 1;
 
     s->mode = mode;
     s->extra_slot = s->mode == FF_LZW_TIFF;
@@ -167,8 +171,8 @@ int ff_lzw_decode_init(LZWState *p, int csize, const uint8_t *buf, int buf_size,
  * @return number of bytes decoded
  */
 int ff_lzw_decode(LZWState *p, uint8_t *buf, int len){
-    int l, c, code, oc, fc;
-    uint8_t *sp;
+    int l, c, code, oc, fc, n;
+    uint8_t *sp, *dst;
     struct LZWState *s = (struct LZWState *)p;
 
     if (s->end_code < 0)
@@ -197,17 +201,39 @@ int ff_lzw_decode(LZWState *p, uint8_t *buf, int len){
         } else {
             code = c;
             if (code == s->slot && fc>=0) {
-                *sp++ = fc;
-                code = oc;
+                n = s->length[oc] + 1;
             }else if(code >= s->slot)
                 break;
-            while (code >= s->newcodes) {
-                *sp++ = s->suffix[code];
-                code = s->prefix[code];
+            else
+                n = s->length[code];
+            if (n <= l) {
+                /* the whole string fits, write it directly from its end */
+                dst = buf + n;
+                if (code == s->slot) {
+                    *--dst = fc;
+                    code = oc;
+                }
+                while (code >= s->newcodes) {
+                    *--dst = s->suffix[code];
+                    code = s->prefix[code];
+                }
+                *--dst = code;
+                buf += n;
+                l   -= n;
+            } else {
+                if (code == s->slot) {
+                    *sp++ = fc;
+                    code = oc;
+                }
+                while (code >= s->newcodes) {
+                    *sp++ = s->suffix[code];
+                    code = s->prefix[code];
+                }
+                *sp++ = code;
             }
-            *sp++ = code;
             if (s->slot < s->top_slot && oc>=0) {
                 s->suffix[s->slot] = code;
+                s->length[s->slot] = s->length[oc] + 1;
                 s->prefix[s->slot++] = oc;
             }
             fc = code;
@@ -218,6 +244,8 @@ int ff_lzw_decode(LZWState *p, uint8_t *buf, int len){
                     s->curmask = mask[++s->cursize];
                 }
             }
+            if (!l)
+                goto the_end;
         }
     }
     s->end_code = -1;
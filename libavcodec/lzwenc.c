@@ -35,21 +35,14 @@
 #define LZW_HASH_SHIFT 6
 
 #define LZW_PREFIX_EMPTY -1
-#define LZW_PREFIX_FREE -2
-
-/** One code in hash table */
-typedef struct Code{
-    /// Hash code of prefix, LZW_PREFIX_EMPTY if empty prefix, or LZW_PREFIX_FREE if no code
-    int hash_prefix;
-    int code;               ///< LZW code
-    uint8_t suffix;         ///< Last character in code block
-}Code;
 
 /** LZW encode state */
 typedef struct LZWEncodeState {
     int clear_code;          ///< Value of clear code
     int end_code;            ///< Value of end code
-    Code tab[LZW_HASH_SIZE]; ///< Hash table
+    /// Hash table of the strings, (prefix + 1) << 8 | last character, 0 if no code
+    uint32_t tab_key[LZW_HASH_SIZE];
+    int16_t tab_code[LZW_HASH_SIZE]; ///< LZW code of the strings in the hash table
     int tabsize;             ///< Number of values in hash table
     int bits;                ///< Actual bits code
     int bufsize;             ///< Size of output buffer
@@ -58,6 +51,8 @@ typedef struct LZWEncodeState {
     int maxcode;             ///< Max value of code
     int output_bytes;        ///< Number of written bytes
     int last_code;           ///< Value of last output code or LZW_PREFIX_EMPTY
+    enum FF_LZW_MODES mode;  ///< TIFF or GIF
+    void (*put_bits)(PutBitContext *, int, unsigned); ///< GIF is LE while TIFF is BE
 }LZWEncodeState;
 
 
@@ -110,28 +105,24 @@ static inline int hashOffset(const int head)
 static inline void writeCode(LZWEncodeState * s, int c)
 {
     assert(0 <= c && c < 1 << s->bits);
-    put_bits(&s->pb, s->bits, c);
+    s->put_bits(&s->pb, s->bits, c);
 }
 
 
 /**
  * Find LZW code for block
  * @param s LZW state
- * @param c Last character in block
- * @param hash_prefix LZW code for prefix
- * @return LZW code for block or -1 if not found in table
+ * @param key Key of the block, as stored in tab_key
+ * @param h Hash of the block
+ * @return Position of the block in the hash table, or of the free slot
+ *         where it should be added
  */
-static inline int findCode(LZWEncodeState * s, uint8_t c, int hash_prefix)
+static inline int findCode(LZWEncodeState * s, uint32_t key, int h)
 {
-    int h = hash(FFMAX(hash_prefix, 0), c);
     int hash_offset = hashOffset(h);
 
-    while (s->tab[h].hash_prefix != LZW_PREFIX_FREE) {
-        if ((s->tab[h].suffix == c)
-            && (s->tab[h].hash_prefix == hash_prefix))
-            return h;
+    while (s->tab_key[h] && s->tab_key[h] != key)
         h = hashNext(h, hash_offset);
-    }
 
     return h;
 }
@@ -139,19 +130,30 @@ static inline int findCode(LZWEncodeState * s, uint8_t c, int hash_prefix)
 /**
  * Add block to LZW code table
  * @param s LZW state
- * @param c Last character in block
- * @param hash_prefix LZW code for prefix
- * @param hash_code LZW code for bytes block
+ * @param key Key of the block, as stored in tab_key
+ * @param hash_code Position of the block in the hash table
  */
-static inline void addCode(LZWEncodeState * s, uint8_t c, int hash_prefix, int hash_code)
+static inline void addCode(LZWEncodeState * s, uint32_t key, int hash_code)
 {
-    s->tab[hash_code].code = s->tabsize;
-    s->tab[hash_code].suffix = c;
-    s->tab[hash_code].hash_prefix = hash_prefix;
+    s->tab_key[hash_code] = key;
+    s->tab_code[hash_code] = s->tabsize;
 
     s->tabsize++;
 
-    if (s->tabsize >= 1 << s->bits)
+    /* TIFF switches to the next code size one code early */
+    if (s->tabsize >= (1 << s->bits) + (s->mode == FF_LZW_GIF))
+        s->bits++;
+}
+
+/**
+ * Widen the codes after the last code of a GIF stream: the decoder adds a
+ * table entry when it reads that code, which the encoder never does
+ * @param s LZW state
+ */
+static inline void gifFinalCodeSize(LZWEncodeState * s)
+{
+    if (s->mode == FF_LZW_GIF && s->tabsize >= 1 << s->bits &&
+        s->bits < s->maxbits)
         s->bits++;
 }
 
@@ -161,19 +163,10 @@ static inline void addCode(LZWEncodeState * s, uint8_t c, int hash_prefix, int h
  */
 static void clearTable(LZWEncodeState * s)
 {
-    int i, h;
-
     writeCode(s, s->clear_code);
     s->bits = 9;
-    for (i = 0; i < LZW_HASH_SIZE; i++) {
-        s->tab[i].hash_prefix = LZW_PREFIX_FREE;
-    }
-    for (i = 0; i < 256; i++) {
-        h = hash(0, i);
-        s->tab[h].code = i;
-        s->tab[h].suffix = i;
-        s->tab[h].hash_prefix = LZW_PREFIX_EMPTY;
-    }
+    /* single characters are their own code and are not stored */
+    memset(s->tab_key, 0, sizeof(s->tab_key));
     s->tabsize = 258;
 }
 
@@ -190,13 +183,17 @@ static int writtenBytes(LZWEncodeState *s){
 }
 
 /**
- * Initialize LZW encoder. Please set s->clear_code, s->end_code and s->maxbits before run.
+ * Initialize LZW encoder
  * @param s LZW state
  * @param outbuf Output buffer
  * @param outsize Size of output buffer
  * @param maxbits Maximum length of code
+ * @param mode FF_LZW_GIF or FF_LZW_TIFF
+ * @param lzw_put_bits put_bits() of the bitstream order of the format
  */
-void ff_lzw_encode_init(LZWEncodeState * s, uint8_t * outbuf, int outsize, int maxbits)
+void ff_lzw_encode_init(LZWEncodeState * s, uint8_t * outbuf, int outsize,
+                        int maxbits, enum FF_LZW_MODES mode,
+                        void (*lzw_put_bits)(PutBitContext *, int, unsigned))
 {
     s->clear_code = 256;
     s->end_code = 257;
@@ -208,6 +205,8 @@ void ff_lzw_encode_init(LZWEncodeState * s, uint8_t * outbuf, int outsize, int m
     s->output_bytes = 0;
     s->last_code = LZW_PREFIX_EMPTY;
     s->bits = 9;
+    s->mode = mode;
+    s->put_bits = lzw_put_bits;
 }
 
 /**
@@ -225,20 +224,27 @@ int ff_lzw_encode(LZWEncodeState * s, const uint8_t * inbuf, int insize)
         return -1;
     }
 
-    if (s->last_code == LZW_PREFIX_EMPTY)
+    if (!insize)
+        return writtenBytes(s);
+
+    if (s->last_code == LZW_PREFIX_EMPTY) {
         clearTable(s);
+        s->last_code = *inbuf++;
+        insize--;
+    }
 
     for (i = 0; i < insize; i++) {
         uint8_t c = *inbuf++;
-        int code = findCode(s, c, s->last_code);
-        if (s->tab[code].hash_prefix == LZW_PREFIX_FREE) {
+        uint32_t key = (s->last_code + 1) << 8 | c;
+        int code = findCode(s, key, hash(s->last_code, c));
+        if (s->tab_key[code]) {
+            s->last_code = s->tab_code[code];
+        } else {
             writeCode(s, s->last_code);
-            addCode(s, c, s->last_code, code);
-            code= hash(0, c);
-        }
-        s->last_code = s->tab[code].code;
-        if (s->tabsize >= s->maxcode - 1) {
-            clearTable(s);
+            addCode(s, key, code);
+            s->last_code = c;
+            if (s->tabsize >= s->maxcode - 1)
+                clearTable(s);
         }
     }
 
@@ -248,14 +254,44 @@ int ff_lzw_encode(LZWEncodeState * s, const uint8_t * inbuf, int insize)
 /**
  * Write end code and flush bitstream
  * @param s LZW state
+ * @param lzw_flush_put_bits flush_put_bits() of the bitstream order of the format
  * @return Number of bytes written or -1 on error
  */
-int ff_lzw_encode_flush(LZWEncodeState * s)
+int ff_lzw_encode_flush(LZWEncodeState * s,
+                        void (*lzw_flush_put_bits)(PutBitContext *))
 {
-    if (s->last_code != -1)
+    if (s->last_code != -1) {
         writeCode(s, s->last_code);
+        gifFinalCodeSize(s);
+    }
     writeCode(s, s->end_code);
-    flush_put_bits(&s->pb);
+    lzw_flush_put_bits(&s->pb);
+    s->last_code = -1;
+
+    return writtenBytes(s);
+}
+
+/**
+ * Terminate the stream with clear codes instead of the end code, padded
+ * to a byte boundary, so that the output of another encoder can simply be
+ * appended to it. Clear codes after the first one are 9 bits wide, so
+ * at most 7 of them are needed for the padding.
+ * @param s LZW state
+ * @param lzw_flush_put_bits flush_put_bits() of the bitstream order of the format
+ * @return Number of bytes written or -1 on error
+ */
+int ff_lzw_encode_split(LZWEncodeState * s,
+                        void (*lzw_flush_put_bits)(PutBitContext *))
+{
+    if (s->last_code != -1) {
+        writeCode(s, s->last_code);
+        gifFinalCodeSize(s);
+    }
+    writeCode(s, s->clear_code);
+    s->bits = 9;
+    while (put_bits_count(&s->pb) & 7)
+        writeCode(s, s->clear_code);
+    lzw_flush_put_bits(&s->pb);
     s->last_code = -1;
 
     return writtenBytes(s);
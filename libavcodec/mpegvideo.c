@@ -465,7 +465,7 @@ av_cold int MPV_common_init(MpegEncContext *s)
     dsputil_init(&s->dsp, s->avctx);
     ff_dct_common_init(s);
 
-    s->flags= s->avctx->flags;
+    s->flags= s->avctx->flags | s->emu_edge;
     s->flags2= s->avctx->flags2;
 
     s->mb_width  = (s->width  + 15) / 16;
@@ -874,6 +874,7 @@ int MPV_frame_start(MpegEncContext *s, AVCodecContext *avctx)
     int i;
     Picture *pic;
     s->mb_skipped = 0;
+    s->rows_reported = 0;
 
     assert(s->last_picture_ptr==NULL || s->out_format != FMT_H264 || s->codec_id == CODEC_ID_SVQ3);
 
@@ -2039,11 +2040,45 @@ void MPV_decode_mb(MpegEncContext *s, DCTELEM block[12][64]){
     else                  MPV_decode_mb_internal(s, block, 0, 0);
 }
 
+/**
+ * Passes the number of finished rows of the current picture to the
+ * row_progress() callback of decoders supporting it.
+ * @param rows number of rows from the top of the frame which decoding
+ *             the rest of the picture will not change anymore
+ */
+void ff_report_row_progress(MpegEncContext *s, int rows){
+    if (!s->avctx->row_progress || s->avctx->hwaccel ||
+        !(s->avctx->codec->capabilities & CODEC_CAP_ROW_PROGRESS))
+        return;
+
+    rows = FFMIN(rows, s->avctx->height);
+    if (rows <= s->rows_reported)
+        return;
+    s->rows_reported = rows;
+
+    emms_c();
+
+    s->avctx->row_progress(s->avctx, (AVFrame*)s->current_picture_ptr, rows);
+}
+
 /**
  *
  * @param h is the normal height, this will be reduced automatically if needed for the last row
  */
 void ff_draw_horiz_band(MpegEncContext *s, int y, int h){
+    if (s->avctx->row_progress && s->out_format != FMT_H264 && !s->slice_threads) {
+        const int field_pic = s->picture_structure != PICT_FRAME;
+        int rows = y + h;
+
+        /* the in-loop filters of H.263 and VC-1 change the bottom of a row
+           while filtering the top of the next one */
+        if ((s->loop_filter || s->codec_id == CODEC_ID_VC1 || s->codec_id == CODEC_ID_WMV3) &&
+            rows < (s->avctx->height >> field_pic))
+            rows = y;
+        /* with field pictures frame rows are only finished in the second field */
+        if (!field_pic || !s->first_field)
+            ff_report_row_progress(s, rows << field_pic);
+    }
     if (s->avctx->draw_horiz_band) {
         AVFrame *src;
         const int field_pic= s->picture_structure != PICT_FRAME;
@@ -215,6 +215,7 @@ typedef struct MpegEncContext {
     int encoding;     ///< true if we are encoding (vs decoding)
     int flags;        ///< AVCodecContext.flags (HQ, MV4, ...)
     int flags2;       ///< AVCodecContext.flags2
+    int emu_edge;     ///< CODEC_FLAG_EMU_EDGE if the decoder emulates edges on its own, added to flags
     int max_b_frames; ///< max number of b-frames for encoding
     int luma_elim_threshold;
     int chroma_elim_threshold;
@@ -251,6 +252,14 @@ typedef struct MpegEncContext {
     int end_mb_y;              ///< end   mb_y of this thread (so current thread should process start_mb_y <= row < end_mb_y)
     struct MpegEncContext *thread_context[MAX_THREADS];
 
+    /* wavefront encoding, thread i encodes the MB rows i, i+thread_count, ... */
+    int wavefront;             ///< encode MB rows in parallel with a 2 MB lag instead of in slices
+    int *wavefront_progress;   ///< number of finished MBs of each row
+    uint8_t **wavefront_row_buf; ///< start of the bitstream of each row
+    int *wavefront_row_bits;   ///< length in bits of the bitstream of each row
+    uint8_t *wavefront_buf;    ///< buffer the rows are encoded into before being concatenated
+    unsigned int wavefront_buf_size;
+
     /**
      * copy of the previous picture structure.
      * note, linesize & data, might not match the previous picture (for field pictures)
@@ -278,6 +287,8 @@ typedef struct MpegEncContext {
     Picture *last_picture_ptr;     ///< pointer to the previous picture.
     Picture *next_picture_ptr;     ///< pointer to the next picture (for bidir pred)
     Picture *current_picture_ptr;  ///< pointer to the current picture
+    int rows_reported;             ///< rows of the current picture passed to AVCodecContext.row_progress()
+    int slice_threads;             ///< slices are decoded in parallel, rows are reported once all of them are done
     uint8_t *visualization_buffer[3]; //< temporary buffer vor MV visualization
     int last_dc[3];                ///< last DC values for MPEG1
     int16_t *dc_val_base;
@@ -694,6 +705,7 @@ void MPV_common_init_arm(MpegEncContext *s);
 void MPV_common_init_altivec(MpegEncContext *s);
 void ff_clean_intra_table_entries(MpegEncContext *s);
 void ff_draw_horiz_band(MpegEncContext *s, int y, int h);
+void ff_report_row_progress(MpegEncContext *s, int rows);
 void ff_mpeg_flush(AVCodecContext *avctx);
 void ff_print_debug_info(MpegEncContext *s, AVFrame *pict);
 void ff_write_quant_matrix(PutBitContext *pb, uint16_t *matrix);
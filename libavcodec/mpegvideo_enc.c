@@ -36,6 +36,7 @@
 #include "h263.h"
 #include "faandct.h"
 #include "aandcttab.h"
+#include "internal.h"
 #include <limits.h>
 
 //#undef NDEBUG
@@ -199,6 +200,8 @@ static void update_duplicate_context_after_me(MpegEncContext *dst, MpegEncContex
     COPY(frame_pred_frame_dct); //FIXME don't set in encode_header
     COPY(progressive_frame); //FIXME don't set in encode_header
     COPY(partitioned_frame); //FIXME don't set in encode_header
+    COPY(y_dc_scale_table); //FIXME don't set in encode_header
+    COPY(c_dc_scale_table); //FIXME don't set in encode_header
 #undef COPY
 }
 
@@ -434,7 +437,30 @@ av_cold int MPV_encode_init(AVCodecContext *avctx)
         }
     }
 
-    if(s->avctx->thread_count > 1 && s->codec_id != CODEC_ID_MPEG4
+    if(s->avctx->thread_count > 1 && (s->flags2 & CODEC_FLAG2_WAVEFRONT)){
+        if(   s->codec_id != CODEC_ID_MPEG4 && s->codec_id != CODEC_ID_MPEG2VIDEO
+           && s->codec_id != CODEC_ID_H263  && s->codec_id != CODEC_ID_H263P
+           && s->codec_id != CODEC_ID_FLV1){
+            av_log(avctx, AV_LOG_ERROR, "wavefront encoding not supported by codec\n");
+            return -1;
+        }
+        /* the quantizer of the first MB of a row would depend on the end of the previous row */
+        if(s->adaptive_quant || (s->flags & CODEC_FLAG_QP_RD)){
+            av_log(avctx, AV_LOG_ERROR, "wavefront encoding does not support adaptive quantization\n");
+            return -1;
+        }
+        if(s->data_partitioning || avctx->rtp_payload_size || avctx->rtp_callback){
+            av_log(avctx, AV_LOG_ERROR, "wavefront encoding does not support data partitioning and RTP\n");
+            return -1;
+        }
+        if(!HAVE_PTHREADS || !avctx->thread_opaque){
+            av_log(avctx, AV_LOG_ERROR, "wavefront encoding needs pthreads\n");
+            return -1;
+        }
+        s->wavefront= 1;
+    }
+
+    if(s->avctx->thread_count > 1 && !s->wavefront && s->codec_id != CODEC_ID_MPEG4
        && s->codec_id != CODEC_ID_MPEG1VIDEO && s->codec_id != CODEC_ID_MPEG2VIDEO
        && (s->codec_id != CODEC_ID_H263P || !(s->flags & CODEC_FLAG_H263P_SLICE_STRUCT))){
         av_log(avctx, AV_LOG_ERROR, "multi threaded encoding not supported by codec\n");
@@ -446,7 +472,7 @@ av_cold int MPV_encode_init(AVCodecContext *avctx)
         return -1;
     }
 
-    if(s->avctx->thread_count > 1)
+    if(s->avctx->thread_count > 1 && !s->wavefront)
         s->rtp_mode= 1;
 
     if(!avctx->time_base.den || !avctx->time_base.num){
@@ -716,6 +742,14 @@ av_cold int MPV_encode_init(AVCodecContext *avctx)
                        s->inter_matrix, s->inter_quant_bias, avctx->qmin, 31, 0);
     }
 
+    if(s->wavefront){
+        s->wavefront_progress= av_malloc(s->mb_height * sizeof(int));
+        s->wavefront_row_buf = av_malloc(s->mb_height * sizeof(uint8_t*));
+        s->wavefront_row_bits= av_malloc(s->mb_height * sizeof(int));
+        if(!s->wavefront_progress || !s->wavefront_row_buf || !s->wavefront_row_bits)
+            return -1;
+    }
+
     if(ff_rate_control_init(s) < 0)
         return -1;
 
@@ -728,6 +762,11 @@ av_cold int MPV_encode_end(AVCodecContext *avctx)
 
     ff_rate_control_uninit(s);
 
+    av_freep(&s->wavefront_progress);
+    av_freep(&s->wavefront_row_buf);
+    av_freep(&s->wavefront_row_bits);
+    av_freep(&s->wavefront_buf);
+
     MPV_common_end(s);
     if ((CONFIG_MJPEG_ENCODER || CONFIG_LJPEG_ENCODER) && s->out_format == FMT_MJPEG)
         ff_mjpeg_encode_close(s);
@@ -1203,6 +1242,9 @@ int MPV_encode_picture(AVCodecContext *avctx,
 
         init_put_bits(&s->thread_context[i]->pb, start, end - start);
     }
+    /* the rows are only concatenated into buf by the main context */
+    if(s->wavefront)
+        init_put_bits(&s->pb, buf, buf_size);
 
     s->picture_in_gop_number++;
 
@@ -1909,33 +1951,53 @@ static int sse_mb(MpegEncContext *s){
                +sse(s, s->new_picture.data[2] + s->mb_x*8  + s->mb_y*s->uvlinesize*8,s->dest[2], w>>1, h>>1, s->uvlinesize);
 }
 
-static int pre_estimate_motion_thread(AVCodecContext *c, void *arg){
-    MpegEncContext *s= *(void**)arg;
-
+/**
+ * Runs the motion estimation pre-pass from the bottom right, on the MB
+ * rows last_mb_y, last_mb_y - mb_y_step, ... down to first_mb_y.
+ */
+static void pre_estimate_motion_rows(MpegEncContext *s, int first_mb_y, int last_mb_y, int mb_y_step){
 
     s->me.pre_pass=1;
     s->me.dia_size= s->avctx->pre_dia_size;
-    s->first_slice_line=1;
-    for(s->mb_y= s->end_mb_y-1; s->mb_y >= s->start_mb_y; s->mb_y--) {
+    s->first_slice_line= !s->wavefront || last_mb_y == s->mb_height-1;
+    for(s->mb_y= last_mb_y; s->mb_y >= first_mb_y; s->mb_y -= mb_y_step) {
         for(s->mb_x=s->mb_width-1; s->mb_x >=0 ;s->mb_x--) {
+            /* the predictors are the MBs right, below and below left */
+            if(HAVE_PTHREADS && s->wavefront && s->mb_y < s->mb_height-1)
+                ff_thread_await_progress(s->avctx, &s->wavefront_progress[s->mb_y+1], FFMIN(s->mb_width - s->mb_x + 1, s->mb_width));
             ff_pre_estimate_p_frame_motion(s, s->mb_x, s->mb_y);
+            if(HAVE_PTHREADS && s->wavefront)
+                ff_thread_report_progress(s->avctx, &s->wavefront_progress[s->mb_y], s->mb_width - s->mb_x);
         }
         s->first_slice_line=0;
     }
 
     s->me.pre_pass=0;
+}
 
+static int pre_estimate_motion_thread(AVCodecContext *c, void *arg){
+    MpegEncContext *s= *(void**)arg;
+    pre_estimate_motion_rows(s, s->start_mb_y, s->end_mb_y-1, 1);
     return 0;
 }
 
-static int estimate_motion_thread(AVCodecContext *c, void *arg){
-    MpegEncContext *s= *(void**)arg;
+static int pre_estimate_motion_wavefront(AVCodecContext *c, void *arg, int jobnr, int threadnr){
+    MpegEncContext *s= ((MpegEncContext**)arg)[jobnr];
+    pre_estimate_motion_rows(s, 0, s->mb_height-1-jobnr, c->thread_count);
+    return 0;
+}
+
+/**
+ * Estimates the motion of the MB rows first_mb_y, first_mb_y + mb_y_step, ...
+ * below end_mb_y.
+ */
+static void estimate_motion_rows(MpegEncContext *s, int first_mb_y, int end_mb_y, int mb_y_step){
 
     ff_check_alignment();
 
     s->me.dia_size= s->avctx->dia_size;
-    s->first_slice_line=1;
-    for(s->mb_y= s->start_mb_y; s->mb_y < s->end_mb_y; s->mb_y++) {
+    s->first_slice_line= !s->wavefront || !first_mb_y;
+    for(s->mb_y= first_mb_y; s->mb_y < end_mb_y; s->mb_y += mb_y_step) {
         s->mb_x=0; //for block init below
         ff_init_block_index(s);
         for(s->mb_x=0; s->mb_x < s->mb_width; s->mb_x++) {
@@ -1944,17 +2006,44 @@ static int estimate_motion_thread(AVCodecContext *c, void *arg){
             s->block_index[2]+=2;
             s->block_index[3]+=2;
 
+            /* the predictors are the MBs left, above and above right */
+            if(HAVE_PTHREADS && s->wavefront && s->mb_y)
+                ff_thread_await_progress(s->avctx, &s->wavefront_progress[s->mb_y-1], FFMIN(s->mb_x+2, s->mb_width));
+
             /* compute motion vector & mb_type and store in context */
             if(s->pict_type==FF_B_TYPE)
                 ff_estimate_b_frame_motion(s, s->mb_x, s->mb_y);
             else
                 ff_estimate_p_frame_motion(s, s->mb_x, s->mb_y);
+
+            if(HAVE_PTHREADS && s->wavefront)
+                ff_thread_report_progress(s->avctx, &s->wavefront_progress[s->mb_y], s->mb_x+1);
         }
         s->first_slice_line=0;
     }
+}
+
+static int estimate_motion_thread(AVCodecContext *c, void *arg){
+    MpegEncContext *s= *(void**)arg;
+    estimate_motion_rows(s, s->start_mb_y, s->end_mb_y, 1);
+    return 0;
+}
+
+static int estimate_motion_wavefront(AVCodecContext *c, void *arg, int jobnr, int threadnr){
+    MpegEncContext *s= ((MpegEncContext**)arg)[jobnr];
+    estimate_motion_rows(s, jobnr, s->mb_height, c->thread_count);
     return 0;
 }
 
+/**
+ * Runs func on every thread context, one job per thread, with all the
+ * rows marked as not started.
+ */
+static void execute_wavefront(MpegEncContext *s, int (*func)(AVCodecContext *c, void *arg, int jobnr, int threadnr), int *ret){
+    memset(s->wavefront_progress, 0, s->mb_height*sizeof(int));
+    s->avctx->execute2(s->avctx, func, s->thread_context, ret, s->avctx->thread_count);
+}
+
 static int mb_var_thread(AVCodecContext *c, void *arg){
     MpegEncContext *s= *(void**)arg;
     int mb_x, mb_y;
@@ -1997,8 +2086,10 @@ static void write_slice_end(MpegEncContext *s){
         s->misc_bits+= get_bits_diff(s);
 }
 
-static int encode_thread(AVCodecContext *c, void *arg){
-    MpegEncContext *s= *(void**)arg;
+/**
+ * Encodes the MB rows first_mb_y, first_mb_y + mb_y_step, ... below end_mb_y.
+ */
+static int encode_mb_rows(MpegEncContext *s, int first_mb_y, int end_mb_y, int mb_y_step){
     int mb_x, mb_y, pdif = 0;
     int chr_h= 16>>s->chroma_y_shift;
     int i, j;
@@ -2056,11 +2147,20 @@ static int encode_thread(AVCodecContext *c, void *arg){
     s->resync_mb_y=0;
     s->first_slice_line = 1;
     s->ptr_lastgob = s->pb.buf;
-    for(mb_y= s->start_mb_y; mb_y < s->end_mb_y; mb_y++) {
+    for(mb_y= first_mb_y; mb_y < end_mb_y; mb_y += mb_y_step) {
 //    printf("row %d at %X\n", s->mb_y, (int)s);
         s->mb_x=0;
         s->mb_y= mb_y;
 
+        if(s->wavefront){
+            /* every row gets its own byte aligned part of the buffer */
+            init_put_bits(&s->pb, put_bits_ptr(&s->pb), s->pb.buf_end - put_bits_ptr(&s->pb));
+            s->last_bits= 0;
+            s->ptr_lastgob= s->pb.buf;
+            s->first_slice_line= mb_y == s->resync_mb_y;
+            s->wavefront_row_buf[mb_y]= s->pb.buf;
+        }
+
         ff_set_qscale(s, s->qscale);
         ff_init_block_index(s);
 
@@ -2073,16 +2173,21 @@ static int encode_thread(AVCodecContext *c, void *arg){
 
             if(s->pb.buf_end - s->pb.buf - (put_bits_count(&s->pb)>>3) < MAX_MB_BYTES){
                 av_log(s->avctx, AV_LOG_ERROR, "encoded frame too large\n");
-                return -1;
+                goto fail;
             }
             if(s->data_partitioning){
                 if(   s->pb2   .buf_end - s->pb2   .buf - (put_bits_count(&s->    pb2)>>3) < MAX_MB_BYTES
                    || s->tex_pb.buf_end - s->tex_pb.buf - (put_bits_count(&s->tex_pb )>>3) < MAX_MB_BYTES){
                     av_log(s->avctx, AV_LOG_ERROR, "encoded frame too large\n");
-                    return -1;
+                    goto fail;
                 }
             }
 
+            /* MV and AC/DC prediction use the MBs above and above right,
+             * MPEG-1/2 rows start new slices and do not depend on each other */
+            if(HAVE_PTHREADS && s->wavefront && mb_y && s->out_format != FMT_MPEG1)
+                ff_thread_await_progress(s->avctx, &s->wavefront_progress[mb_y-1], FFMIN(mb_x+2, s->mb_width));
+
             s->mb_x = mb_x;
             s->mb_y = mb_y;  // moved into loop, can get changed by H.261
             ff_update_block_index(s);
@@ -2605,10 +2710,21 @@ static int encode_thread(AVCodecContext *c, void *arg){
                 if(CONFIG_ANY_H263_ENCODER && s->out_format == FMT_H263)
                     ff_h263_loop_filter(s);
             }
+            if(HAVE_PTHREADS && s->wavefront)
+                ff_thread_report_progress(s->avctx, &s->wavefront_progress[mb_y], mb_x+1);
 //printf("MB %d %d bits\n", s->mb_x+s->mb_y*s->mb_stride, put_bits_count(&s->pb));
         }
+
+        if(s->wavefront){
+            s->wavefront_row_bits[mb_y]= put_bits_count(&s->pb);
+            flush_put_bits(&s->pb);
+        }
     }
 
+    /* the main context ends the picture after concatenating the rows */
+    if(s->wavefront)
+        return 0;
+
     //not beautiful here but we must write it before flushing so it has to be here
     if (CONFIG_MSMPEG4_ENCODER && s->msmpeg4_version && s->msmpeg4_version<4 && s->pict_type == FF_I_TYPE)
         msmpeg4_encode_ext_header(s);
@@ -2625,6 +2741,23 @@ static int encode_thread(AVCodecContext *c, void *arg){
     }
 
     return 0;
+fail:
+    if(HAVE_PTHREADS && s->wavefront){
+        /* do not leave the threads encoding the following rows waiting */
+        for(; mb_y < end_mb_y; mb_y += mb_y_step)
+            ff_thread_report_progress(s->avctx, &s->wavefront_progress[mb_y], s->mb_width);
+    }
+    return -1;
+}
+
+static int encode_thread(AVCodecContext *c, void *arg){
+    MpegEncContext *s= *(void**)arg;
+    return encode_mb_rows(s, s->start_mb_y, s->end_mb_y, 1);
+}
+
+static int encode_wavefront(AVCodecContext *c, void *arg, int jobnr, int threadnr){
+    MpegEncContext *s= ((MpegEncContext**)arg)[jobnr];
+    return encode_mb_rows(s, jobnr, s->mb_height, c->thread_count);
 }
 
 #define MERGE(field) dst->field += src->field; src->field=0
@@ -2660,12 +2793,58 @@ static void merge_context_after_encode(MpegEncContext *dst, MpegEncContext *src)
         }
     }
 
+    if(dst->wavefront)
+        return;
     assert(put_bits_count(&src->pb) % 8 ==0);
     assert(put_bits_count(&dst->pb) % 8 ==0);
     ff_copy_bits(&dst->pb, src->pb.buf, put_bits_count(&src->pb));
     flush_put_bits(&dst->pb);
 }
 
+/**
+ * Encodes the MB rows in parallel with encode_wavefront() and concatenates
+ * them after the picture header.
+ */
+static int encode_picture_wavefront(MpegEncContext *s){
+    PutBitContext header_pb= s->pb;
+    int size= s->pb.buf_end - s->pb.buf;
+    int threads= s->avctx->thread_count;
+    int ret[MAX_THREADS];
+    int i, mb_y;
+
+    av_fast_malloc(&s->wavefront_buf, &s->wavefront_buf_size, size);
+    if(!s->wavefront_buf)
+        return -1;
+    for(i=0; i<threads; i++){
+        int start= (int64_t)size* i   /threads;
+        int end  = (int64_t)size*(i+1)/threads;
+        init_put_bits(&s->thread_context[i]->pb, s->wavefront_buf + start, end - start);
+    }
+    memset(s->wavefront_row_bits, 0, s->mb_height*sizeof(int));
+
+    execute_wavefront(s, encode_wavefront, ret);
+
+    s->pb= header_pb;
+    for(i=0; i<threads; i++){
+        if(ret[i] < 0)
+            return -1;
+    }
+    for(mb_y=0; mb_y<s->mb_height; mb_y++){
+        int bits= s->wavefront_row_bits[mb_y];
+        /* MPEG-2 rows start with a byte aligned slice header */
+        if(s->rtp_mode && mb_y)
+            write_slice_end(s);
+        if(s->pb.buf_end - put_bits_ptr(&s->pb) < (bits>>3) + 8){
+            av_log(s->avctx, AV_LOG_ERROR, "encoded frame too large\n");
+            return -1;
+        }
+        ff_copy_bits(&s->pb, s->wavefront_row_buf[mb_y], bits);
+        s->last_bits= put_bits_count(&s->pb);
+    }
+    write_slice_end(s);
+    return 0;
+}
+
 static int estimate_qp(MpegEncContext *s, int dry_run){
     if (s->next_lambda){
         s->current_picture_ptr->quality=
@@ -2718,7 +2897,7 @@ static void set_frame_distances(MpegEncContext * s){
 
 static int encode_picture(MpegEncContext *s, int picture_number)
 {
-    int i;
+    int i, ret= 0;
     int bits;
 
     s->picture_number = picture_number;
@@ -2772,11 +2951,17 @@ static int encode_picture(MpegEncContext *s, int picture_number)
         s->lambda2= (s->lambda2* (int64_t)s->avctx->me_penalty_compensation + 128)>>8;
         if(s->pict_type != FF_B_TYPE && s->avctx->me_threshold==0){
             if((s->avctx->pre_me && s->last_non_b_pict_type==FF_I_TYPE) || s->avctx->pre_me==2){
-                s->avctx->execute(s->avctx, pre_estimate_motion_thread, &s->thread_context[0], NULL, s->avctx->thread_count, sizeof(void*));
+                if(s->wavefront)
+                    execute_wavefront(s, pre_estimate_motion_wavefront, NULL);
+                else
+                    s->avctx->execute(s->avctx, pre_estimate_motion_thread, &s->thread_context[0], NULL, s->avctx->thread_count, sizeof(void*));
             }
         }
 
-        s->avctx->execute(s->avctx, estimate_motion_thread, &s->thread_context[0], NULL, s->avctx->thread_count, sizeof(void*));
+        if(s->wavefront)
+            execute_wavefront(s, estimate_motion_wavefront, NULL);
+        else
+            s->avctx->execute(s->avctx, estimate_motion_thread, &s->thread_context[0], NULL, s->avctx->thread_count, sizeof(void*));
     }else /* if(s->pict_type == FF_I_TYPE) */{
         /* I-Frame */
         for(i=0; i<s->mb_stride*s->mb_height; i++)
@@ -2924,12 +3109,15 @@ static int encode_picture(MpegEncContext *s, int picture_number)
     for(i=1; i<s->avctx->thread_count; i++){
         update_duplicate_context_after_me(s->thread_context[i], s);
     }
-    s->avctx->execute(s->avctx, encode_thread, &s->thread_context[0], NULL, s->avctx->thread_count, sizeof(void*));
+    if(s->wavefront)
+        ret= encode_picture_wavefront(s);
+    else
+        s->avctx->execute(s->avctx, encode_thread, &s->thread_context[0], NULL, s->avctx->thread_count, sizeof(void*));
     for(i=1; i<s->avctx->thread_count; i++){
         merge_context_after_encode(s, s->thread_context[i]);
     }
     emms_c();
-    return 0;
+    return ret;
 }
 
 void  denoise_dct_c(MpegEncContext *s, DCTELEM *block){
@@ -2976,7 +3164,9 @@ int dct_quantize_trellis_c(MpegEncContext *s,
     int last_i;
     int coeff[2][64];
     int coeff_count[64];
+    int unquant_mul[64];
     int qmul, qadd, start_i, last_non_zero, i, dc;
+    int aan_scaled, h263;
     const int esc_length= s->ac_esc_length;
     uint8_t * length;
     uint8_t * last_length;
@@ -3068,6 +3258,18 @@ int dct_quantize_trellis_c(MpegEncContext *s,
         return last_non_zero;
     }
 
+    aan_scaled= s->dsp.fdct == fdct_ifast
+#ifndef FAAN_POSTSCALE
+             || s->dsp.fdct == ff_faandct
+#endif
+             ;
+    h263= s->out_format == FMT_H263;
+    if(!h263){
+        const uint16_t *matrix= s->mb_intra ? s->intra_matrix : s->inter_matrix;
+        for(i=start_i; i<=last_non_zero; i++)
+            unquant_mul[i]= qscale * matrix[ s->dsp.idct_permutation[ scantable[i] ] ];
+    }
+
     score_tab[start_i]= 0;
     survivor[0]= start_i;
     survivor_count= 1;
@@ -3076,12 +3278,9 @@ int dct_quantize_trellis_c(MpegEncContext *s,
         int level_index, j, zero_distortion;
         int dct_coeff= FFABS(block[ scantable[i] ]);
         int best_score=256*256*256*120;
+        int best_run=0, best_level=0;
 
-        if (   s->dsp.fdct == fdct_ifast
-#ifndef FAAN_POSTSCALE
-            || s->dsp.fdct == ff_faandct
-#endif
-           )
+        if(aan_scaled)
             dct_coeff= (dct_coeff*ff_inv_aanscales[ scantable[i] ]) >> 12;
         zero_distortion= dct_coeff*dct_coeff;
 
@@ -3093,42 +3292,37 @@ int dct_quantize_trellis_c(MpegEncContext *s,
 
             assert(level);
 
-            if(s->out_format == FMT_H263){
+            if(h263){
                 unquant_coeff= alevel*qmul + qadd;
             }else{ //MPEG1
-                j= s->dsp.idct_permutation[ scantable[i] ]; //FIXME optimize
-                if(s->mb_intra){
-                        unquant_coeff = (int)(  alevel  * qscale * s->intra_matrix[j]) >> 3;
-                        unquant_coeff =   (unquant_coeff - 1) | 1;
-                }else{
-                        unquant_coeff = (((  alevel  << 1) + 1) * qscale * ((int) s->inter_matrix[j])) >> 4;
-                        unquant_coeff =   (unquant_coeff - 1) | 1;
-                }
-                unquant_coeff<<= 3;
+                if(s->mb_intra)
+                    unquant_coeff= (alevel * unquant_mul[i]) >> 3;
+                else
+                    unquant_coeff= (((alevel << 1) + 1) * unquant_mul[i]) >> 4;
+                unquant_coeff= ((unquant_coeff - 1) | 1) << 3;
             }
 
             distortion= (unquant_coeff - dct_coeff) * (unquant_coeff - dct_coeff) - zero_distortion;
             level+=64;
             if((level&(~127)) == 0){
+                /* the VLC lengths of this level, indexed by run */
+                const uint8_t *run_length     = length      + UNI_AC_ENC_INDEX(0, level);
+                const uint8_t *run_last_length= last_length + UNI_AC_ENC_INDEX(0, level);
+
                 for(j=survivor_count-1; j>=0; j--){
                     int run= i - survivor[j];
-                    int score= distortion + length[UNI_AC_ENC_INDEX(run, level)]*lambda;
-                    score += score_tab[i-run];
+                    int score= distortion + score_tab[survivor[j]];
+                    int cost= score + run_length[UNI_AC_ENC_INDEX(run, 0)]*lambda;
 
-                    if(score < best_score){
-                        best_score= score;
-                        run_tab[i+1]= run;
-                        level_tab[i+1]= level-64;
+                    if(cost < best_score){
+                        best_score= cost;
+                        best_run  = run;
+                        best_level= level-64;
                     }
-                }
-
-                if(s->out_format == FMT_H263){
-                    for(j=survivor_count-1; j>=0; j--){
-                        int run= i - survivor[j];
-                        int score= distortion + last_length[UNI_AC_ENC_INDEX(run, level)]*lambda;
-                        score += score_tab[i-run];
-                        if(score < last_score){
-                            last_score= score;
+                    if(h263){
+                        cost= score + run_last_length[UNI_AC_ENC_INDEX(run, 0)]*lambda;
+                        if(cost < last_score){
+                            last_score= cost;
                             last_run= run;
                             last_level= level-64;
                             last_i= i+1;
@@ -3139,31 +3333,26 @@ int dct_quantize_trellis_c(MpegEncContext *s,
                 distortion += esc_length*lambda;
                 for(j=survivor_count-1; j>=0; j--){
                     int run= i - survivor[j];
-                    int score= distortion + score_tab[i-run];
+                    int score= distortion + score_tab[survivor[j]];
 
                     if(score < best_score){
                         best_score= score;
-                        run_tab[i+1]= run;
-                        level_tab[i+1]= level-64;
+                        best_run  = run;
+                        best_level= level-64;
                     }
-                }
-
-                if(s->out_format == FMT_H263){
-                  for(j=survivor_count-1; j>=0; j--){
-                        int run= i - survivor[j];
-                        int score= distortion + score_tab[i-run];
-                        if(score < last_score){
-                            last_score= score;
-                            last_run= run;
-                            last_level= level-64;
-                            last_i= i+1;
-                        }
+                    if(h263 && score < last_score){
+                        last_score= score;
+                        last_run= run;
+                        last_level= level-64;
+                        last_i= i+1;
                     }
                 }
             }
         }
 
         score_tab[i+1]= best_score;
+        run_tab  [i+1]= best_run;
+        level_tab[i+1]= best_level;
 
         //Note: there is a vlc code in mpeg4 which is 1 bit shorter then another one with a shorter run and the same level
         if(last_non_zero <= 27){
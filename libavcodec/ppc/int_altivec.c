@@ -137,10 +137,44 @@ static int32_t scalarproduct_int16_altivec(int16_t * v1, int16_t * v2, int order
     return ires;
 }
 
+static int32_t scalarproduct_and_madd_int16_altivec(int16_t *v1, int16_t *v2, int16_t *v3, int order, int mul)
+{
+    int i;
+    LOAD_ZERO;
+    register vec_s16 vec1, vec2, vec3, *pv;
+    register vec_s32 res = zero_s32v;
+    union {
+        vec_s16 vmul;
+        int16_t mul[8];
+    } u;
+    int32_t ires;
+
+    for(i = 0; i < 8; i++)
+        u.mul[i] = mul;
+
+    for(i = 0; i < order; i += 8){
+        vec1 = vec_ld(0, v1);
+        pv = (vec_s16*)v2;
+        vec2 = vec_perm(pv[0], pv[1], vec_lvsl(0, v2));
+        pv = (vec_s16*)v3;
+        vec3 = vec_perm(pv[0], pv[1], vec_lvsl(0, v3));
+        res = vec_msum(vec1, vec2, res);
+        vec_st(vec_mladd(vec3, u.vmul, vec1), 0, v1);
+        v1 += 8;
+        v2 += 8;
+        v3 += 8;
+    }
+    res = vec_sums(res, zero_s32v);
+    res = vec_splat(res, 3);
+    vec_ste(res, 0, &ires);
+    return ires;
+}
+
 void int_init_altivec(DSPContext* c, AVCodecContext *avctx)
 {
     c->ssd_int8_vs_int16 = ssd_int8_vs_int16_altivec;
     c->add_int16 = add_int16_altivec;
     c->sub_int16 = sub_int16_altivec;
     c->scalarproduct_int16 = scalarproduct_int16_altivec;
+    c->scalarproduct_and_madd_int16 = scalarproduct_and_madd_int16_altivec;
 }
@@ -21,10 +21,16 @@
  * License along with FFmpeg; if not, write to the Free Software
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
+#define _GNU_SOURCE /* for sched_setaffinity() */
+#include <stdlib.h>
 #include <pthread.h>
 
 #include "avcodec.h"
 
+#if HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
+
 typedef int (action_func)(AVCodecContext *c, void *arg);
 typedef int (action_func2)(AVCodecContext *c, void *arg, int jobnr, int threadnr);
 
@@ -43,8 +49,64 @@ typedef struct ThreadContext {
     pthread_mutex_t current_job_lock;
     int current_job;
     int done;
+
+    pthread_cond_t progress_cond;
+    pthread_mutex_t progress_lock;
+
+    int affinity_parsed;
+    int *cpus;          ///< CPU for each thread, from AVCodecContext.thread_affinity
+    int nb_cpus;
 } ThreadContext;
 
+#if HAVE_SCHED_SETAFFINITY
+/**
+ * Parse a CPU list like "0-3,8-11", keeping at most max_cpus entries.
+ * @return number of CPUs, negative on error
+ */
+static int parse_cpu_list(int *cpus, int max_cpus, const char *list)
+{
+    int nb_cpus = 0;
+
+    while (*list) {
+        char *end;
+        int first = strtol(list, &end, 10), last = first;
+
+        if (end == list || first < 0)
+            return -1;
+        if (*end == '-') {
+            list = end + 1;
+            last = strtol(list, &end, 10);
+            if (end == list || last < first)
+                return -1;
+        }
+        if (last >= CPU_SETSIZE)
+            return -1;
+        for (; first <= last && nb_cpus < max_cpus; first++)
+            cpus[nb_cpus++] = first;
+        if (*end == ',')
+            end++;
+        else if (*end)
+            return -1;
+        list = end;
+    }
+    return nb_cpus;
+}
+#endif
+
+static void bind_thread(AVCodecContext *avctx, int self_id, int cpu)
+{
+#if HAVE_SCHED_SETAFFINITY
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set))
+        av_log(avctx, AV_LOG_ERROR, "Could not bind thread %d to CPU %d\n", self_id, cpu);
+    else
+        av_log(avctx, AV_LOG_VERBOSE, "thread %d bound to CPU %d\n", self_id, cpu);
+#endif
+}
+
 static void* attribute_align_arg worker(void *v)
 {
     AVCodecContext *avctx = v;
@@ -52,6 +114,7 @@ static void* attribute_align_arg worker(void *v)
     int our_job = c->job_count;
     int thread_count = avctx->thread_count;
     int self_id;
+    int bound = 0;
 
     pthread_mutex_lock(&c->current_job_lock);
     self_id = c->current_job++;
@@ -70,6 +133,10 @@ static void* attribute_align_arg worker(void *v)
         }
         pthread_mutex_unlock(&c->current_job_lock);
 
+        if (!bound && c->nb_cpus > 0)
+            bind_thread(avctx, self_id, c->cpus[self_id % c->nb_cpus]);
+        bound = 1;
+
         c->rets[our_job%c->rets_count] = c->func ? c->func(avctx, (char*)c->args + our_job*c->job_size):
                                                    c->func2(avctx, c->args, our_job, self_id);
 
@@ -100,6 +167,9 @@ void avcodec_thread_free(AVCodecContext *avctx)
     pthread_mutex_destroy(&c->current_job_lock);
     pthread_cond_destroy(&c->current_job_cond);
     pthread_cond_destroy(&c->last_job_cond);
+    pthread_mutex_destroy(&c->progress_lock);
+    pthread_cond_destroy(&c->progress_cond);
+    av_free(c->cpus);
     av_free(c->workers);
     av_freep(&avctx->thread_opaque);
 }
@@ -114,6 +184,21 @@ int avcodec_thread_execute(AVCodecContext *avctx, action_func* func, void *arg,
 
     pthread_mutex_lock(&c->current_job_lock);
 
+    /* the affinity is set after avcodec_thread_init() like the other
+       options, the threads bind themselves when they get their first job */
+    if (!c->affinity_parsed && avctx->thread_affinity) {
+#if HAVE_SCHED_SETAFFINITY
+        c->cpus = av_malloc(sizeof(*c->cpus) * avctx->thread_count);
+        if (c->cpus)
+            c->nb_cpus = parse_cpu_list(c->cpus, avctx->thread_count, avctx->thread_affinity);
+        if (c->nb_cpus < 0)
+            av_log(avctx, AV_LOG_ERROR, "Invalid thread affinity '%s'\n", avctx->thread_affinity);
+#else
+        av_log(avctx, AV_LOG_WARNING, "Thread affinity is not supported on this system\n");
+#endif
+    }
+    c->affinity_parsed = 1;
+
     c->current_job = avctx->thread_count;
     c->job_count = job_count;
     c->job_size = job_size;
@@ -140,6 +225,26 @@ int avcodec_thread_execute2(AVCodecContext *avctx, action_func2* func2, void *ar
     return avcodec_thread_execute(avctx, NULL, arg, ret, job_count, 0);
 }
 
+void ff_thread_report_progress(AVCodecContext *avctx, int *progress, int n)
+{
+    ThreadContext *c= avctx->thread_opaque;
+
+    pthread_mutex_lock(&c->progress_lock);
+    *progress = n;
+    pthread_cond_broadcast(&c->progress_cond);
+    pthread_mutex_unlock(&c->progress_lock);
+}
+
+void ff_thread_await_progress(AVCodecContext *avctx, int *progress, int n)
+{
+    ThreadContext *c= avctx->thread_opaque;
+
+    pthread_mutex_lock(&c->progress_lock);
+    while (*progress < n)
+        pthread_cond_wait(&c->progress_cond, &c->progress_lock);
+    pthread_mutex_unlock(&c->progress_lock);
+}
+
 int avcodec_thread_init(AVCodecContext *avctx, int thread_count)
 {
     int i;
@@ -164,6 +269,8 @@ int avcodec_thread_init(AVCodecContext *avctx, int thread_count)
     pthread_cond_init(&c->current_job_cond, NULL);
     pthread_cond_init(&c->last_job_cond, NULL);
     pthread_mutex_init(&c->current_job_lock, NULL);
+    pthread_cond_init(&c->progress_cond, NULL);
+    pthread_mutex_init(&c->progress_lock, NULL);
     pthread_mutex_lock(&c->current_job_lock);
     for (i=0; i<thread_count; i++) {
         if(pthread_create(&c->workers[i], NULL, worker, avctx)) {
@@ -486,11 +486,12 @@ typedef struct SnowContext{
 #define ME_CACHE_SIZE 1024
     int me_cache[ME_CACHE_SIZE];
     int me_cache_generation;
-    slice_buffer sb;
+    slice_buffer sb[MAX_PLANES];
 
     MpegEncContext m; // needed for motion estimation, should not be used for anything else, the idea is to eventually make the motion estimation independent of MpegEncContext, so this will be removed then (FIXME/XXX)
 
     uint8_t *scratchbuf;
+    int scratchbuf_count;   ///< number of per-thread scratch buffers in scratchbuf
 }SnowContext;
 
 typedef struct {
@@ -1906,7 +1907,7 @@ void ff_snow_inner_add_yblock(const uint8_t *obmc, const int obmc_stride, uint8_
 }
 
 //FIXME name cleanup (b_w, block_w, b_width stuff)
-static av_always_inline void add_yblock(SnowContext *s, int sliced, slice_buffer *sb, IDWTELEM *dst, uint8_t *dst8, const uint8_t *obmc, int src_x, int src_y, int b_w, int b_h, int w, int h, int dst_stride, int src_stride, int obmc_stride, int b_x, int b_y, int add, int offset_dst, int plane_index){
+static av_always_inline void add_yblock(SnowContext *s, uint8_t *tmp, int sliced, slice_buffer *sb, IDWTELEM *dst, uint8_t *dst8, const uint8_t *obmc, int src_x, int src_y, int b_w, int b_h, int w, int h, int dst_stride, int src_stride, int obmc_stride, int b_x, int b_y, int add, int offset_dst, int plane_index){
     const int b_width = s->b_width  << s->block_max_depth;
     const int b_height= s->b_height << s->block_max_depth;
     const int b_stride= b_width;
@@ -1916,7 +1917,6 @@ static av_always_inline void add_yblock(SnowContext *s, int sliced, slice_buffer
     BlockNode *rb= lb+1;
     uint8_t *block[4];
     int tmp_step= src_stride >= 7*MB_SIZE ? MB_SIZE : MB_SIZE*src_stride;
-    uint8_t *tmp = s->scratchbuf;
     uint8_t *ptmp;
     int x,y;
 
@@ -2063,7 +2063,7 @@ static av_always_inline void add_yblock(SnowContext *s, int sliced, slice_buffer
 #endif /* 0 */
 }
 
-static av_always_inline void predict_slice_buffered(SnowContext *s, slice_buffer * sb, IDWTELEM * old_buffer, int plane_index, int add, int mb_y){
+static av_always_inline void predict_slice_buffered(SnowContext *s, uint8_t *tmp, slice_buffer * sb, IDWTELEM * old_buffer, int plane_index, int add, int mb_y){
     Plane *p= &s->plane[plane_index];
     const int mb_w= s->b_width  << s->block_max_depth;
     const int mb_h= s->b_height << s->block_max_depth;
@@ -2108,7 +2108,7 @@ static av_always_inline void predict_slice_buffered(SnowContext *s, slice_buffer
     }
 
     for(mb_x=0; mb_x<=mb_w; mb_x++){
-        add_yblock(s, 1, sb, old_buffer, dst8, obmc,
+        add_yblock(s, tmp, 1, sb, old_buffer, dst8, obmc,
                    block_w*mb_x - block_w/2,
                    block_w*mb_y - block_w/2,
                    block_w, block_w,
@@ -2119,7 +2119,7 @@ static av_always_inline void predict_slice_buffered(SnowContext *s, slice_buffer
     }
 }
 
-static av_always_inline void predict_slice(SnowContext *s, IDWTELEM *buf, int plane_index, int add, int mb_y){
+static av_always_inline void predict_slice(SnowContext *s, uint8_t *tmp, IDWTELEM *buf, int plane_index, int add, int mb_y){
     Plane *p= &s->plane[plane_index];
     const int mb_w= s->b_width  << s->block_max_depth;
     const int mb_h= s->b_height << s->block_max_depth;
@@ -2158,7 +2158,7 @@ static av_always_inline void predict_slice(SnowContext *s, IDWTELEM *buf, int pl
     }
 
     for(mb_x=0; mb_x<=mb_w; mb_x++){
-        add_yblock(s, 0, NULL, buf, dst8, obmc,
+        add_yblock(s, tmp, 0, NULL, buf, dst8, obmc,
                    block_w*mb_x - block_w/2,
                    block_w*mb_y - block_w/2,
                    block_w, block_w,
@@ -2169,11 +2169,45 @@ static av_always_inline void predict_slice(SnowContext *s, IDWTELEM *buf, int pl
     }
 }
 
-static av_always_inline void predict_plane(SnowContext *s, IDWTELEM *buf, int plane_index, int add){
+/**
+ * Returns the scratch buffer of the given thread, or NULL if the codec
+ * has more threads than scratch buffers.
+ */
+static uint8_t *get_scratchbuf(SnowContext *s, int threadnr){
+    if(threadnr >= s->scratchbuf_count)
+        return NULL;
+    return s->scratchbuf + threadnr*s->mconly_picture.linesize[0]*7*MB_SIZE;
+}
+
+typedef struct PredictPlaneArg{
+    IDWTELEM *buf;
+    int plane_index;
+    int add;
+}PredictPlaneArg;
+
+static int predict_slice_thread(AVCodecContext *avctx, void *arg, int mb_y, int threadnr){
+    SnowContext *s = avctx->priv_data;
+    PredictPlaneArg *a = arg;
+    predict_slice(s, get_scratchbuf(s, threadnr), a->buf, a->plane_index, a->add, mb_y);
+    emms_c();
+    return 0;
+}
+
+/**
+ * Each OBMC block row only writes the lines between the centers of its
+ * blocks, so the rows of a plane are predicted in parallel.
+ */
+static void predict_plane(SnowContext *s, IDWTELEM *buf, int plane_index, int add){
     const int mb_h= s->b_height << s->block_max_depth;
     int mb_y;
-    for(mb_y=0; mb_y<=mb_h; mb_y++)
-        predict_slice(s, buf, plane_index, add, mb_y);
+
+    if(s->avctx->thread_count > 1 && s->avctx->thread_count <= s->scratchbuf_count){
+        PredictPlaneArg arg = { buf, plane_index, add };
+        s->avctx->execute2(s->avctx, predict_slice_thread, &arg, NULL, mb_h+1);
+    }else{
+        for(mb_y=0; mb_y<=mb_h; mb_y++)
+            predict_slice(s, s->scratchbuf, buf, plane_index, add, mb_y);
+    }
 }
 
 static void dequantize_slice_buffered(SnowContext *s, slice_buffer * sb, SubBand *b, IDWTELEM *src, int stride, int start_y, int end_y){
@@ -2409,7 +2443,8 @@ static av_cold int common_init(AVCodecContext *avctx){
             scale_mv_ref[i][j] = 256*(i+1)/(j+1);
 
     s->avctx->get_buffer(s->avctx, &s->mconly_picture);
-    s->scratchbuf = av_malloc(s->mconly_picture.linesize[0]*7*MB_SIZE);
+    s->scratchbuf_count = FFMAX(s->avctx->thread_count, 1);
+    s->scratchbuf = av_malloc(s->mconly_picture.linesize[0]*7*MB_SIZE*s->scratchbuf_count);
 
     return 0;
 }
@@ -2730,6 +2765,109 @@ static av_cold int decode_init(AVCodecContext *avctx)
     return 0;
 }
 
+static void decode_coeffs_plane(SnowContext *s, Plane *p){
+    int level, orientation;
+
+    for(level=0; level<s->spatial_decomposition_count; level++){
+        for(orientation=level ? 1 : 0; orientation<4; orientation++){
+            SubBand *b= &p->band[level][orientation];
+            unpack_coeffs(s, b, b->parent, orientation);
+        }
+    }
+}
+
+/**
+ * Inverse transform and motion compensate one plane whose coefficients
+ * have already been unpacked. The planes only share read-only state, so
+ * they are reconstructed in parallel.
+ */
+static int decode_plane_thread(AVCodecContext *avctx, void *arg, int plane_index, int threadnr){
+    SnowContext *s = avctx->priv_data;
+    Plane *p= &s->plane[plane_index];
+    slice_buffer *sb= &s->sb[plane_index];
+    uint8_t *tmp= get_scratchbuf(s, threadnr);
+    int w= p->width;
+    int h= p->height;
+    int x, level, orientation;
+    int decode_state[MAX_DECOMPOSITIONS][4][1]; /* Stored state info for unpack_coeffs. 1 variable per instance. */
+    const int mb_h= s->b_height << s->block_max_depth;
+    const int block_size = MB_SIZE >> s->block_max_depth;
+    const int block_w    = plane_index ? block_size/2 : block_size;
+    int mb_y;
+    DWTCompose cs[MAX_DECOMPOSITIONS];
+    int yd=0, yq=0;
+    int y;
+    int end_y;
+
+    ff_spatial_idwt_buffered_init(cs, sb, w, h, 1, s->spatial_decomposition_type, s->spatial_decomposition_count);
+    for(mb_y=0; mb_y<=mb_h; mb_y++){
+
+        int slice_starty = block_w*mb_y;
+        int slice_h = block_w*(mb_y+1);
+        if (!(s->keyframe || s->avctx->debug&512)){
+            slice_starty = FFMAX(0, slice_starty - (block_w >> 1));
+            slice_h -= (block_w >> 1);
+        }
+
+        for(level=0; level<s->spatial_decomposition_count; level++){
+            for(orientation=level ? 1 : 0; orientation<4; orientation++){
+                SubBand *b= &p->band[level][orientation];
+                int start_y;
+                int end_y;
+                int our_mb_start = mb_y;
+                int our_mb_end = (mb_y + 1);
+                const int extra= 3;
+                start_y = (mb_y ? ((block_w * our_mb_start) >> (s->spatial_decomposition_count - level)) + s->spatial_decomposition_count - level + extra: 0);
+                end_y = (((block_w * our_mb_end) >> (s->spatial_decomposition_count - level)) + s->spatial_decomposition_count - level + extra);
+                if (!(s->keyframe || s->avctx->debug&512)){
+                    start_y = FFMAX(0, start_y - (block_w >> (1+s->spatial_decomposition_count - level)));
+                    end_y = FFMAX(0, end_y - (block_w >> (1+s->spatial_decomposition_count - level)));
+                }
+                start_y = FFMIN(b->height, start_y);
+                end_y = FFMIN(b->height, end_y);
+
+                if (start_y != end_y){
+                    if (orientation == 0){
+                        SubBand * correlate_band = &p->band[0][0];
+                        int correlate_end_y = FFMIN(b->height, end_y + 1);
+                        int correlate_start_y = FFMIN(b->height, (start_y ? start_y + 1 : 0));
+                        decode_subband_slice_buffered(s, correlate_band, sb, correlate_start_y, correlate_end_y, decode_state[0][0]);
+                        correlate_slice_buffered(s, sb, correlate_band, correlate_band->ibuf, correlate_band->stride, 1, 0, correlate_start_y, correlate_end_y);
+                        dequantize_slice_buffered(s, sb, correlate_band, correlate_band->ibuf, correlate_band->stride, start_y, end_y);
+                    }
+                    else
+                        decode_subband_slice_buffered(s, b, sb, start_y, end_y, decode_state[level][orientation]);
+                }
+            }
+        }
+
+        for(; yd<slice_h; yd+=4){
+            ff_spatial_idwt_buffered_slice(&s->dsp, cs, sb, w, h, 1, s->spatial_decomposition_type, s->spatial_decomposition_count, yd);
+        }
+
+        if(s->qlog == LOSSLESS_QLOG){
+            for(; yq<slice_h && yq<h; yq++){
+                IDWTELEM * line = slice_buffer_get_line(sb, yq);
+                for(x=0; x<w; x++){
+                    line[x] <<= FRAC_BITS;
+                }
+            }
+        }
+
+        predict_slice_buffered(s, tmp, sb, s->spatial_idwt_buffer, plane_index, 1, mb_y);
+
+        y = FFMIN(p->height, slice_starty);
+        end_y = FFMIN(p->height, slice_h);
+        while(y < end_y)
+            slice_buffer_release(sb, y++);
+    }
+
+    slice_buffer_flush(sb);
+    emms_c();
+
+    return 0;
+}
+
 static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPacket *avpkt){
     const uint8_t *buf = avpkt->data;
     int buf_size = avpkt->size;
@@ -2737,7 +2875,7 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
     RangeCoder * const c= &s->c;
     int bytes_read;
     AVFrame *picture = data;
-    int level, orientation, plane_index;
+    int plane_index;
 
     ff_init_range_decoder(c, buf, buf_size);
     ff_build_rac_states(c, 0.05*(1LL<<32), 256-8);
@@ -2747,9 +2885,11 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
         return -1;
     common_init_after_header(avctx);
 
-    // realloc slice buffer for the case that spatial_decomposition_count changed
-    slice_buffer_destroy(&s->sb);
-    slice_buffer_init(&s->sb, s->plane[0].height, (MB_SIZE >> s->block_max_depth) + s->spatial_decomposition_count * 8 + 1, s->plane[0].width, s->spatial_idwt_buffer);
+    // realloc slice buffers for the case that spatial_decomposition_count changed
+    for(plane_index=0; plane_index<3; plane_index++){
+        slice_buffer_destroy(&s->sb[plane_index]);
+        slice_buffer_init(&s->sb[plane_index], s->plane[0].height, (MB_SIZE >> s->block_max_depth) + s->spatial_decomposition_count * 8 + 1, s->plane[0].width, s->spatial_idwt_buffer);
+    }
 
     for(plane_index=0; plane_index<3; plane_index++){
         Plane *p= &s->plane[plane_index];
@@ -2773,7 +2913,6 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
         int w= p->width;
         int h= p->height;
         int x, y;
-        int decode_state[MAX_DECOMPOSITIONS][4][1]; /* Stored state info for unpack_coeffs. 1 variable per instance. */
 
         if(s->avctx->debug&2048){
             memset(s->spatial_dwt_buffer, 0, sizeof(DWTELEM)*w*h);
@@ -2787,93 +2926,15 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
             }
         }
 
-        {
-        for(level=0; level<s->spatial_decomposition_count; level++){
-            for(orientation=level ? 1 : 0; orientation<4; orientation++){
-                SubBand *b= &p->band[level][orientation];
-                unpack_coeffs(s, b, b->parent, orientation);
-            }
-        }
-        }
-
-        {
-        const int mb_h= s->b_height << s->block_max_depth;
-        const int block_size = MB_SIZE >> s->block_max_depth;
-        const int block_w    = plane_index ? block_size/2 : block_size;
-        int mb_y;
-        DWTCompose cs[MAX_DECOMPOSITIONS];
-        int yd=0, yq=0;
-        int y;
-        int end_y;
-
-        ff_spatial_idwt_buffered_init(cs, &s->sb, w, h, 1, s->spatial_decomposition_type, s->spatial_decomposition_count);
-        for(mb_y=0; mb_y<=mb_h; mb_y++){
-
-            int slice_starty = block_w*mb_y;
-            int slice_h = block_w*(mb_y+1);
-            if (!(s->keyframe || s->avctx->debug&512)){
-                slice_starty = FFMAX(0, slice_starty - (block_w >> 1));
-                slice_h -= (block_w >> 1);
-            }
-
-            for(level=0; level<s->spatial_decomposition_count; level++){
-                for(orientation=level ? 1 : 0; orientation<4; orientation++){
-                    SubBand *b= &p->band[level][orientation];
-                    int start_y;
-                    int end_y;
-                    int our_mb_start = mb_y;
-                    int our_mb_end = (mb_y + 1);
-                    const int extra= 3;
-                    start_y = (mb_y ? ((block_w * our_mb_start) >> (s->spatial_decomposition_count - level)) + s->spatial_decomposition_count - level + extra: 0);
-                    end_y = (((block_w * our_mb_end) >> (s->spatial_decomposition_count - level)) + s->spatial_decomposition_count - level + extra);
-                    if (!(s->keyframe || s->avctx->debug&512)){
-                        start_y = FFMAX(0, start_y - (block_w >> (1+s->spatial_decomposition_count - level)));
-                        end_y = FFMAX(0, end_y - (block_w >> (1+s->spatial_decomposition_count - level)));
-                    }
-                    start_y = FFMIN(b->height, start_y);
-                    end_y = FFMIN(b->height, end_y);
-
-                    if (start_y != end_y){
-                        if (orientation == 0){
-                            SubBand * correlate_band = &p->band[0][0];
-                            int correlate_end_y = FFMIN(b->height, end_y + 1);
-                            int correlate_start_y = FFMIN(b->height, (start_y ? start_y + 1 : 0));
-                            decode_subband_slice_buffered(s, correlate_band, &s->sb, correlate_start_y, correlate_end_y, decode_state[0][0]);
-                            correlate_slice_buffered(s, &s->sb, correlate_band, correlate_band->ibuf, correlate_band->stride, 1, 0, correlate_start_y, correlate_end_y);
-                            dequantize_slice_buffered(s, &s->sb, correlate_band, correlate_band->ibuf, correlate_band->stride, start_y, end_y);
-                        }
-                        else
-                            decode_subband_slice_buffered(s, b, &s->sb, start_y, end_y, decode_state[level][orientation]);
-                    }
-                }
-            }
-
-            for(; yd<slice_h; yd+=4){
-                ff_spatial_idwt_buffered_slice(&s->dsp, cs, &s->sb, w, h, 1, s->spatial_decomposition_type, s->spatial_decomposition_count, yd);
-            }
-
-            if(s->qlog == LOSSLESS_QLOG){
-                for(; yq<slice_h && yq<h; yq++){
-                    IDWTELEM * line = slice_buffer_get_line(&s->sb, yq);
-                    for(x=0; x<w; x++){
-                        line[x] <<= FRAC_BITS;
-                    }
-                }
-            }
-
-            predict_slice_buffered(s, &s->sb, s->spatial_idwt_buffer, plane_index, 1, mb_y);
-
-            y = FFMIN(p->height, slice_starty);
-            end_y = FFMIN(p->height, slice_h);
-            while(y < end_y)
-                slice_buffer_release(&s->sb, y++);
-        }
-
-        slice_buffer_flush(&s->sb);
-        }
-
+        decode_coeffs_plane(s, p);
     }
 
+    if(avctx->thread_count <= s->scratchbuf_count)
+        avctx->execute2(avctx, decode_plane_thread, NULL, NULL, 3);
+    else
+        for(plane_index=0; plane_index<3; plane_index++)
+            decode_plane_thread(avctx, NULL, plane_index, 0);
+
     emms_c();
 
     release_buffer(avctx);
@@ -2894,8 +2955,10 @@ static int decode_frame(AVCodecContext *avctx, void *data, int *data_size, AVPac
 static av_cold int decode_end(AVCodecContext *avctx)
 {
     SnowContext *s = avctx->priv_data;
+    int plane_index;
 
-    slice_buffer_destroy(&s->sb);
+    for(plane_index=0; plane_index<3; plane_index++)
+        slice_buffer_destroy(&s->sb[plane_index]);
 
     common_end(s);
 
@@ -3363,7 +3426,7 @@ static int get_dc(SnowContext *s, int mb_x, int mb_y, int plane_index){
         int x= block_w*mb_x2 + block_w/2;
         int y= block_w*mb_y2 + block_w/2;
 
-        add_yblock(s, 0, NULL, dst + ((i&1)+(i>>1)*obmc_stride)*block_w, NULL, obmc,
+        add_yblock(s, s->scratchbuf, 0, NULL, dst + ((i&1)+(i>>1)*obmc_stride)*block_w, NULL, obmc,
                     x, y, block_w, block_w, w, h, obmc_stride, ref_stride, obmc_stride, mb_x2, mb_y2, 0, 0, plane_index);
 
         for(y2= FFMAX(y, 0); y2<FFMIN(h, y+block_w); y2++){
@@ -3551,7 +3614,7 @@ static int get_4block_rd(SnowContext *s, int mb_x, int mb_y, int plane_index){
         int x= block_w*mb_x2 + block_w/2;
         int y= block_w*mb_y2 + block_w/2;
 
-        add_yblock(s, 0, NULL, zero_dst, dst, obmc,
+        add_yblock(s, s->scratchbuf, 0, NULL, zero_dst, dst, obmc,
                    x, y, block_w, block_w, w, h, /*dst_stride*/0, ref_stride, obmc_stride, mb_x2, mb_y2, 1, 1, plane_index);
 
         //FIXME find a cleaner/simpler way to skip the outside stuff
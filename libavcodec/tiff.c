@@ -32,6 +32,7 @@
 #include "tiff.h"
 #include "faxcompr.h"
 #include "libavutil/common.h"
+#include "libavutil/intreadwrite.h"
 
 
 typedef struct TiffContext {
@@ -36,6 +36,18 @@
 #define FORMAT_INT 1
 #define FORMAT_FLOAT 3
 
+#define MAX_CHANNELS 8
+
+#define MAX_ORDER 16
+#define FILTER_HISTORY_SIZE 256
+typedef struct TTAFilter {
+    int32_t shift, round, error, mode;
+    int32_t qm[MAX_ORDER];
+    int32_t *dx, *dl;   ///< sliding windows into the history buffers
+    int32_t dx_hist[FILTER_HISTORY_SIZE + MAX_ORDER];
+    int32_t dl_hist[FILTER_HISTORY_SIZE + MAX_ORDER];
+} TTAFilter;
+
 typedef struct TTAContext {
     AVCodecContext *avctx;
     GetBitContext gb;
@@ -44,6 +56,7 @@ typedef struct TTAContext {
     int frame_length, last_frame_length, total_frames;
 
     int32_t *decode_buffer;
+    TTAFilter *filters;  ///< per channel filter states, too large for the stack
 } TTAContext;
 
 #if 0
@@ -79,14 +92,6 @@ static const uint32_t shift_1[] = {
 static const uint32_t * const shift_16 = shift_1 + 4;
 #endif
 
-#define MAX_ORDER 16
-typedef struct TTAFilter {
-    int32_t shift, round, error, mode;
-    int32_t qm[MAX_ORDER];
-    int32_t dx[MAX_ORDER];
-    int32_t dl[MAX_ORDER];
-} TTAFilter;
-
 static const int32_t ttafilter_configs[4][2] = {
     {10, 1},
     {9, 1},
@@ -100,18 +105,8 @@ static void ttafilter_init(TTAFilter *c, int32_t shift, int32_t mode) {
    c->round = shift_1[shift-1];
 //    c->round = 1 << (shift - 1);
     c->mode = mode;
-}
-
-// FIXME: copy paste from original
-static inline void memshl(register int32_t *a, register int32_t *b) {
-    *a++ = *b++;
-    *a++ = *b++;
-    *a++ = *b++;
-    *a++ = *b++;
-    *a++ = *b++;
-    *a++ = *b++;
-    *a++ = *b++;
-    *a = *b;
+    c->dx = c->dx_hist;
+    c->dl = c->dl_hist;
 }
 
 // FIXME: copy paste from original
@@ -171,8 +166,15 @@ static inline void ttafilter_process(TTAFilter *c, int32_t *in, int32_t mode) {
         *(dl-3) = *(dl-2) - *(dl-3);
     }
 
-    memshl(c->dl, c->dl + 1);
-    memshl(c->dx, c->dx + 1);
+    /* slide the windows instead of shifting them on every sample */
+    c->dl++;
+    c->dx++;
+    if (c->dl == c->dl_hist + FILTER_HISTORY_SIZE) {
+        memcpy(c->dl_hist, c->dl, 8 * sizeof(int32_t));
+        memcpy(c->dx_hist, c->dx, 8 * sizeof(int32_t));
+        c->dl = c->dl_hist;
+        c->dx = c->dx_hist;
+    }
 }
 
 typedef struct TTARice {
@@ -226,6 +228,10 @@ static av_cold int tta_decode_init(AVCodecContext * avctx)
         }
         s->is_float = (s->flags == FORMAT_FLOAT);
         avctx->channels = s->channels = get_bits(&s->gb, 16);
+        if (s->channels < 1 || s->channels > MAX_CHANNELS) {
+            av_log(s->avctx, AV_LOG_ERROR, "Invalid number of channels: %d\n", s->channels);
+            return -1;
+        }
         avctx->bits_per_coded_sample = get_bits(&s->gb, 16);
         s->bps = (avctx->bits_per_coded_sample + 7) / 8;
         avctx->sample_rate = get_bits_long(&s->gb, 32);
@@ -277,6 +283,9 @@ static av_cold int tta_decode_init(AVCodecContext * avctx)
         }
 
         s->decode_buffer = av_mallocz(sizeof(int32_t)*s->frame_length*s->channels);
+        s->filters = av_malloc(s->channels * sizeof(*s->filters));
+        if (!s->decode_buffer || !s->filters)
+            return AVERROR(ENOMEM);
     } else {
         av_log(avctx, AV_LOG_ERROR, "Wrong extradata present\n");
         return -1;
@@ -297,7 +306,7 @@ static int tta_decode_frame(AVCodecContext *avctx,
     init_get_bits(&s->gb, buf, buf_size*8);
     {
         int32_t predictors[s->channels];
-        TTAFilter filters[s->channels];
+        TTAFilter *filters = s->filters;
         TTARice rices[s->channels];
         int cur_chan = 0, framelen = s->frame_length;
         int32_t *p;
@@ -430,8 +439,8 @@ static int tta_decode_frame(AVCodecContext *avctx,
 static av_cold int tta_decode_close(AVCodecContext *avctx) {
     TTAContext *s = avctx->priv_data;
 
-    if (s->decode_buffer)
-        av_free(s->decode_buffer);
+    av_freep(&s->decode_buffer);
+    av_freep(&s->filters);
 
     return 0;
 }
@@ -3327,7 +3327,7 @@ AVCodec vc1_decoder = {
     NULL,
     vc1_decode_end,
     vc1_decode_frame,
-    CODEC_CAP_DR1 | CODEC_CAP_DELAY,
+    CODEC_CAP_DR1 | CODEC_CAP_DELAY | CODEC_CAP_ROW_PROGRESS,
     NULL,
     .long_name = NULL_IF_CONFIG_SMALL("SMPTE VC-1"),
     .pix_fmts = ff_hwaccel_pixfmt_list_420
@@ -3343,7 +3343,7 @@ AVCodec wmv3_decoder = {
     NULL,
     vc1_decode_end,
     vc1_decode_frame,
-    CODEC_CAP_DR1 | CODEC_CAP_DELAY,
+    CODEC_CAP_DR1 | CODEC_CAP_DELAY | CODEC_CAP_ROW_PROGRESS,
     NULL,
     .long_name = NULL_IF_CONFIG_SMALL("Windows Media Video 9"),
     .pix_fmts = ff_hwaccel_pixfmt_list_420
@@ -48,6 +48,10 @@ typedef struct {
     int *quantlist;
     float *dimentions;
     float *pow2;
+    int nused;          ///< number of entries with a codeword
+    int *used;          ///< indexes of the entries with a codeword
+    float *used_dims;   ///< dimentions of the used entries, packed
+    float *used_pow2;   ///< pow2 of the used entries, packed
 } vorbis_enc_codebook;
 
 typedef struct {
@@ -66,6 +70,7 @@ typedef struct {
     int rangebits;
     int values;
     vorbis_floor1_entry *list;
+    double *tilt; ///< frequency dependent floor boost, in sorted post order
 } vorbis_enc_floor;
 
 typedef struct {
@@ -151,6 +156,8 @@ static void ready_codebook(vorbis_enc_codebook *cb)
 
     if (!cb->lookup) {
         cb->pow2 = cb->dimentions = NULL;
+        cb->used = NULL;
+        cb->used_dims = cb->used_pow2 = NULL;
     } else {
         int vals = cb_lookup_vals(cb->lookup, cb->ndimentions, cb->nentries);
         cb->dimentions = av_malloc(sizeof(float) * cb->nentries * cb->ndimentions);
@@ -174,6 +181,22 @@ static void ready_codebook(vorbis_enc_codebook *cb)
             }
             cb->pow2[i] /= 2.;
         }
+
+        /* pack the entries which can actually be coded, so that the
+         * vector search does not have to skip the unused ones */
+        cb->used      = av_malloc(sizeof(int)   * cb->nentries);
+        cb->used_dims = av_malloc(sizeof(float) * cb->nentries * cb->ndimentions);
+        cb->used_pow2 = av_malloc(sizeof(float) * cb->nentries);
+        cb->nused     = 0;
+        for (i = 0; i < cb->nentries; i++) {
+            if (!cb->lens[i])
+                continue;
+            memcpy(cb->used_dims + cb->nused * cb->ndimentions,
+                   cb->dimentions + i * cb->ndimentions,
+                   sizeof(float) * cb->ndimentions);
+            cb->used_pow2[cb->nused] = cb->pow2[i];
+            cb->used[cb->nused++]    = i;
+        }
     }
 }
 
@@ -303,6 +326,10 @@ static void create_vorbis_context(vorbis_enc_context *venc,
     }
     ff_vorbis_ready_floor1_list(fc->list, fc->values);
 
+    fc->tilt = av_malloc(sizeof(double) * fc->values);
+    for (i = 0; i < fc->values; i++)
+        fc->tilt[i] = pow(1.25, fc->list[fc->list[i].sort].x / 200.); // MAGIC!
+
     venc->nresidues = 1;
     venc->residues  = av_malloc(sizeof(vorbis_enc_residue) * venc->nresidues);
 
@@ -673,15 +700,19 @@ static void floor_fit(vorbis_enc_context *venc, vorbis_enc_floor *fc,
     tot_average /= venc->quality;
 
     for (i = 0; i < fc->values; i++) {
-        int position  = fc->list[fc->list[i].sort].x;
         float average = averages[i];
-        int j;
-
-        average *= pow(tot_average / average, 0.5) * pow(1.25, position/200.); // MAGIC!
-        for (j = 0; j < range - 1; j++)
-            if (ff_vorbis_floor1_inverse_db_table[j * fc->multiplier] > average)
-                break;
-        posts[fc->list[i].sort] = j;
+        int lo = 0, hi = range - 1;
+
+        average *= pow(tot_average / average, 0.5) * fc->tilt[i];
+        /* the table is increasing, find the first entry above average */
+        while (lo < hi) {
+            int mid = (lo + hi) >> 1;
+            if (ff_vorbis_floor1_inverse_db_table[mid * fc->multiplier] > average)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        posts[fc->list[i].sort] = lo;
     }
 }
 
@@ -773,26 +804,48 @@ static void floor_encode(vorbis_enc_context *venc, vorbis_enc_floor *fc,
                                  fc->multiplier, floor, samples);
 }
 
-static float *put_vector(vorbis_enc_codebook *book, PutBitContext *pb,
-                         float *num)
+static av_always_inline int nearest_vector(const float *dims,
+                                           const float *pow2, int n,
+                                           int ndim, const float *num)
 {
     int i, entry = -1;
     float distance = FLT_MAX;
-    assert(book->dimentions);
-    for (i = 0; i < book->nentries; i++) {
-        float * vec = book->dimentions + i * book->ndimentions, d = book->pow2[i];
+    for (i = 0; i < n; i++) {
+        const float *vec = dims + i * ndim;
+        float d = pow2[i];
         int j;
-        if (!book->lens[i])
-            continue;
-        for (j = 0; j < book->ndimentions; j++)
+        for (j = 0; j < ndim; j++)
             d -= vec[j] * num[j];
         if (distance > d) {
             entry    = i;
             distance = d;
         }
     }
-    put_codeword(pb, book, entry);
-    return &book->dimentions[entry * book->ndimentions];
+    return entry;
+}
+
+static float *put_vector(vorbis_enc_codebook *book, PutBitContext *pb,
+                         float *num)
+{
+    int entry;
+    assert(book->dimentions);
+    /* constant dimensions let the compiler unroll the inner loop */
+    switch (book->ndimentions) {
+    case 2:
+        entry = nearest_vector(book->used_dims, book->used_pow2, book->nused, 2, num);
+        break;
+    case 4:
+        entry = nearest_vector(book->used_dims, book->used_pow2, book->nused, 4, num);
+        break;
+    case 8:
+        entry = nearest_vector(book->used_dims, book->used_pow2, book->nused, 8, num);
+        break;
+    default:
+        entry = nearest_vector(book->used_dims, book->used_pow2, book->nused,
+                               book->ndimentions, num);
+    }
+    put_codeword(pb, book, book->used[entry]);
+    return &book->used_dims[entry * book->ndimentions];
 }
 
 static void residue_encode(vorbis_enc_context *venc, vorbis_enc_residue *rc,
@@ -1039,6 +1092,9 @@ static av_cold int vorbis_encode_close(AVCodecContext *avccontext)
             av_freep(&venc->codebooks[i].quantlist);
             av_freep(&venc->codebooks[i].dimentions);
             av_freep(&venc->codebooks[i].pow2);
+            av_freep(&venc->codebooks[i].used);
+            av_freep(&venc->codebooks[i].used_dims);
+            av_freep(&venc->codebooks[i].used_pow2);
         }
     av_freep(&venc->codebooks);
 
@@ -1051,6 +1107,7 @@ static av_cold int vorbis_encode_close(AVCodecContext *avccontext)
             av_freep(&venc->floors[i].classes);
             av_freep(&venc->floors[i].partition_to_class);
             av_freep(&venc->floors[i].list);
+            av_freep(&venc->floors[i].tilt);
         }
     av_freep(&venc->floors);
 
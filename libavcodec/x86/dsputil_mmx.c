@@ -2579,6 +2579,50 @@ static int32_t scalarproduct_int16_sse2(int16_t * v1, int16_t * v2, int order, i
     return res;
 }
 
+static int32_t scalarproduct_and_madd_int16_sse2(int16_t *v1, int16_t *v2, int16_t *v3, int order, int mul)
+{
+    int res;
+    x86_reg o = -(order << 1);
+
+    v1 += order;
+    v2 += order;
+    v3 += order;
+    __asm__ volatile(
+        "movd       %5,       %%xmm6        \n\t"
+        "pshuflw    $0,       %%xmm6,%%xmm6 \n\t"
+        "punpcklqdq %%xmm6,   %%xmm6        \n\t"
+        "pxor       %%xmm7,   %%xmm7        \n\t"
+        "1:                                 \n\t"
+        "movdqa      (%0,%4), %%xmm4        \n\t"
+        "movdqa    16(%0,%4), %%xmm5        \n\t"
+        "movdqu      (%1,%4), %%xmm0        \n\t"
+        "movdqu    16(%1,%4), %%xmm1        \n\t"
+        "movdqu      (%2,%4), %%xmm2        \n\t"
+        "movdqu    16(%2,%4), %%xmm3        \n\t"
+        "pmaddwd    %%xmm4,   %%xmm0        \n\t"
+        "pmaddwd    %%xmm5,   %%xmm1        \n\t"
+        "pmullw     %%xmm6,   %%xmm2        \n\t"
+        "pmullw     %%xmm6,   %%xmm3        \n\t"
+        "paddd      %%xmm0,   %%xmm7        \n\t"
+        "paddd      %%xmm1,   %%xmm7        \n\t"
+        "paddw      %%xmm4,   %%xmm2        \n\t"
+        "paddw      %%xmm5,   %%xmm3        \n\t"
+        "movdqa     %%xmm2,     (%0,%4)     \n\t"
+        "movdqa     %%xmm3,   16(%0,%4)     \n\t"
+        "add        $32,      %4            \n\t"
+        "js         1b                      \n\t"
+        "movhlps    %%xmm7,   %%xmm0        \n\t"
+        "paddd      %%xmm0,   %%xmm7        \n\t"
+        "pshuflw    $0x4E,    %%xmm7,%%xmm0 \n\t"
+        "paddd      %%xmm0,   %%xmm7        \n\t"
+        "movd       %%xmm7,   %3            \n\t"
+        : "+r"(v1), "+r"(v2), "+r"(v3), "=r"(res), "+r"(o)
+        : "r"(mul)
+        : "memory"
+    );
+    return res;
+}
+
 void dsputil_init_mmx(DSPContext* c, AVCodecContext *avctx)
 {
     mm_flags = mm_support();
@@ -3036,6 +3080,7 @@ void dsputil_init_mmx(DSPContext* c, AVCodecContext *avctx)
             c->add_int16 = add_int16_sse2;
             c->sub_int16 = sub_int16_sse2;
             c->scalarproduct_int16 = scalarproduct_int16_sse2;
+            c->scalarproduct_and_madd_int16 = scalarproduct_and_madd_int16_sse2;
         }
     }
 
@@ -384,6 +384,55 @@ static int sse16_sse2(void *v, uint8_t * pix1, uint8_t * pix2, int line_size, in
     return tmp;
 }
 
+static void ssim_4x4x2_core_sse2(const uint8_t *pix1, int stride1,
+                                 const uint8_t *pix2, int stride2, int sums[2][4])
+{
+    DECLARE_ALIGNED_16(uint16_t, pixsum[2][8]);
+    DECLARE_ALIGNED_16(uint32_t, sqsum[2][4]);
+    int z;
+
+    __asm__ volatile(
+        "pxor %%xmm7, %%xmm7            \n\t"
+        "pxor %%xmm3, %%xmm3            \n\t" /* sum of pix1 per column */
+        "pxor %%xmm4, %%xmm4            \n\t" /* sum of pix2 per column */
+        "pxor %%xmm5, %%xmm5            \n\t" /* sum of pix1^2 + pix2^2 */
+        "pxor %%xmm6, %%xmm6            \n\t" /* sum of pix1*pix2 */
+        "mov $4, %%"REG_c"              \n\t"
+        "1:                             \n\t"
+        "movq (%0), %%xmm0              \n\t"
+        "movq (%1), %%xmm1              \n\t"
+        "punpcklbw %%xmm7, %%xmm0       \n\t"
+        "punpcklbw %%xmm7, %%xmm1       \n\t"
+        "paddw %%xmm0, %%xmm3           \n\t"
+        "paddw %%xmm1, %%xmm4           \n\t"
+        "movdqa %%xmm0, %%xmm2          \n\t"
+        "pmaddwd %%xmm1, %%xmm2         \n\t"
+        "paddd %%xmm2, %%xmm6           \n\t"
+        "pmaddwd %%xmm0, %%xmm0         \n\t"
+        "pmaddwd %%xmm1, %%xmm1         \n\t"
+        "paddd %%xmm0, %%xmm5           \n\t"
+        "paddd %%xmm1, %%xmm5           \n\t"
+        "add %2, %0                     \n\t"
+        "add %3, %1                     \n\t"
+        "dec %%"REG_c"                  \n\t"
+        "jnz 1b                         \n\t"
+        "movdqa %%xmm3,   (%4)          \n\t"
+        "movdqa %%xmm4, 16(%4)          \n\t"
+        "movdqa %%xmm5,   (%5)          \n\t"
+        "movdqa %%xmm6, 16(%5)          \n\t"
+        : "+r"(pix1), "+r"(pix2)
+        : "r"((x86_reg)stride1), "r"((x86_reg)stride2), "r"(pixsum), "r"(sqsum)
+        : "%"REG_c, "memory"
+    );
+
+    for (z = 0; z < 2; z++) {
+        sums[z][0] = pixsum[0][4*z] + pixsum[0][4*z+1] + pixsum[0][4*z+2] + pixsum[0][4*z+3];
+        sums[z][1] = pixsum[1][4*z] + pixsum[1][4*z+1] + pixsum[1][4*z+2] + pixsum[1][4*z+3];
+        sums[z][2] = sqsum[0][2*z] + sqsum[0][2*z+1];
+        sums[z][3] = sqsum[1][2*z] + sqsum[1][2*z+1];
+    }
+}
+
 static int hf_noise8_mmx(uint8_t * pix1, int line_size, int h) {
     int tmp;
   __asm__ volatile (
@@ -1410,6 +1459,7 @@ void dsputilenc_init_mmx(DSPContext* c, AVCodecContext *avctx)
 
         if(mm_flags & FF_MM_SSE2){
             c->get_pixels = get_pixels_sse2;
+            c->ssim_4x4x2_core = ssim_4x4x2_core_sse2;
             c->sum_abs_dctelem= sum_abs_dctelem_sse2;
             c->hadamard8_diff[0]= hadamard8_diff16_sse2;
             c->hadamard8_diff[1]= hadamard8_diff_sse2;
@@ -22,8 +22,8 @@
 #define AVFORMAT_AVFORMAT_H
 
 #define LIBAVFORMAT_VERSION_MAJOR 52
-#define LIBAVFORMAT_VERSION_MINOR 40
-#define LIBAVFORMAT_VERSION_MICRO  2
+#define LIBAVFORMAT_VERSION_MINOR 42
+#define LIBAVFORMAT_VERSION_MICRO  0
 
 #define LIBAVFORMAT_VERSION_INT AV_VERSION_INT(LIBAVFORMAT_VERSION_MAJOR, \
                                                LIBAVFORMAT_VERSION_MINOR, \
@@ -622,7 +622,8 @@ typedef struct AVFormatContext {
      * accurate seeking (depends on demuxer).
      * Demuxers for which a full in-memory index is mandatory will ignore
      * this.
-     * muxing  : unused
+     * muxing  : set by user, muxers which keep an index in memory until
+     *           the trailer (e.g. AVI OpenDML) may flush it early instead
      * demuxing: set by user
      */
     unsigned int max_index_size;
@@ -661,6 +662,15 @@ typedef struct AVFormatContext {
      */
 #define RAW_PACKET_BUFFER_SIZE 2500000
     int raw_packet_buffer_remaining_size;
+
+    /**
+     * Number of background threads formats made of many files (e.g. image
+     * sequences) may use to read ahead or write behind, overlapping the
+     * open and transfer latency of the files. 0 does all I/O synchronously.
+     * - muxing: set by user
+     * - demuxing: set by user
+     */
+    int io_threads;
 } AVFormatContext;
 
 typedef struct AVPacketList {
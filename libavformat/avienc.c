@@ -36,6 +36,8 @@ typedef struct AVIIentry {
 typedef struct AVIIndex {
     int64_t     indx_start;
     int         entry;
+    int         ents_flushed;   ///< entries already written to a leaf index
+    int         master_entries; ///< entries in use in the master index
     int         ents_allocated;
     AVIIentry** cluster;
 } AVIIndex;
@@ -65,7 +67,7 @@ static int64_t avi_start_new_riff(AVIContext *avi, ByteIOContext *pb,
 
     avi->riff_id++;
     for (i=0; i<MAX_STREAMS; i++)
-         avi->indexes[i].entry = 0;
+         avi->indexes[i].entry = avi->indexes[i].ents_flushed = 0;
 
     avi->riff_start = ff_start_tag(pb, "RIFF");
     put_tag(pb, riff_tag);
@@ -378,63 +380,89 @@ static int avi_write_header(AVFormatContext *s)
     return 0;
 }
 
-static int avi_write_ix(AVFormatContext *s)
+/**
+ * Write the entries of a stream not yet covered by a leaf index as an
+ * OpenDML ix## chunk and reference it from the master index.
+ */
+static int avi_write_ix_stream(AVFormatContext *s, int i)
 {
     ByteIOContext *pb = s->pb;
     AVIContext *avi = s->priv_data;
+    AVIIndex *idx = &avi->indexes[i];
     char tag[5];
     char ix_tag[] = "ix00";
-    int i, j;
+    int64_t ix, pos;
+    int j, count = idx->entry - idx->ents_flushed;
 
-    assert(!url_is_streamed(pb));
-
-    if (avi->riff_id > AVI_MASTER_INDEX_SIZE)
+    if (idx->master_entries >= AVI_MASTER_INDEX_SIZE)
         return -1;
 
-    for (i=0;i<s->nb_streams;i++) {
-         int64_t ix, pos;
-
-         avi_stream2fourcc(&tag[0], i, s->streams[i]->codec->codec_type);
-         ix_tag[3] = '0' + i;
-
-         /* Writing AVI OpenDML leaf index chunk */
-         ix = url_ftell(pb);
-         put_tag(pb, &ix_tag[0]);     /* ix?? */
-         put_le32(pb, avi->indexes[i].entry * 8 + 24);
-                                      /* chunk size */
-         put_le16(pb, 2);             /* wLongsPerEntry */
-         put_byte(pb, 0);             /* bIndexSubType (0 == frame index) */
-         put_byte(pb, 1);             /* bIndexType (1 == AVI_INDEX_OF_CHUNKS) */
-         put_le32(pb, avi->indexes[i].entry);
-                                      /* nEntriesInUse */
-         put_tag(pb, &tag[0]);        /* dwChunkId */
-         put_le64(pb, avi->movi_list);/* qwBaseOffset */
-         put_le32(pb, 0);             /* dwReserved_3 (must be 0) */
-
-         for (j=0; j<avi->indexes[i].entry; j++) {
-             AVIIentry* ie = avi_get_ientry(&avi->indexes[i], j);
-             put_le32(pb, ie->pos + 8);
-             put_le32(pb, ((uint32_t)ie->len & ~0x80000000) |
-                          (ie->flags & 0x10 ? 0 : 0x80000000));
-         }
-         put_flush_packet(pb);
-         pos = url_ftell(pb);
-
-         /* Updating one entry in the AVI OpenDML master index */
-         url_fseek(pb, avi->indexes[i].indx_start - 8, SEEK_SET);
-         put_tag(pb, "indx");                 /* enabling this entry */
-         url_fskip(pb, 8);
-         put_le32(pb, avi->riff_id);          /* nEntriesInUse */
-         url_fskip(pb, 16*avi->riff_id);
-         put_le64(pb, ix);                    /* qwOffset */
-         put_le32(pb, pos - ix);              /* dwSize */
-         put_le32(pb, avi->indexes[i].entry); /* dwDuration */
-
-         url_fseek(pb, pos, SEEK_SET);
+    avi_stream2fourcc(&tag[0], i, s->streams[i]->codec->codec_type);
+    ix_tag[3] = '0' + i;
+
+    /* Writing AVI OpenDML leaf index chunk */
+    ix = url_ftell(pb);
+    put_tag(pb, &ix_tag[0]);     /* ix?? */
+    put_le32(pb, count * 8 + 24);
+                                 /* chunk size */
+    put_le16(pb, 2);             /* wLongsPerEntry */
+    put_byte(pb, 0);             /* bIndexSubType (0 == frame index) */
+    put_byte(pb, 1);             /* bIndexType (1 == AVI_INDEX_OF_CHUNKS) */
+    put_le32(pb, count);         /* nEntriesInUse */
+    put_tag(pb, &tag[0]);        /* dwChunkId */
+    put_le64(pb, avi->movi_list);/* qwBaseOffset */
+    put_le32(pb, 0);             /* dwReserved_3 (must be 0) */
+
+    for (j=idx->ents_flushed; j<idx->entry; j++) {
+        AVIIentry* ie = avi_get_ientry(idx, j);
+        put_le32(pb, ie->pos + 8);
+        put_le32(pb, ((uint32_t)ie->len & ~0x80000000) |
+                     (ie->flags & 0x10 ? 0 : 0x80000000));
     }
+    put_flush_packet(pb);
+    pos = url_ftell(pb);
+
+    /* Updating one entry in the AVI OpenDML master index */
+    idx->master_entries++;
+    url_fseek(pb, idx->indx_start - 8, SEEK_SET);
+    put_tag(pb, "indx");                 /* enabling this entry */
+    url_fskip(pb, 8);
+    put_le32(pb, idx->master_entries);   /* nEntriesInUse */
+    url_fskip(pb, 16*idx->master_entries);
+    put_le64(pb, ix);                    /* qwOffset */
+    put_le32(pb, pos - ix);              /* dwSize */
+    put_le32(pb, count);                 /* dwDuration */
+
+    url_fseek(pb, pos, SEEK_SET);
+    put_flush_packet(pb);
+
+    /* The entries of the first RIFF are kept for idx1, the others can
+     * be dropped as soon as they are in a leaf index. */
+    if (avi->riff_id > 1)
+        idx->entry = 0;
+    idx->ents_flushed = idx->entry;
     return 0;
 }
 
+static int avi_write_ix(AVFormatContext *s)
+{
+    AVIContext *avi = s->priv_data;
+    int i, ret = 0;
+
+    assert(!url_is_streamed(s->pb));
+
+    for (i=0;i<s->nb_streams;i++) {
+        AVIIndex *idx = &avi->indexes[i];
+        /* nothing written since the last leaf index of this stream */
+        if (idx->entry == idx->ents_flushed)
+            continue;
+        /* a full master index only stops this stream */
+        if (avi_write_ix_stream(s, i) < 0)
+            ret = -1;
+    }
+    return ret;
+}
+
 static int avi_write_idx1(AVFormatContext *s)
 {
     ByteIOContext *pb = s->pb;
@@ -550,6 +578,19 @@ static int avi_write_packet(AVFormatContext *s, AVPacket *pkt)
     if (size & 1)
         put_byte(pb, 0);
 
+    /* Flush the leaf index once it uses more than max_index_size bytes,
+     * so that the index memory stays bounded and a file that is never
+     * finalized remains seekable up to this point. Every RIFF needs a
+     * master index entry for the leaf index written when it ends, so
+     * enough entries are kept for the current RIFF and for as many more
+     * RIFFs as the file already has. */
+    if (!url_is_streamed(pb)) {
+        AVIIndex* idx = &avi->indexes[stream_index];
+        if ((idx->entry - idx->ents_flushed) * sizeof(AVIIentry) >= s->max_index_size &&
+            idx->master_entries + 2 + avi->riff_id <= AVI_MASTER_INDEX_SIZE)
+            avi_write_ix_stream(s, stream_index);
+    }
+
     put_flush_packet(pb);
     return 0;
 }
@@ -563,15 +604,21 @@ static int avi_write_trailer(AVFormatContext *s)
     int64_t file_size;
 
     if (!url_is_streamed(pb)){
-        if (avi->riff_id == 1) {
-            ff_end_tag(pb, avi->movi_list);
-            res = avi_write_idx1(s);
-            ff_end_tag(pb, avi->riff_start);
-        } else {
+        /* a single RIFF file is an OpenDML one too if leaf indexes were
+         * flushed while writing it */
+        int odml = avi->riff_id > 1;
+        for (i=0; i<s->nb_streams; i++)
+            if (avi->indexes[i].master_entries)
+                odml = 1;
+
+        if (odml)
             avi_write_ix(s);
-            ff_end_tag(pb, avi->movi_list);
-            ff_end_tag(pb, avi->riff_start);
+        ff_end_tag(pb, avi->movi_list);
+        if (avi->riff_id == 1)
+            res = avi_write_idx1(s);
+        ff_end_tag(pb, avi->riff_start);
 
+        if (odml) {
             file_size = url_ftell(pb);
             url_fseek(pb, avi->odml_list - 8, SEEK_SET);
             put_tag(pb, "LIST"); /* Making this AVI OpenDML one */
@@ -591,7 +638,8 @@ static int avi_write_trailer(AVFormatContext *s)
             put_le32(pb, nb_frames);
             url_fseek(pb, file_size, SEEK_SET);
 
-            avi_write_counters(s, avi->riff_id);
+            if (avi->riff_id > 1)
+                avi_write_counters(s, avi->riff_id);
         }
     }
     put_flush_packet(pb);
@@ -205,6 +205,7 @@ typedef struct {
     int (*read_pause)(void *opaque, int pause);
     int64_t (*read_seek)(void *opaque, int stream_index,
                          int64_t timestamp, int flags);
+    int orig_buffer_size; ///< buffer size to go back to after a larger buffer was handed in, e.g. by probing
 } ByteIOContext;
 
 int init_put_byte(ByteIOContext *s,
@@ -23,6 +23,7 @@
 #include "libavutil/intreadwrite.h"
 #include "avformat.h"
 #include "avio.h"
+#include "internal.h"
 #include <stdarg.h>
 
 #define IO_BUFFER_SIZE 32768
@@ -43,6 +44,7 @@ int init_put_byte(ByteIOContext *s,
 {
     s->buffer = buffer;
     s->buffer_size = buffer_size;
+    s->orig_buffer_size = buffer_size;
     s->buf_ptr = buffer;
     s->opaque = opaque;
     url_resetbuf(s, write_flag ? URL_WRONLY : URL_RDONLY);
@@ -306,6 +308,16 @@ static void fill_buffer(ByteIOContext *s)
         s->checksum_ptr= s->buffer;
     }
 
+    /* go back to the normal buffer size once the probe data has been read */
+    if (dst == s->buffer && s->buffer_size > s->orig_buffer_size) {
+        uint8_t *buffer = av_malloc(s->orig_buffer_size);
+        if (buffer) {
+            av_free(s->buffer);
+            s->buffer       = s->buf_ptr = s->buf_end = s->checksum_ptr = dst = buffer;
+            s->buffer_size  = len = s->orig_buffer_size;
+        }
+    }
+
     if(s->read_packet)
         len = s->read_packet(s->opaque, dst, len);
     else
@@ -581,11 +593,49 @@ int url_setbufsize(ByteIOContext *s, int buf_size)
     av_free(s->buffer);
     s->buffer = buffer;
     s->buffer_size = buf_size;
+    s->orig_buffer_size = buf_size;
     s->buf_ptr = buffer;
     url_resetbuf(s, s->write_flag ? URL_WRONLY : URL_RDONLY);
     return 0;
 }
 
+int ff_rewind_with_probe_data(ByteIOContext *s, unsigned char *buf, int buf_size)
+{
+    int64_t buffer_start;
+    int buffer_size;
+    int overlap, new_size;
+
+    if (s->write_flag)
+        return AVERROR(EINVAL);
+
+    buffer_size = s->buf_end - s->buffer;
+
+    /* the probe data and the buffered data must touch or overlap */
+    if ((buffer_start = s->pos - buffer_size) > buf_size)
+        return AVERROR(EINVAL);
+
+    overlap  = buf_size - buffer_start;
+    new_size = buf_size + buffer_size - overlap;
+
+    if (new_size > buf_size) {
+        if (!(buf = av_realloc(buf, new_size)))
+            return AVERROR(ENOMEM);
+
+        memcpy(buf + buf_size, s->buffer + overlap, buffer_size - overlap);
+        buf_size = new_size;
+    }
+
+    av_free(s->buffer);
+    s->buf_ptr = s->buffer = buf;
+    s->buffer_size = buf_size;
+    s->pos = buf_size;
+    s->buf_end = s->buf_ptr + buf_size;
+    s->eof_reached = 0;
+    s->must_flush = 0;
+
+    return 0;
+}
+
 #if LIBAVFORMAT_VERSION_MAJOR < 53
 int url_resetbuf(ByteIOContext *s, int flags)
 #else
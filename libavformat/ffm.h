@@ -45,6 +45,11 @@ typedef struct FFMContext {
     int64_t write_index, file_size;
     int read_state;
     uint8_t header[FRAME_HEADER_SIZE+4];
+    /* mapping of a local feed file, packets are then read in place */
+    int fd;
+    uint8_t *map;
+    int64_t map_size;
+    int64_t pos;            /* read position in the mapping */
 
     /* read and write */
     int first_packet; /* true if first packet, needed to set the discontinuity tag */
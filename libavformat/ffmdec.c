@@ -20,11 +20,118 @@
  */
 
 #include "libavutil/intreadwrite.h"
+#include "libavutil/avstring.h"
+#include "libavutil/bswap.h"
 #include "avformat.h"
 #include "ffm.h"
-#if CONFIG_FFSERVER
+#if HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#if CONFIG_FFSERVER || HAVE_MMAP
 #include <unistd.h>
+#endif
+
+#if HAVE_MMAP
+/* Read a feed file that shrank through the ByteIOContext again, touching
+   the mapping beyond the end of the file would raise SIGBUS. */
+static void ffm_drop_map(AVFormatContext *s, int64_t file_size)
+{
+    FFMContext *ffm = s->priv_data;
+    int len = ffm->packet_end - ffm->packet_ptr;
+
+    /* keep the rest of the current packet if the file still holds it */
+    if (ffm->packet_ptr >= ffm->map &&
+        ffm->packet_ptr <= ffm->map + ffm->map_size) {
+        if (ffm->packet_end - ffm->map <= file_size)
+            memcpy(ffm->packet, ffm->packet_ptr, len);
+        else
+            len = 0;
+        ffm->packet_ptr = ffm->packet;
+        ffm->packet_end = ffm->packet + len;
+    }
+    munmap(ffm->map, ffm->map_size);
+    close(ffm->fd);
+    ffm->map      = NULL;
+    ffm->map_size = 0;
+    ffm->file_size = file_size;
+    url_fseek(s->pb, ffm->pos, SEEK_SET);
+}
+
+/* map the whole feed file again if it grew, drop the mapping if it shrank */
+static int ffm_update_map(AVFormatContext *s)
+{
+    FFMContext *ffm = s->priv_data;
+    struct stat st;
+    uint8_t *map;
+
+    if (fstat(ffm->fd, &st) < 0)
+        return AVERROR(errno);
+    if (st.st_size < ffm->map_size) {
+        ffm_drop_map(s, st.st_size);
+        return 0;
+    }
+    if (st.st_size > ffm->map_size) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, ffm->fd, 0);
+        if (map == MAP_FAILED)
+            return AVERROR(errno);
+        if (ffm->map) {
+            /* the current packet is read in place */
+            if (ffm->packet_ptr >= ffm->map &&
+                ffm->packet_ptr <= ffm->map + ffm->map_size) {
+                ffm->packet_ptr = map + (ffm->packet_ptr - ffm->map);
+                ffm->packet_end = map + (ffm->packet_end - ffm->map);
+            }
+            munmap(ffm->map, ffm->map_size);
+        }
+        ffm->map      = map;
+        ffm->map_size = st.st_size;
+    }
+    ffm->file_size = ffm->map_size;
+    return 0;
+}
 
+/* The writer updates the index with a single aligned 8 byte write, read
+   it until it is stable in case the host cannot load it atomically. */
+static int64_t ffm_map_write_index(FFMContext *ffm)
+{
+    const volatile uint64_t *p = (const volatile uint64_t *)(ffm->map + 8);
+    uint64_t pos, pos1 = *p;
+
+    do {
+        pos  = pos1;
+        pos1 = *p;
+    } while (pos != pos1);
+    return be2me_64(pos);
+}
+
+/* Readers of a local feed file map it shared with the writer, they follow
+   it without any system call or copy, whichever process they are in. */
+static void ffm_map_file(AVFormatContext *s)
+{
+    FFMContext *ffm = s->priv_data;
+    const char *filename = s->filename;
+
+    if (url_is_streamed(s->pb) ||
+        (!av_strstart(filename, "file:", &filename) && strchr(filename, ':')))
+        return;
+    ffm->fd = open(filename, O_RDONLY);
+    if (ffm->fd < 0)
+        return;
+    if (ffm_update_map(s) < 0 || ffm->map_size != url_fsize(s->pb) ||
+        ffm->map_size < FFM_PACKET_SIZE ||
+        AV_RL32(ffm->map) != MKTAG('F', 'F', 'M', '1')) {
+        if (ffm->map)
+            munmap(ffm->map, ffm->map_size);
+        ffm->map = NULL;
+        ffm->map_size = 0;
+        close(ffm->fd);
+    }
+}
+#endif
+
+#if CONFIG_FFSERVER
 int64_t ffm_read_write_index(int fd)
 {
     uint8_t buf[8];
@@ -35,6 +142,8 @@ int64_t ffm_read_write_index(int fd)
     return AV_RB64(buf);
 }
 
+/* the index is written in one aligned write, so that readers mapping
+   the feed never see it half updated */
 int ffm_write_write_index(int fd, int64_t pos)
 {
     uint8_t buf[8];
@@ -52,20 +161,57 @@ void ffm_set_write_index(AVFormatContext *s, int64_t pos, int64_t file_size)
 {
     FFMContext *ffm = s->priv_data;
     ffm->write_index = pos;
+#if HAVE_MMAP
+    if (ffm->map) {
+        /* the feed was truncated, or could not be mapped again */
+        if (file_size < ffm->map_size ||
+            (file_size > ffm->map_size && ffm_update_map(s) < 0))
+            ffm_drop_map(s, file_size);
+        if (ffm->map)
+            return;
+    }
+#endif
     ffm->file_size = file_size;
 }
 #endif // CONFIG_FFSERVER
 
+static int64_t ffm_tell(AVFormatContext *s)
+{
+#if HAVE_MMAP
+    FFMContext *ffm = s->priv_data;
+    if (ffm->map)
+        return ffm->pos;
+#endif
+    return url_ftell(s->pb);
+}
+
 static int ffm_is_avail_data(AVFormatContext *s, int size)
 {
     FFMContext *ffm = s->priv_data;
     int64_t pos, avail_size;
+#if HAVE_MMAP
+    int64_t write_index;
+    int ret;
+#endif
     int len;
 
+#if HAVE_MMAP
+    /* follow the writer of a live feed, whose index is never 0; this is
+       checked even within a packet, which may be gone from a truncated file */
+    if (ffm->map && (write_index = ffm_map_write_index(ffm))) {
+        /* the file grew, or the index went back because the writer
+           wrapped around or truncated the file */
+        int changed = write_index > ffm->file_size ||
+                      write_index < ffm->write_index;
+        ffm->write_index = write_index;
+        if (changed && (ret = ffm_update_map(s)) < 0)
+            return ret;
+    }
+#endif
     len = ffm->packet_end - ffm->packet_ptr;
     if (size <= len)
         return 1;
-    pos = url_ftell(s->pb);
+    pos = ffm_tell(s);
     if (!ffm->write_index) {
         if (pos == ffm->file_size)
             return AVERROR_EOF;
@@ -89,8 +235,22 @@ static int ffm_is_avail_data(AVFormatContext *s, int size)
 
 static int ffm_resync(AVFormatContext *s, int state)
 {
+#if HAVE_MMAP
+    FFMContext *ffm = s->priv_data;
+#endif
+
     av_log(s, AV_LOG_ERROR, "resyncing\n");
     while (state != PACKET_ID) {
+#if HAVE_MMAP
+        if (ffm->map) {
+            if (ffm->pos >= ffm->map_size) {
+                av_log(s, AV_LOG_ERROR, "cannot find FFM syncword\n");
+                return -1;
+            }
+            state = (state << 8) | ffm->map[ffm->pos++];
+            continue;
+        }
+#endif
         if (url_feof(s->pb)) {
             av_log(s, AV_LOG_ERROR, "cannot find FFM syncword\n");
             return -1;
@@ -100,13 +260,66 @@ static int ffm_resync(AVFormatContext *s, int state)
     return 0;
 }
 
+static void ffm_seek_pos(AVFormatContext *s, int64_t pos)
+{
+#if HAVE_MMAP
+    FFMContext *ffm = s->priv_data;
+    if (ffm->map) {
+        ffm->pos = pos;
+        return;
+    }
+#endif
+    url_fseek(s->pb, pos, SEEK_SET);
+}
+
+/* read the header of the next packet, return a pointer to its data,
+   which is read in place if the file is mapped */
+static uint8_t *ffm_get_packet(AVFormatContext *s, int *fill_size,
+                               int *frame_offset)
+{
+    FFMContext *ffm = s->priv_data;
+    ByteIOContext *pb = s->pb;
+    int id;
+
+#if HAVE_MMAP
+    if (ffm->map) {
+        uint8_t *p;
+
+        if (ffm->pos + 2 > ffm->map_size)
+            return NULL;
+        id = AV_RB16(ffm->map + ffm->pos);
+        ffm->pos += 2;
+        if (id != PACKET_ID)
+            if (ffm_resync(s, id) < 0)
+                return NULL;
+        if (ffm->pos + ffm->packet_size - 2 > ffm->map_size)
+            return NULL;
+        p = ffm->map + ffm->pos;
+        *fill_size    = AV_RB16(p);
+        ffm->dts      = AV_RB64(p + 2);
+        *frame_offset = AV_RB16(p + 10);
+        ffm->pos += ffm->packet_size - 2;
+        return p + 12;
+    }
+#endif
+    id = get_be16(pb); /* PACKET_ID */
+    if (id != PACKET_ID)
+        if (ffm_resync(s, id) < 0)
+            return NULL;
+    *fill_size = get_be16(pb);
+    ffm->dts = get_be64(pb);
+    *frame_offset = get_be16(pb);
+    get_buffer(pb, ffm->packet, ffm->packet_size - FFM_HEADER_SIZE);
+    return ffm->packet;
+}
+
 /* first is true if we read the frame header */
 static int ffm_read_data(AVFormatContext *s,
                          uint8_t *buf, int size, int header)
 {
     FFMContext *ffm = s->priv_data;
-    ByteIOContext *pb = s->pb;
-    int len, fill_size, size1, frame_offset, id;
+    uint8_t *data;
+    int len, fill_size, size1, frame_offset;
 
     size1 = size;
     while (size > 0) {
@@ -117,27 +330,22 @@ static int ffm_read_data(AVFormatContext *s,
         if (len > size)
             len = size;
         if (len == 0) {
-            if (url_ftell(pb) == ffm->file_size)
-                url_fseek(pb, ffm->packet_size, SEEK_SET);
+            if (ffm_tell(s) == ffm->file_size)
+                ffm_seek_pos(s, ffm->packet_size);
     retry_read:
-            id = get_be16(pb); /* PACKET_ID */
-            if (id != PACKET_ID)
-                if (ffm_resync(s, id) < 0)
-                    return -1;
-            fill_size = get_be16(pb);
-            ffm->dts = get_be64(pb);
-            frame_offset = get_be16(pb);
-            get_buffer(pb, ffm->packet, ffm->packet_size - FFM_HEADER_SIZE);
-            ffm->packet_end = ffm->packet + (ffm->packet_size - FFM_HEADER_SIZE - fill_size);
-            if (ffm->packet_end < ffm->packet || frame_offset < 0)
+            data = ffm_get_packet(s, &fill_size, &frame_offset);
+            if (!data)
+                return -1;
+            ffm->packet_end = data + (ffm->packet_size - FFM_HEADER_SIZE - fill_size);
+            if (ffm->packet_end < data || frame_offset < 0)
                 return -1;
             /* if first packet or resynchronization packet, we must
                handle it specifically */
             if (ffm->first_packet || (frame_offset & 0x8000)) {
                 if (!frame_offset) {
                     /* This packet has no frame headers in it */
-                    if (url_ftell(pb) >= ffm->packet_size * 3) {
-                        url_fseek(pb, -ffm->packet_size * 2, SEEK_CUR);
+                    if (ffm_tell(s) >= ffm->packet_size * 3) {
+                        ffm_seek_pos(s, ffm_tell(s) - ffm->packet_size * 2);
                         goto retry_read;
                     }
                     /* This is bad, we cannot find a valid frame header */
@@ -146,11 +354,11 @@ static int ffm_read_data(AVFormatContext *s,
                 ffm->first_packet = 0;
                 if ((frame_offset & 0x7fff) < FFM_HEADER_SIZE)
                     return -1;
-                ffm->packet_ptr = ffm->packet + (frame_offset & 0x7fff) - FFM_HEADER_SIZE;
+                ffm->packet_ptr = data + (frame_offset & 0x7fff) - FFM_HEADER_SIZE;
                 if (!header)
                     break;
             } else {
-                ffm->packet_ptr = ffm->packet;
+                ffm->packet_ptr = data;
             }
             goto redo;
         }
@@ -170,7 +378,6 @@ static int ffm_read_data(AVFormatContext *s,
 static void ffm_seek1(AVFormatContext *s, int64_t pos1)
 {
     FFMContext *ffm = s->priv_data;
-    ByteIOContext *pb = s->pb;
     int64_t pos;
 
     pos = FFMIN(pos1, ffm->file_size - FFM_PACKET_SIZE);
@@ -178,17 +385,27 @@ static void ffm_seek1(AVFormatContext *s, int64_t pos1)
 #ifdef DEBUG_SEEK
     av_log(s, AV_LOG_DEBUG, "seek to %"PRIx64" -> %"PRIx64"\n", pos1, pos);
 #endif
-    url_fseek(pb, pos, SEEK_SET);
+    ffm_seek_pos(s, pos);
 }
 
 static int64_t get_dts(AVFormatContext *s, int64_t pos)
 {
+#if HAVE_MMAP
+    FFMContext *ffm = s->priv_data;
+#endif
     ByteIOContext *pb = s->pb;
     int64_t dts;
 
     ffm_seek1(s, pos);
-    url_fskip(pb, 4);
-    dts = get_be64(pb);
+#if HAVE_MMAP
+    if (ffm->map) {
+        dts = ffm->pos + 12 <= ffm->map_size ? AV_RB64(ffm->map + ffm->pos + 4) : 0;
+    } else
+#endif
+    {
+        url_fskip(pb, 4);
+        dts = get_be64(pb);
+    }
 #ifdef DEBUG_SEEK
     av_log(s, AV_LOG_DEBUG, "dts=%0.6f\n", dts / 1000000.0);
 #endif
@@ -268,6 +485,9 @@ static int ffm_read_header(AVFormatContext *s, AVFormatParameters *ap)
     ffm->packet_size = get_be32(pb);
     if (ffm->packet_size != FFM_PACKET_SIZE)
         goto fail;
+#if HAVE_MMAP
+    ffm_map_file(s);
+#endif
     ffm->write_index = get_be64(pb);
     /* get also filesize */
     if (!url_is_streamed(pb)) {
@@ -372,6 +592,7 @@ static int ffm_read_header(AVFormatContext *s, AVFormatParameters *ap)
         get_byte(pb);
 
     /* init packet demux */
+    ffm->pos = url_ftell(pb);
     ffm->packet_ptr = ffm->packet;
     ffm->packet_end = ffm->packet;
     ffm->frame_offset = 0;
@@ -386,6 +607,13 @@ static int ffm_read_header(AVFormatContext *s, AVFormatParameters *ap)
             av_free(st);
         }
     }
+#if HAVE_MMAP
+    if (ffm->map) {
+        munmap(ffm->map, ffm->map_size);
+        ffm->map = NULL;
+        close(ffm->fd);
+    }
+#endif
     return -1;
 }
 
@@ -402,7 +630,7 @@ static int ffm_read_packet(AVFormatContext *s, AVPacket *pkt)
             return ret;
 
         dprintf(s, "pos=%08"PRIx64" spos=%"PRIx64", write_index=%"PRIx64" size=%"PRIx64"\n",
-               url_ftell(s->pb), s->pb->pos, ffm->write_index, ffm->file_size);
+               ffm_tell(s), s->pb->pos, ffm->write_index, ffm->file_size);
         if (ffm_read_data(s, ffm->header, FRAME_HEADER_SIZE, 1) !=
             FRAME_HEADER_SIZE)
             return -1;
@@ -429,7 +657,7 @@ static int ffm_read_packet(AVFormatContext *s, AVPacket *pkt)
             ffm->read_state = READ_HEADER;
             return -1;
         }
-        pkt->pos = url_ftell(s->pb);
+        pkt->pos = ffm_tell(s);
         if (ffm->header[1] & FLAG_KEY_FRAME)
             pkt->flags |= PKT_FLAG_KEY;
 
@@ -502,6 +730,19 @@ static int ffm_seek(AVFormatContext *s, int stream_index, int64_t wanted_pts, in
     return 0;
 }
 
+static int ffm_read_close(AVFormatContext *s)
+{
+#if HAVE_MMAP
+    FFMContext *ffm = s->priv_data;
+
+    if (ffm->map) {
+        munmap(ffm->map, ffm->map_size);
+        close(ffm->fd);
+    }
+#endif
+    return 0;
+}
+
 static int ffm_probe(AVProbeData *p)
 {
     if (
@@ -518,6 +759,6 @@ AVInputFormat ffm_demuxer = {
     ffm_probe,
     ffm_read_header,
     ffm_read_packet,
-    NULL,
+    ffm_read_close,
     ffm_seek,
 };
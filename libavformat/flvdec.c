@@ -118,6 +118,78 @@ static int amf_get_string(ByteIOContext *ioc, char *buffer, int buffsize) {
     return length;
 }
 
+#define KEYFRAMES_TAG            "keyframes"
+#define KEYFRAMES_TIMESTAMP_TAG  "times"
+#define KEYFRAMES_BYTEOFFSET_TAG "filepositions"
+
+/**
+ * Adds the "keyframes" object written by metadata injectors (times in
+ * seconds and file positions of the video keyframes) to the index of the
+ * video stream, so that seeking does not need to scan the file.
+ * The read position is restored so that the caller can skip the object.
+ */
+static int parse_keyframes_index(AVFormatContext *s, ByteIOContext *ioc, AVStream *vstream, int64_t max_pos) {
+    unsigned int timeslen = 0, fileposlen = 0, i;
+    char str_val[256];
+    double *times = NULL;
+    double *filepositions = NULL;
+    int ret = 0;
+    int64_t initial_pos = url_ftell(ioc);
+
+    while (url_ftell(ioc) < max_pos - 2 && amf_get_string(ioc, str_val, sizeof(str_val)) > 0) {
+        double **current_array;
+        unsigned int arraylen;
+
+        if (get_byte(ioc) != AMF_DATA_TYPE_ARRAY)
+            break;
+
+        arraylen = get_be32(ioc);
+        if (arraylen > (max_pos - url_ftell(ioc)) / 9)
+            break;
+
+        if (!strcmp(KEYFRAMES_TIMESTAMP_TAG, str_val) && !times) {
+            current_array = &times;
+            timeslen      = arraylen;
+        } else if (!strcmp(KEYFRAMES_BYTEOFFSET_TAG, str_val) && !filepositions) {
+            current_array = &filepositions;
+            fileposlen    = arraylen;
+        } else // unexpected entry, the object is not used for the index
+            break;
+
+        if (!(*current_array = av_malloc(sizeof(**current_array) * arraylen))) {
+            ret = AVERROR(ENOMEM);
+            goto finish;
+        }
+
+        for (i = 0; i < arraylen; i++) {
+            if (get_byte(ioc) != AMF_DATA_TYPE_NUMBER)
+                goto finish;
+            (*current_array)[i] = av_int2dbl(get_be64(ioc));
+        }
+
+        if (times && filepositions)
+            break;
+    }
+
+    if (times && filepositions && timeslen == fileposlen) {
+        for (i = 0; i < fileposlen; i++) {
+            /* the positions point to the tag, the index to the preceding tag size */
+            if (filepositions[i] < 4 || times[i] < 0)
+                continue;
+            av_add_index_entry(vstream, (int64_t)filepositions[i] - 4,
+                               (int64_t)(times[i] * 1000 + 0.5), 0, 0,
+                               AVINDEX_KEYFRAME);
+        }
+    } else
+        av_log(s, AV_LOG_WARNING, "Invalid keyframes object, skipping.\n");
+
+finish:
+    av_freep(&times);
+    av_freep(&filepositions);
+    url_fseek(ioc, initial_pos, SEEK_SET);
+    return ret;
+}
+
 static int amf_parse_object(AVFormatContext *s, AVStream *astream, AVStream *vstream, const char *key, int64_t max_pos, int depth) {
     AVCodecContext *acodec, *vcodec;
     ByteIOContext *ioc;
@@ -142,6 +214,11 @@ static int amf_parse_object(AVFormatContext *s, AVStream *astream, AVStream *vst
         case AMF_DATA_TYPE_OBJECT: {
             unsigned int keylen;
 
+            if (vstream && key && depth == 1 && !strcmp(KEYFRAMES_TAG, key) &&
+                !url_is_streamed(ioc))
+                if (parse_keyframes_index(s, ioc, vstream, max_pos) < 0)
+                    return -1;
+
             while(url_ftell(ioc) < max_pos - 2 && (keylen = get_be16(ioc))) {
                 url_fskip(ioc, keylen); //skip key string
                 if(amf_parse_object(s, NULL, NULL, NULL, max_pos, depth + 1) < 0)
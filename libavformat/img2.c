@@ -24,6 +24,29 @@
 #include "libavutil/avstring.h"
 #include "avformat.h"
 #include <strings.h>
+#if HAVE_PTHREADS
+#include <pthread.h>
+#endif
+
+enum ImageJobState {
+    JOB_FREE,
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+};
+
+/**
+ * One image file to be read or written, possibly by a background thread.
+ */
+typedef struct ImageJob {
+    enum ImageJobState state;
+    int number;         ///< number of the image in the sequence
+    int stream_index;
+    uint8_t *data;
+    int size;
+    int size0;          ///< size of the first file, for guessing raw video dimensions
+    int ret;
+} ImageJob;
 
 typedef struct {
     int img_first;
@@ -32,6 +55,17 @@ typedef struct {
     int img_count;
     int is_pipe;
     char path[1024];
+#if HAVE_PTHREADS
+    int nb_threads;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    ImageJob *jobs;     ///< ring of nb_threads jobs, indexed by job counter
+    unsigned job_head;  ///< counter of the oldest job not yet collected
+    unsigned job_tail;  ///< counter of the next job to queue
+    int quit;
+    int (*run)(AVFormatContext *s, ImageJob *job);
+#endif
 } VideoData;
 
 typedef struct {
@@ -169,6 +203,129 @@ static int find_image_range(int *pfirst_index, int *plast_index,
     return -1;
 }
 
+#if HAVE_PTHREADS
+static void *io_worker(void *arg)
+{
+    AVFormatContext *s1 = arg;
+    VideoData *s = s1->priv_data;
+
+    pthread_mutex_lock(&s->lock);
+    while (!s->quit) {
+        ImageJob *job = NULL;
+        unsigned i;
+
+        for (i = s->job_head; i != s->job_tail; i++)
+            if (s->jobs[i % s->nb_threads].state == JOB_QUEUED) {
+                job = &s->jobs[i % s->nb_threads];
+                break;
+            }
+        if (!job) {
+            pthread_cond_wait(&s->cond, &s->lock);
+            continue;
+        }
+
+        job->state = JOB_RUNNING;
+        pthread_mutex_unlock(&s->lock);
+        job->ret = s->run(s1, job);
+        pthread_mutex_lock(&s->lock);
+        job->state = JOB_DONE;
+        pthread_cond_broadcast(&s->cond);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+static void io_stop(VideoData *s)
+{
+    int i;
+
+    pthread_mutex_lock(&s->lock);
+    s->quit = 1;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    for (i = 0; i < s->nb_threads; i++)
+        pthread_join(s->threads[i], NULL);
+
+    for (i = 0; i < s->nb_threads; i++)
+        av_freep(&s->jobs[i].data);
+    av_freep(&s->jobs);
+    av_freep(&s->threads);
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->lock);
+}
+
+static int io_start(AVFormatContext *s1, int nb_threads,
+                    int (*run)(AVFormatContext *s, ImageJob *job))
+{
+    VideoData *s = s1->priv_data;
+
+    s->jobs    = av_mallocz(nb_threads * sizeof(*s->jobs));
+    s->threads = av_mallocz(nb_threads * sizeof(*s->threads));
+    if (!s->jobs || !s->threads) {
+        av_freep(&s->jobs);
+        av_freep(&s->threads);
+        return AVERROR(ENOMEM);
+    }
+    s->run      = run;
+    s->quit     = 0;
+    s->job_head = s->job_tail = 0;
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+
+    for (s->nb_threads = 0; s->nb_threads < nb_threads; s->nb_threads++)
+        if (pthread_create(&s->threads[s->nb_threads], NULL, io_worker, s1))
+            break;
+    if (!s->nb_threads) {
+        io_stop(s);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+/**
+ * Queues a job; there must be a free one, i.e. less than nb_threads
+ * jobs may be pending.
+ */
+static void io_queue(VideoData *s, int number, int stream_index,
+                     uint8_t *data, int size)
+{
+    ImageJob *job = &s->jobs[s->job_tail % s->nb_threads];
+
+    job->number       = number;
+    job->stream_index = stream_index;
+    job->data         = data;
+    job->size         = size;
+    pthread_mutex_lock(&s->lock);
+    job->state = JOB_QUEUED;
+    s->job_tail++;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/**
+ * Waits for the oldest pending job to complete.
+ * The job must be released with io_release() once its data was used.
+ */
+static ImageJob *io_wait(VideoData *s)
+{
+    ImageJob *job = &s->jobs[s->job_head % s->nb_threads];
+
+    pthread_mutex_lock(&s->lock);
+    while (job->state != JOB_DONE)
+        pthread_cond_wait(&s->cond, &s->lock);
+    pthread_mutex_unlock(&s->lock);
+    return job;
+}
+
+static void io_release(VideoData *s, ImageJob *job)
+{
+    av_freep(&job->data);
+    pthread_mutex_lock(&s->lock);
+    job->state = JOB_FREE;
+    s->job_head++;
+    pthread_mutex_unlock(&s->lock);
+}
+#endif
 
 static int image_probe(AVProbeData *p)
 {
@@ -248,69 +405,145 @@ static int img_read_header(AVFormatContext *s1, AVFormatParameters *ap)
     return 0;
 }
 
-static int img_read_packet(AVFormatContext *s1, AVPacket *pkt)
+/**
+ * Reads all files of an image into a newly allocated job->data.
+ */
+static int read_image(AVFormatContext *s1, ImageJob *job)
 {
     VideoData *s = s1->priv_data;
+    AVCodecContext *codec= s1->streams[0]->codec;
     char filename[1024];
-    int i;
-    int size[3]={0}, ret[3]={0};
     ByteIOContext *f[3];
-    AVCodecContext *codec= s1->streams[0]->codec;
-
-    if (!s->is_pipe) {
-        /* loop over input */
-        if (s1->loop_input && s->img_number > s->img_last) {
-            s->img_number = s->img_first;
+    int size[3]={0};
+    int i, n, ret = 0;
+
+    if (av_get_frame_filename(filename, sizeof(filename),
+                              s->path, job->number)<0 && job->number > 1)
+        return AVERROR(EIO);
+    for(n=0; n<3; ){
+        if (url_fopen(&f[n], filename, URL_RDONLY) < 0) {
+            av_log(s1, AV_LOG_ERROR, "Could not open file : %s\n",filename);
+            ret = AVERROR(EIO);
+            goto end;
         }
-        if (s->img_number > s->img_last)
-            return AVERROR_EOF;
-        if (av_get_frame_filename(filename, sizeof(filename),
-                                  s->path, s->img_number)<0 && s->img_number > 1)
-            return AVERROR(EIO);
-        for(i=0; i<3; i++){
-            if (url_fopen(&f[i], filename, URL_RDONLY) < 0) {
-                av_log(s1, AV_LOG_ERROR, "Could not open file : %s\n",filename);
-                return AVERROR(EIO);
-            }
-            size[i]= url_fsize(f[i]);
+        size[n]= url_fsize(f[n]);
+        filename[ strlen(filename) - 1 ]= 'U' + n++;
 
-            if(codec->codec_id != CODEC_ID_RAWVIDEO)
-                break;
-            filename[ strlen(filename) - 1 ]= 'U' + i;
-        }
+        if(codec->codec_id != CODEC_ID_RAWVIDEO)
+            break;
+    }
 
-        if(codec->codec_id == CODEC_ID_RAWVIDEO && !codec->width)
-            infer_size(&codec->width, &codec->height, size[0]);
-    } else {
-        f[0] = s1->pb;
-        if (url_feof(f[0]))
-            return AVERROR(EIO);
-        size[0]= 4096;
+    job->data = av_malloc(size[0] + size[1] + size[2] + FF_INPUT_BUFFER_PADDING_SIZE);
+    if (!job->data) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    job->size  = 0;
+    job->size0 = size[0];
+    for(i=0; i<n; i++){
+        int r = size[i] ? get_buffer(f[i], job->data + job->size, size[i]) : 0;
+        if (r < 0 || (!i && r <= 0))
+            ret = AVERROR(EIO); /* signal EOF */
+        else
+            job->size += r;
     }
+    memset(job->data + job->size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+    if (ret < 0)
+        av_freep(&job->data);
+end:
+    for(i=0; i<n; i++)
+        url_fclose(f[i]);
+    return ret;
+}
 
-    av_new_packet(pkt, size[0] + size[1] + size[2]);
-    pkt->stream_index = 0;
-    pkt->flags |= PKT_FLAG_KEY;
+/**
+ * Wraps to the first image when looping.
+ * @return 0 if the end of the sequence was reached
+ */
+static int next_image(AVFormatContext *s1)
+{
+    VideoData *s = s1->priv_data;
 
-    pkt->size= 0;
-    for(i=0; i<3; i++){
-        if(size[i]){
-            ret[i]= get_buffer(f[i], pkt->data + pkt->size, size[i]);
-            if (!s->is_pipe)
-                url_fclose(f[i]);
-            if(ret[i]>0)
-                pkt->size += ret[i];
-        }
-    }
+    if (s1->loop_input && s->img_number > s->img_last)
+        s->img_number = s->img_first;
+    return s->img_number <= s->img_last;
+}
 
-    if (ret[0] <= 0 || ret[1]<0 || ret[2]<0) {
-        av_free_packet(pkt);
-        return AVERROR(EIO); /* signal EOF */
-    } else {
+static int img_read_packet(AVFormatContext *s1, AVPacket *pkt)
+{
+    VideoData *s = s1->priv_data;
+    AVCodecContext *codec= s1->streams[0]->codec;
+    ImageJob job = { 0 };
+    int ret;
+
+    if (s->is_pipe) {
+        ByteIOContext *f = s1->pb;
+        if (url_feof(f))
+            return AVERROR(EIO);
+        av_new_packet(pkt, 4096);
+        pkt->stream_index = 0;
+        pkt->flags |= PKT_FLAG_KEY;
+        ret= get_buffer(f, pkt->data, 4096);
+        if (ret <= 0) {
+            av_free_packet(pkt);
+            return AVERROR(EIO); /* signal EOF */
+        }
+        pkt->size = ret;
         s->img_count++;
         s->img_number++;
         return 0;
     }
+
+#if HAVE_PTHREADS
+    if (s1->io_threads > 0) {
+        ImageJob *done;
+
+        if (!s->jobs && (ret = io_start(s1, s1->io_threads, read_image)) < 0)
+            return ret;
+        /* keep nb_threads files in flight */
+        while (s->job_tail - s->job_head < s->nb_threads && next_image(s1))
+            io_queue(s, s->img_number++, 0, NULL, 0);
+        if (s->job_head == s->job_tail)
+            return AVERROR_EOF;
+        done = io_wait(s);
+        job  = *done;
+        done->data = NULL;
+        io_release(s, done);
+    } else
+#endif
+    {
+        if (!next_image(s1))
+            return AVERROR_EOF;
+        job.number = s->img_number;
+        job.ret    = read_image(s1, &job);
+        if (job.ret >= 0)
+            s->img_number++;
+    }
+    if (job.ret < 0)
+        return job.ret;
+
+    if(codec->codec_id == CODEC_ID_RAWVIDEO && !codec->width)
+        infer_size(&codec->width, &codec->height, job.size0);
+
+    av_init_packet(pkt);
+    pkt->data     = job.data;
+    pkt->size     = job.size;
+    pkt->destruct = av_destruct_packet;
+    pkt->stream_index = 0;
+    pkt->flags |= PKT_FLAG_KEY;
+    s->img_count++;
+    return 0;
+}
+
+static int img_read_close(AVFormatContext *s1)
+{
+#if HAVE_PTHREADS
+    VideoData *s = s1->priv_data;
+
+    if (s->jobs)
+        io_stop(s);
+#endif
+    return 0;
 }
 
 #if CONFIG_IMAGE2_MUXER || CONFIG_IMAGE2PIPE_MUXER
@@ -333,39 +566,14 @@ static int img_write_header(AVFormatContext *s)
     return 0;
 }
 
-static int img_write_packet(AVFormatContext *s, AVPacket *pkt)
+static int write_image(AVFormatContext *s, AVCodecContext *codec,
+                       ByteIOContext *pb[3], const uint8_t *data, int size)
 {
-    VideoData *img = s->priv_data;
-    ByteIOContext *pb[3];
-    char filename[1024];
-    AVCodecContext *codec= s->streams[ pkt->stream_index ]->codec;
-    int i;
-
-    if (!img->is_pipe) {
-        if (av_get_frame_filename(filename, sizeof(filename),
-                                  img->path, img->img_number) < 0 && img->img_number>1) {
-            av_log(s, AV_LOG_ERROR, "Could not get frame filename from pattern\n");
-            return AVERROR(EIO);
-        }
-        for(i=0; i<3; i++){
-            if (url_fopen(&pb[i], filename, URL_WRONLY) < 0) {
-                av_log(s, AV_LOG_ERROR, "Could not open file : %s\n",filename);
-                return AVERROR(EIO);
-            }
-
-            if(codec->codec_id != CODEC_ID_RAWVIDEO)
-                break;
-            filename[ strlen(filename) - 1 ]= 'U' + i;
-        }
-    } else {
-        pb[0] = s->pb;
-    }
-
     if(codec->codec_id == CODEC_ID_RAWVIDEO){
         int ysize = codec->width * codec->height;
-        put_buffer(pb[0], pkt->data        , ysize);
-        put_buffer(pb[1], pkt->data + ysize, (pkt->size - ysize)/2);
-        put_buffer(pb[2], pkt->data + ysize +(pkt->size - ysize)/2, (pkt->size - ysize)/2);
+        put_buffer(pb[0], data        , ysize);
+        put_buffer(pb[1], data + ysize, (size - ysize)/2);
+        put_buffer(pb[2], data + ysize +(size - ysize)/2, (size - ysize)/2);
         put_flush_packet(pb[1]);
         put_flush_packet(pb[2]);
         url_fclose(pb[1]);
@@ -375,7 +583,7 @@ static int img_write_packet(AVFormatContext *s, AVPacket *pkt)
             AVStream *st = s->streams[0];
             if(st->codec->extradata_size > 8 &&
                AV_RL32(st->codec->extradata+4) == MKTAG('j','p','2','h')){
-                if(pkt->size < 8 || AV_RL32(pkt->data+4) != MKTAG('j','p','2','c'))
+                if(size < 8 || AV_RL32(data+4) != MKTAG('j','p','2','c'))
                     goto error;
                 put_be32(pb[0], 12);
                 put_tag (pb[0], "jP  ");
@@ -386,25 +594,117 @@ static int img_write_packet(AVFormatContext *s, AVPacket *pkt)
                 put_be32(pb[0], 0);
                 put_tag (pb[0], "jp2 ");
                 put_buffer(pb[0], st->codec->extradata, st->codec->extradata_size);
-            }else if(pkt->size < 8 ||
+            }else if(size < 8 ||
                      (!st->codec->extradata_size &&
-                      AV_RL32(pkt->data+4) != MKTAG('j','P',' ',' '))){ // signature
+                      AV_RL32(data+4) != MKTAG('j','P',' ',' '))){ // signature
             error:
                 av_log(s, AV_LOG_ERROR, "malformated jpeg2000 codestream\n");
                 return -1;
             }
         }
-        put_buffer(pb[0], pkt->data, pkt->size);
+        put_buffer(pb[0], data, size);
     }
     put_flush_packet(pb[0]);
-    if (!img->is_pipe) {
-        url_fclose(pb[0]);
+    return 0;
+}
+
+/**
+ * Writes job->data to the file(s) of image job->number.
+ */
+static int write_image_file(AVFormatContext *s, ImageJob *job)
+{
+    VideoData *img = s->priv_data;
+    ByteIOContext *pb[3];
+    char filename[1024];
+    AVCodecContext *codec= s->streams[ job->stream_index ]->codec;
+    int i, ret;
+
+    if (av_get_frame_filename(filename, sizeof(filename),
+                              img->path, job->number) < 0 && job->number>1) {
+        av_log(s, AV_LOG_ERROR, "Could not get frame filename from pattern\n");
+        return AVERROR(EIO);
+    }
+    for(i=0; i<3; i++){
+        if (url_fopen(&pb[i], filename, URL_WRONLY) < 0) {
+            av_log(s, AV_LOG_ERROR, "Could not open file : %s\n",filename);
+            return AVERROR(EIO);
+        }
+
+        if(codec->codec_id != CODEC_ID_RAWVIDEO)
+            break;
+        filename[ strlen(filename) - 1 ]= 'U' + i;
     }
 
+    ret = write_image(s, codec, pb, job->data, job->size);
+    url_fclose(pb[0]);
+    return ret;
+}
+
+static int img_write_packet(AVFormatContext *s, AVPacket *pkt)
+{
+    VideoData *img = s->priv_data;
+    int ret;
+
+    if (img->is_pipe) {
+        ByteIOContext *pb[3] = { s->pb };
+        ret = write_image(s, s->streams[ pkt->stream_index ]->codec, pb,
+                          pkt->data, pkt->size);
+    }
+#if HAVE_PTHREADS
+    else if (s->io_threads > 0) {
+        uint8_t *data;
+
+        if (!img->jobs && (ret = io_start(s, s->io_threads, write_image_file)) < 0)
+            return ret;
+        /* bound the queue, collecting the oldest write when it is full */
+        if (img->job_tail - img->job_head == img->nb_threads) {
+            ImageJob *done = io_wait(img);
+            ret = done->ret;
+            io_release(img, done);
+            if (ret < 0)
+                return ret;
+        }
+        if (!(data = av_malloc(pkt->size)))
+            return AVERROR(ENOMEM);
+        memcpy(data, pkt->data, pkt->size);
+        io_queue(img, img->img_number, pkt->stream_index, data, pkt->size);
+        ret = 0;
+    }
+#endif
+    else {
+        ImageJob job = { 0 };
+        job.number       = img->img_number;
+        job.stream_index = pkt->stream_index;
+        job.data         = pkt->data;
+        job.size         = pkt->size;
+        ret = write_image_file(s, &job);
+    }
+    if (ret < 0)
+        return ret;
+
     img->img_number++;
     return 0;
 }
 
+static int img_write_trailer(AVFormatContext *s)
+{
+    int ret = 0;
+#if HAVE_PTHREADS
+    VideoData *img = s->priv_data;
+
+    if (img->jobs) {
+        while (img->job_head != img->job_tail) {
+            ImageJob *done = io_wait(img);
+            if (done->ret < 0)
+                ret = done->ret;
+            io_release(img, done);
+        }
+        io_stop(img);
+    }
+#endif
+    return ret;
+}
+
 #endif /* CONFIG_IMAGE2_MUXER || CONFIG_IMAGE2PIPE_MUXER */
 
 /* input */
@@ -416,7 +716,7 @@ AVInputFormat image2_demuxer = {
     image_probe,
     img_read_header,
     img_read_packet,
-    NULL,
+    img_read_close,
     NULL,
     NULL,
     AVFMT_NOFILE,
@@ -445,7 +745,7 @@ AVOutputFormat image2_muxer = {
     CODEC_ID_MJPEG,
     img_write_header,
     img_write_packet,
-    NULL,
+    img_write_trailer,
     .flags= AVFMT_NOTIMESTAMPS | AVFMT_NOFILE
 };
 #endif
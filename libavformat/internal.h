@@ -35,4 +35,18 @@ void av_program_add_stream_index(AVFormatContext *ac, int progid, unsigned int i
 void ff_interleave_add_packet(AVFormatContext *s, AVPacket *pkt,
                               int (*compare)(AVFormatContext *, AVPacket *, AVPacket *));
 
+/**
+ * Rewinds the ByteIOContext using the specified buffer containing the first
+ * buf_size bytes of the file, so that they are read again from memory.
+ * On success the ByteIOContext uses the buffer as its internal one, so it
+ * must have been allocated with av_malloc() and is freed along with the
+ * ByteIOContext. On failure the buffer is still owned by the caller.
+ *
+ * @param buf buffer containing the first buf_size bytes of the file
+ * @param buf_size size of buf
+ * @return 0 in case of success, a negative value corresponding to an
+ * AVERROR code in case of failure
+ */
+int ff_rewind_with_probe_data(ByteIOContext *s, unsigned char *buf, int buf_size);
+
 #endif /* AVFORMAT_INTERNAL_H */
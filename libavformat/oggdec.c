@@ -38,6 +38,7 @@
 #define DECODER_BUFFER_SIZE MAX_PAGE_SIZE
 
 static const struct ogg_codec * const ogg_codecs[] = {
+    &ff_skeleton_codec,
     &ff_speex_codec,
     &ff_vorbis_codec,
     &ff_theora_codec,
@@ -50,6 +51,8 @@ static const struct ogg_codec * const ogg_codecs[] = {
     NULL
 };
 
+static uint64_t ogg_gptopts(AVFormatContext * s, int i, uint64_t gp);
+
 //FIXME We could avoid some structure duplication
 static int
 ogg_save (AVFormatContext * s)
@@ -293,6 +296,15 @@ ogg_read_page (AVFormatContext * s, int *str)
     os->granule = gp;
     os->flags = flags;
 
+    /* remember where the page ends and its time, as ogg_read_timestamp()
+       would find them, so that later seeks can start close to the target */
+    if (gp != -1 && gp != 0 && os->codec && os->header > -1 &&
+        !url_is_streamed(bc)) {
+        ff_reduce_index(s, idx);
+        av_add_index_entry(s->streams[idx], url_ftell(bc),
+                           ogg_gptopts(s, idx, gp), 0, 0, AVINDEX_KEYFRAME);
+    }
+
     if (str)
         *str = idx;
 
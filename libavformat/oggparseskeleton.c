@@ -0,0 +1,114 @@
+/*
+ * Ogg Skeleton parser
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "libavutil/intreadwrite.h"
+#include "avformat.h"
+#include "oggdec.h"
+
+#define INDEX_HEADER_SIZE 42
+
+/**
+ * Reads a variable length integer of a Skeleton index, 7 bits per byte
+ * starting with the least significant ones, the last byte has its high
+ * bit set.
+ * @return the position after the integer, NULL if it does not end
+ *         before end
+ */
+static const uint8_t *read_var_length(const uint8_t *p, const uint8_t *end,
+                                      int64_t *v)
+{
+    int shift = 0;
+
+    *v = 0;
+    while (p < end && shift < 63) {
+        int b = *p++;
+        *v |= (int64_t)(b & 0x7f) << shift;
+        shift += 7;
+        if (b & 0x80)
+            return p;
+    }
+    return NULL;
+}
+
+/**
+ * Adds the keypoints of a Skeleton 4 index packet to the index of the
+ * stream it describes, so that seeking can start from them.
+ */
+static void skeleton_index(AVFormatContext *s, const uint8_t *p, int size)
+{
+    struct ogg *ogg = s->priv_data;
+    const uint8_t *end = p + size;
+    int64_t nkeypoints, denom, offset = 0, time = 0, i;
+    uint32_t serial;
+    AVStream *st;
+    int j;
+
+    if (size < INDEX_HEADER_SIZE)
+        return;
+
+    serial     = AV_RL32(p + 6);
+    nkeypoints = AV_RL64(p + 10);
+    denom      = AV_RL64(p + 18);
+    if (denom <= 0 || denom > INT_MAX || nkeypoints < 0)
+        return;
+
+    for (j = 0; j < ogg->nstreams; j++)
+        if (ogg->streams[j].serial == serial)
+            break;
+    if (j == ogg->nstreams)
+        return;
+    st = s->streams[j];
+
+    p += INDEX_HEADER_SIZE;
+    for (i = 0; i < nkeypoints; i++) {
+        int64_t doffset, dtime;
+        if (!(p = read_var_length(p, end, &doffset)) ||
+            !(p = read_var_length(p, end, &dtime)))
+            break;
+        offset += doffset;
+        time   += dtime;
+        av_add_index_entry(st, offset,
+                           av_rescale_q(time, (AVRational){1, (int)denom}, st->time_base),
+                           0, 0, AVINDEX_KEYFRAME);
+    }
+}
+
+static int skeleton_header(AVFormatContext *s, int idx)
+{
+    struct ogg *ogg = s->priv_data;
+    struct ogg_stream *os = ogg->streams + idx;
+    AVStream *st = s->streams[idx];
+    uint8_t *p = os->buf + os->pstart;
+
+    st->codec->codec_type = CODEC_TYPE_DATA;
+
+    /* fishead and fisbone packets carry nothing needed for demuxing */
+    if (os->psize >= 6 && !memcmp(p, "index\0", 6))
+        skeleton_index(s, p, os->psize);
+
+    /* every Skeleton packet is a header, the stream has no data */
+    return 1;
+}
+
+const struct ogg_codec ff_skeleton_codec = {
+    .magic = "fishead",
+    .magicsize = 8,
+    .header = skeleton_header,
+};
@@ -340,16 +340,10 @@ static void rtp_send_mpegts_raw(AVFormatContext *s1,
     }
 }
 
-/* write an RTP packet. 'buf1' must contain a single specific frame. */
-static int rtp_write_packet(AVFormatContext *s1, AVPacket *pkt)
+void ff_rtp_start_frame(AVFormatContext *s1, int64_t pts)
 {
     RTPMuxContext *s = s1->priv_data;
-    AVStream *st = s1->streams[0];
     int rtcp_bytes;
-    int size= pkt->size;
-    uint8_t *buf1= pkt->data;
-
-    dprintf(s1, "%d: write len=%d\n", pkt->stream_index, size);
 
     rtcp_bytes = ((s->octet_count - s->last_octet_count) * RTCP_TX_RATIO_NUM) /
         RTCP_TX_RATIO_DEN;
@@ -359,7 +353,19 @@ static int rtp_write_packet(AVFormatContext *s1, AVPacket *pkt)
         s->last_octet_count = s->octet_count;
         s->first_packet = 0;
     }
-    s->cur_timestamp = s->base_timestamp + pkt->pts;
+    s->cur_timestamp = s->base_timestamp + pts;
+}
+
+/* write an RTP packet. 'buf1' must contain a single specific frame. */
+static int rtp_write_packet(AVFormatContext *s1, AVPacket *pkt)
+{
+    AVStream *st = s1->streams[0];
+    int size= pkt->size;
+    uint8_t *buf1= pkt->data;
+
+    dprintf(s1, "%d: write len=%d\n", pkt->stream_index, size);
+
+    ff_rtp_start_frame(s1, pkt->pts);
 
     switch(st->codec->codec_id) {
     case CODEC_ID_PCM_MULAW:
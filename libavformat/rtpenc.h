@@ -56,6 +56,12 @@ typedef struct RTPMuxContext RTPMuxContext;
 
 void ff_rtp_send_data(AVFormatContext *s1, const uint8_t *buf1, int len, int m);
 
+/**
+ * Begin a new frame: send an RTCP sender report if one is due and set the
+ * timestamp for the RTP packets of the frame to pts.
+ */
+void ff_rtp_start_frame(AVFormatContext *s1, int64_t pts);
+
 void ff_rtp_send_h264(AVFormatContext *s1, const uint8_t *buf1, int size);
 void ff_rtp_send_h263(AVFormatContext *s1, const uint8_t *buf1, int size);
 void ff_rtp_send_aac(AVFormatContext *s1, const uint8_t *buff, int size);
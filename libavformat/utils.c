@@ -477,24 +477,22 @@ int av_open_input_file(AVFormatContext **ic_ptr, const char *filename,
 
         for(probe_size= PROBE_BUF_MIN; probe_size<=PROBE_BUF_MAX && !fmt; probe_size<<=1){
             int score= probe_size < PROBE_BUF_MAX ? AVPROBE_SCORE_MAX/4 : 0;
-            /* read probe data */
+            int ret;
+            /* read only the probe data not read in the previous rounds */
             pd->buf= av_realloc(pd->buf, probe_size + AVPROBE_PADDING_SIZE);
-            pd->buf_size = get_buffer(pb, pd->buf, probe_size);
-
-            if ((int)pd->buf_size < 0) {
-                err = pd->buf_size;
-                goto fail;
-            }
+            ret = get_buffer(pb, pd->buf + pd->buf_size, probe_size - pd->buf_size);
 
-            memset(pd->buf+pd->buf_size, 0, AVPROBE_PADDING_SIZE);
-            if (url_fseek(pb, 0, SEEK_SET) < 0) {
-                url_fclose(pb);
-                if (url_fopen(&pb, filename, URL_RDONLY) < 0) {
-                    pb = NULL;
-                    err = AVERROR(EIO);
+            if (ret < 0) {
+                /* a short file is probed with the data it has */
+                if (ret != AVERROR_EOF || !pd->buf_size) {
+                    err = ret;
                     goto fail;
                 }
+                ret = 0;
             }
+            pd->buf_size += ret;
+
+            memset(pd->buf+pd->buf_size, 0, AVPROBE_PADDING_SIZE);
             /* guess file format */
             fmt = av_probe_input_format2(pd, 1, &score);
             if(fmt){
@@ -504,6 +502,21 @@ int av_open_input_file(AVFormatContext **ic_ptr, const char *filename,
                     av_log(logctx, AV_LOG_DEBUG, "Probed with size=%d and score=%d\n", probe_size, score);
             }
         }
+
+        /* hand the probe data to the ByteIOContext so that the demuxer
+           reads it again from memory, instead of seeking back or
+           reopening the file; nothing was read if the format was forced */
+        if (pd->buf && ff_rewind_with_probe_data(pb, pd->buf, pd->buf_size) < 0) {
+            if (url_fseek(pb, 0, SEEK_SET) < 0) {
+                url_fclose(pb);
+                if (url_fopen(&pb, filename, URL_RDONLY) < 0) {
+                    pb = NULL;
+                    err = AVERROR(EIO);
+                    goto fail;
+                }
+            }
+        } else
+            pd->buf = NULL;
         av_freep(&pd->buf);
     }
 
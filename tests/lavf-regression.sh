@@ -174,6 +174,8 @@ fi
 
 if [ -n "$do_wav" ] ; then
 do_audio_only wav
+# forced format, the file is not probed
+do_ffmpeg_crc $file -f wav -i $target_path/$file
 fi
 
 if [ -n "$do_alaw" ] ; then
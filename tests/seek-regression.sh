@@ -12,6 +12,21 @@ logfile="$datadir/seek.regression"
 reffile="$1"
 
 list=`grep '^tests/data/[ab]-' "$reffile"`
+
+# benchmark mode: report seek cost instead of comparing against the reference
+if [ "$4" = "bench" ]; then
+    shift 4
+    for i in $list ; do
+        printf "%-32s " $i
+        $target_exec $target_path/tests/seek_test -b 100 $target_path/$i
+    done
+    for i in "$@" ; do
+        printf "%-32s " $i
+        $target_exec $target_path/tests/seek_test -b 100 $i
+    done
+    exit 0
+fi
+
 rm -f $logfile
 for i in $list ; do
     echo ---------------- >> $logfile
@@ -25,6 +25,7 @@
 #include <string.h>
 
 #include "libavutil/common.h"
+#include "libavutil/lfg.h"
 #include "libavformat/avformat.h"
 
 #undef exit
@@ -57,12 +58,115 @@ static void ts_str(char buffer[60], int64_t ts, AVRational base)
     snprintf(buffer, 60, "%9f", tsval);
 }
 
+/* I/O statistics gathered below the ByteIOContext buffer */
+static void *io_opaque;
+static int     (*io_read)(void *opaque, uint8_t *buf, int buf_size);
+static int64_t (*io_seek)(void *opaque, int64_t offset, int whence);
+static int64_t io_bytes, io_seeks;
+
+static int count_read(void *opaque, uint8_t *buf, int buf_size)
+{
+    int ret = io_read(io_opaque, buf, buf_size);
+    if (ret > 0)
+        io_bytes += ret;
+    return ret;
+}
+
+static int64_t count_seek(void *opaque, int64_t offset, int whence)
+{
+    if (whence != AVSEEK_SIZE)
+        io_seeks++;
+    return io_seek(io_opaque, offset, whence);
+}
+
+/**
+ * Seeks to count random positions and reports per seek the wall time
+ * until the first keyframe is returned, the bytes read and the number of
+ * seeks done on the underlying protocol, and the distance of the landing
+ * keyframe from the target.
+ */
+static void benchmark(AVFormatContext *ic, int count)
+{
+    ByteIOContext *pb = ic->pb;
+    AVLFG lfg;
+    int64_t start = ic->start_time == AV_NOPTS_VALUE ? 0 : ic->start_time;
+    int64_t time_sum = 0, time_max = 0, bytes_sum = 0, seeks_sum = 0;
+    int64_t dist_sum = 0, dist_max = 0;
+    int i, failed = 0, video = -1;
+
+    if (!pb || !pb->seek || ic->duration == AV_NOPTS_VALUE || ic->duration <= 0) {
+        printf("not seekable or unknown duration\n");
+        return;
+    }
+
+    for (i = 0; i < ic->nb_streams; i++)
+        if (ic->streams[i]->codec->codec_type == CODEC_TYPE_VIDEO) {
+            video = i;
+            break;
+        }
+
+    io_opaque = pb->opaque;
+    io_read   = pb->read_packet;
+    io_seek   = pb->seek;
+    pb->read_packet = count_read;
+    pb->seek        = count_seek;
+
+    av_lfg_init(&lfg, 0xdeadbeef);
+    for (i = 0; i < count; i++) {
+        int64_t target = start + av_rescale(av_lfg_get(&lfg), ic->duration, UINT32_MAX);
+        int64_t t0, t, dist = INT64_MAX;
+        AVPacket pkt;
+
+        io_bytes = io_seeks = 0;
+        t0 = av_gettime();
+        if (avformat_seek_file(ic, -1, INT64_MIN, target, target, 0) >= 0) {
+            while (av_read_frame(ic, &pkt) >= 0) {
+                AVStream *st = ic->streams[pkt.stream_index];
+                int found = (video < 0 || pkt.stream_index == video) &&
+                            (pkt.flags & PKT_FLAG_KEY) && pkt.dts != AV_NOPTS_VALUE;
+                if (found)
+                    dist = av_rescale_q(pkt.dts, st->time_base, AV_TIME_BASE_Q) - target;
+                av_free_packet(&pkt);
+                if (found)
+                    break;
+            }
+        }
+        t = av_gettime() - t0;
+
+        if (dist == INT64_MAX) {
+            failed++;
+            continue;
+        }
+        time_sum  += t;
+        time_max   = FFMAX(time_max, t);
+        bytes_sum += io_bytes;
+        seeks_sum += io_seeks;
+        dist_sum  += FFABS(dist);
+        dist_max   = FFMAX(dist_max, FFABS(dist));
+    }
+
+    pb->read_packet = io_read;
+    pb->seek        = io_seek;
+
+    if (failed == count) {
+        printf("seeks:%d failed:%d\n", count, failed);
+        return;
+    }
+    count -= failed;
+    printf("seeks:%d failed:%d time:%"PRId64"us (max %"PRId64"us) "
+           "read:%"PRId64" bytes url_fseek:%.1f distance:%fs (max %fs)\n",
+           count, failed, time_sum / count, time_max, bytes_sum / count,
+           (double)seeks_sum / count,
+           dist_sum / (double)count / AV_TIME_BASE, dist_max / (double)AV_TIME_BASE);
+}
+
 int main(int argc, char **argv)
 {
     const char *filename;
     AVFormatContext *ic;
     int i, ret, stream_id;
     int64_t timestamp;
+    int bench = 0;
     AVFormatParameters params, *ap= &params;
     memset(ap, 0, sizeof(params));
     ap->channels=1;
@@ -71,8 +175,14 @@ int main(int argc, char **argv)
     /* initialize libavcodec, and register all codecs and formats */
     av_register_all();
 
+    if (argc == 4 && !strcmp(argv[1], "-b")) {
+        bench = FFMAX(atoi(argv[2]), 1);
+        argv += 2;
+        argc -= 2;
+    }
     if (argc != 2) {
-        printf("usage: %s input_file\n"
+        printf("usage: %s [-b count] input_file\n"
+               "-b count  benchmark count random seeks instead of the regression test\n"
                "\n", argv[0]);
         exit(1);
     }
@@ -98,6 +208,11 @@ int main(int argc, char **argv)
         exit(1);
     }
 
+    if (bench) {
+        benchmark(ic, bench);
+        return 0;
+    }
+
     for(i=0; ; i++){
         AVPacket pkt;
         AVStream *av_uninit(st);